@@ -0,0 +1,160 @@
+#include "assetloader.h"
+#include "texturestream.h"
+
+#include <memory>
+#include <vector>
+
+UploadQueue::UploadQueue(size_t capacity) {
+    this->capacity = capacity > 0 ? capacity : 1;
+    closed = false;
+}
+
+void UploadQueue::push(Upload upload) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this]() { return closed || uploads.size() < capacity; });
+        if (closed) return;
+        uploads.push_back(upload);
+    }
+    not_empty.notify_one();
+}
+
+size_t UploadQueue::drain(size_t max) {
+    size_t ran = 0;
+
+    while (ran < max) {
+        Upload upload;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (uploads.empty()) break;
+            upload = uploads.front();
+            uploads.pop_front();
+        }
+        not_full.notify_one();
+
+        // Outside the lock, uploads are where the actual GL work happens
+        upload();
+        ran++;
+    }
+
+    return ran;
+}
+
+void UploadQueue::waitForWork(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_empty.wait_for(lock, timeout, [this]() { return closed || !uploads.empty(); });
+}
+
+void UploadQueue::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        uploads.clear();
+    }
+    not_full.notify_all();
+    not_empty.notify_all();
+}
+
+size_t UploadQueue::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return uploads.size();
+}
+
+AssetLoader::AssetLoader(unsigned int threads, size_t upload_capacity)
+    : uploads(upload_capacity), pool(threads) {
+}
+
+AssetLoader::~AssetLoader() {
+    // Workers stuck on a full queue would keep the pool from joining.
+    // Whatever was still in flight is dropped, its futures report a broken promise.
+    uploads.close();
+}
+
+AssetLoader::TextureEntry AssetLoader::textureEntry(const std::string& requested) {
+    std::string path = CanonicalPath(requested);
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = textures.find(path);
+    if (it != textures.end()) return it->second;
+
+    std::shared_ptr<std::promise<void>> queued = std::make_shared<std::promise<void>>();
+    std::shared_ptr<std::promise<Texture>> ready = std::make_shared<std::promise<Texture>>();
+
+    TextureEntry entry;
+    entry.queued = queued->get_future().share();
+    entry.ready = ready->get_future().share();
+    textures[path] = entry;
+
+    UploadQueue* uploads = &this->uploads;
+
+    pool.submit([path, queued, ready, uploads]() {
+        std::shared_ptr<TextureData> data = std::make_shared<TextureData>();
+        Texture::Decode(path, *data);
+        data->buildMips();
+
+        // Only creates the texture, the texels follow over the next frames
+        uploads->push([data, ready]() {
+            ready->set_value(TextureStreamer::begin(data));
+        });
+        queued->set_value();
+    });
+
+    return entry;
+}
+
+std::shared_future<Texture> AssetLoader::texture(const std::string& path) {
+    return textureEntry(path).ready;
+}
+
+void AssetLoader::forgetTexture(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    textures.erase(CanonicalPath(path));
+}
+
+std::shared_future<Model> AssetLoader::model(const std::string& path) {
+    std::shared_ptr<std::promise<Model>> ready = std::make_shared<std::promise<Model>>();
+    std::shared_future<Model> result = ready->get_future().share();
+
+    pool.submit([this, path, ready]() {
+        std::shared_ptr<ModelData> data = std::make_shared<ModelData>();
+        Model::Parse(path, *data);
+
+        // Every texture goes out on its own task, so one model's textures
+        // decode in parallel too
+        std::string directory = path.substr(0, path.find_last_of('/'));
+        std::vector<std::string> names;
+        std::vector<TextureEntry> entries;
+
+        for (const CachedMesh& c : data->cached.meshes) {
+            const std::string* used[] = { &c.diffuse_texture, &c.specular_texture, &c.normal_texture };
+            for (const std::string* name : used) {
+                if (name->empty()) continue;
+                names.push_back(directory + '/' + *name);
+                entries.push_back(textureEntry(names.back()));
+            }
+        }
+
+        // Once every texture upload is queued, queueing this one behind them
+        // means they have all run by the time it does
+        for (const TextureEntry& e : entries) {
+            pool.waitFor(e.queued);
+        }
+
+        std::unordered_map<std::string, std::shared_future<Texture>> loaded;
+        for (size_t i = 0; i < names.size(); i++) {
+            loaded[names[i]] = entries[i].ready;
+        }
+
+        uploads.push([data, ready, loaded]() {
+            ready->set_value(Model::FromData(*data, [&loaded](const std::string& p) {
+                return loaded.at(p).get();
+            }));
+        });
+    });
+
+    return result;
+}
+
+size_t AssetLoader::update(size_t max) {
+    return uploads.drain(max);
+}
@@ -0,0 +1,106 @@
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <chrono>
+
+#include <GL/glew.h>
+
+#include "assman.h"
+#include "models.h"
+#include "threadpool.h"
+
+// Finished CPU work waiting for the GL context. Workers block on push while
+// it is full, which caps how much decoded data can pile up ahead of the
+// main thread.
+class UploadQueue {
+public:
+    typedef std::function<void()> Upload;
+
+    explicit UploadQueue(size_t capacity);
+
+    // Any thread. Dropped silently once closed.
+    void push(Upload upload);
+
+    // Main thread only, runs up to max uploads, returns how many it ran
+    size_t drain(size_t max);
+
+    // Main thread only, until something is pushed or timeout passes
+    void waitForWork(std::chrono::milliseconds timeout);
+
+    // Unblocks every pusher for good, for shutting down
+    void close();
+
+    size_t size();
+
+private:
+    std::deque<Upload> uploads;
+    size_t capacity;
+    bool closed;
+
+    std::mutex mutex;
+    std::condition_variable not_full, not_empty;
+};
+
+// Decodes textures and parses models on a thread pool. Only the GL object
+// creation at the end goes through the upload queue, which the main thread
+// empties with update() or while waiting on a result. Texels themselves
+// are left to TextureStreamer.
+//
+// Textures are loaded once per canonical path until forgotten, including
+// the ones models ask for.
+class AssetLoader {
+public:
+    // 0 threads means ThreadPool's default
+    explicit AssetLoader(unsigned int threads = 0, size_t upload_capacity = 8);
+    ~AssetLoader();
+
+    // The texture type is left UNSET, callers know what they asked for
+    std::shared_future<Texture> texture(const std::string& path);
+    std::shared_future<Model> model(const std::string& path);
+
+    // Next time path is asked for it loads again. Whoever got the texture
+    // before is responsible for deleting it, see AssetManager::unload.
+    void forgetTexture(const std::string& path);
+
+    // Main thread only. Runs up to max pending uploads, returns how many ran.
+    size_t update(size_t max = (size_t)-1);
+
+    // Main thread only. Keeps uploading until f is ready.
+    template <typename T>
+    T wait(const std::shared_future<T>& f) {
+        while (f.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (update(1) == 0) uploads.waitForWork(std::chrono::milliseconds(1));
+        }
+        return f.get();
+    }
+
+    unsigned int threads() const { return pool.size(); }
+
+private:
+    struct TextureEntry {
+        // Set once the upload is in the queue, anything queued later runs after it
+        std::shared_future<void> queued;
+        std::shared_future<Texture> ready;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<std::string, TextureEntry> textures;
+
+    // Declared last so the workers go away before what they use
+    UploadQueue uploads;
+    ThreadPool pool;
+
+    TextureEntry textureEntry(const std::string& path);
+
+    AssetLoader(const AssetLoader&);
+    AssetLoader& operator=(const AssetLoader&);
+};
+
+#endif
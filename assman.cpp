@@ -0,0 +1,306 @@
+#include "shader.h"
+#include "models.h"
+#include "assetloader.h"
+#include "texturestream.h"
+#include "glstate.h"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+template <typename T>
+struct Slot {
+    std::string key;
+    uint32_t generation = 0;
+    uint32_t references = 0;
+    bool live = false;
+    T value;
+};
+
+struct TextureAsset {
+    std::shared_future<Texture> texture;
+};
+
+struct ModelAsset {
+    std::shared_future<Model> loading;
+    std::unique_ptr<Model> model;
+
+    // What the model's meshes use, given back when it goes
+    std::vector<TextureHandle> textures;
+};
+
+struct MeshAsset {
+    std::unique_ptr<Mesh> mesh;
+};
+
+// Slots are reused through the free list, bumping the generation each time
+template <typename T, typename A>
+struct Table {
+    std::vector<Slot<A>> slots;
+    std::vector<uint32_t> free;
+    std::unordered_map<std::string, uint32_t> by_key;
+
+    Slot<A>* find(Handle<T> handle) {
+        if (!handle.valid() || handle.index >= slots.size()) return NULL;
+        Slot<A>& slot = slots[handle.index];
+        return slot.live && slot.generation == handle.generation ? &slot : NULL;
+    }
+
+    // Existing entry with a new reference, or a fresh slot with its first
+    Handle<T> acquire(const std::string& key, bool& created) {
+        Handle<T> handle;
+
+        auto it = by_key.find(key);
+        if (it != by_key.end()) {
+            Slot<A>& slot = slots[it->second];
+            slot.references++;
+            handle.index = it->second;
+            handle.generation = slot.generation;
+            created = false;
+            return handle;
+        }
+
+        if (free.empty()) {
+            free.push_back(slots.size());
+            slots.push_back(Slot<A>());
+        }
+
+        handle.index = free.back();
+        free.pop_back();
+
+        Slot<A>& slot = slots[handle.index];
+        slot.key = key;
+        slot.generation++;
+        if (slot.generation == 0) slot.generation = 1;
+        slot.references = 1;
+        slot.live = true;
+        slot.value = A();
+
+        handle.generation = slot.generation;
+        by_key[key] = handle.index;
+        created = true;
+        return handle;
+    }
+
+    void remove(Handle<T> handle) {
+        Slot<A>& slot = slots[handle.index];
+        by_key.erase(slot.key);
+        slot.live = false;
+        slot.references = 0;
+        slot.value = A();
+        free.push_back(handle.index);
+    }
+
+    unsigned int live() const {
+        return slots.size() - free.size();
+    }
+};
+
+struct State {
+    Table<Texture, TextureAsset> textures;
+    Table<Model, ModelAsset> models;
+    Table<Mesh, MeshAsset> meshes;
+
+    // Made on first use, that has to be after GL is up
+    std::unique_ptr<AssetLoader> loader;
+
+    unsigned int requests, loads;
+};
+
+State state;
+
+AssetLoader& loader() {
+    if (!state.loader) state.loader.reset(new AssetLoader());
+    return *state.loader;
+}
+
+template <typename T>
+bool isReady(const std::shared_future<T>& f) {
+    return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+// Models only get looked at once they are done, which is also when they
+// take their references to the textures they ended up using
+Model* resolve(Slot<ModelAsset>& slot) {
+    ModelAsset& asset = slot.value;
+
+    if (!asset.model) {
+        asset.model.reset(new Model(loader().wait(asset.loading)));
+
+        for (const std::string& path : asset.model->texture_paths) {
+            asset.textures.push_back(AssetManager::texture(path));
+        }
+    }
+
+    return asset.model.get();
+}
+
+}
+
+TextureHandle AssetManager::texture(const std::string& path) {
+    std::string key = CanonicalPath(path);
+    state.requests++;
+
+    bool created;
+    TextureHandle handle = state.textures.acquire(key, created);
+
+    if (created) {
+        state.loads++;
+        state.textures.find(handle)->value.texture = loader().texture(key);
+    }
+
+    return handle;
+}
+
+ModelHandle AssetManager::model(const std::string& path) {
+    std::string key = CanonicalPath(path);
+    state.requests++;
+
+    bool created;
+    ModelHandle handle = state.models.acquire(key, created);
+
+    if (created) {
+        state.loads++;
+        state.models.find(handle)->value.loading = loader().model(key);
+    }
+
+    return handle;
+}
+
+MeshHandle AssetManager::mesh(const std::string& name, const std::function<Mesh()>& make) {
+    state.requests++;
+
+    bool created;
+    MeshHandle handle = state.meshes.acquire(name, created);
+
+    if (created) {
+        state.loads++;
+        state.meshes.find(handle)->value.mesh.reset(new Mesh(make()));
+    }
+
+    return handle;
+}
+
+void AssetManager::retain(TextureHandle handle) {
+    if (Slot<TextureAsset>* slot = state.textures.find(handle)) slot->references++;
+}
+
+void AssetManager::retain(ModelHandle handle) {
+    if (Slot<ModelAsset>* slot = state.models.find(handle)) slot->references++;
+}
+
+void AssetManager::retain(MeshHandle handle) {
+    if (Slot<MeshAsset>* slot = state.meshes.find(handle)) slot->references++;
+}
+
+void AssetManager::release(TextureHandle handle) {
+    Slot<TextureAsset>* slot = state.textures.find(handle);
+    if (slot && --slot->references == 0) unload(handle);
+}
+
+void AssetManager::release(ModelHandle handle) {
+    Slot<ModelAsset>* slot = state.models.find(handle);
+    if (slot && --slot->references == 0) unload(handle);
+}
+
+void AssetManager::release(MeshHandle handle) {
+    Slot<MeshAsset>* slot = state.meshes.find(handle);
+    if (slot && --slot->references == 0) unload(handle);
+}
+
+void AssetManager::unload(TextureHandle handle) {
+    Slot<TextureAsset>* slot = state.textures.find(handle);
+    if (!slot) return;
+
+    // Can't delete what doesn't exist yet, so a texture still loading finishes first
+    Texture t = loader().wait(slot->value.texture);
+    if (t.id != 0) {
+        TextureStreamer::cancel(t.id);
+        glDeleteTextures(1, &t.id);
+        GLState::forgetTexture(t.id);
+    }
+
+    loader().forgetTexture(slot->key);
+    state.textures.remove(handle);
+}
+
+// Vertex and index ranges go back to the GeometryBuffer, so anything still
+// holding a copy of the model's meshes must not draw them after this
+void AssetManager::unload(ModelHandle handle) {
+    Slot<ModelAsset>* slot = state.models.find(handle);
+    if (!slot) return;
+
+    resolve(*slot);
+
+    if (slot->value.model) {
+        for (const Mesh& mesh : slot->value.model->meshes) {
+            GeometryBuffer::release(mesh.range());
+        }
+    }
+
+    std::vector<TextureHandle> textures;
+    textures.swap(slot->value.textures);
+    state.models.remove(handle);
+
+    for (TextureHandle t : textures) {
+        release(t);
+    }
+}
+
+void AssetManager::unload(MeshHandle handle) {
+    Slot<MeshAsset>* slot = state.meshes.find(handle);
+    if (!slot) return;
+
+    if (slot->value.mesh) GeometryBuffer::release(slot->value.mesh->range());
+    state.meshes.remove(handle);
+}
+
+bool AssetManager::ready(TextureHandle handle) {
+    Slot<TextureAsset>* slot = state.textures.find(handle);
+    return slot && isReady(slot->value.texture);
+}
+
+bool AssetManager::ready(ModelHandle handle) {
+    Slot<ModelAsset>* slot = state.models.find(handle);
+    return slot && (slot->value.model || isReady(slot->value.loading));
+}
+
+const Texture* AssetManager::get(TextureHandle handle) {
+    Slot<TextureAsset>* slot = state.textures.find(handle);
+    if (!slot) return NULL;
+
+    loader().wait(slot->value.texture);
+    return &slot->value.texture.get();
+}
+
+Model* AssetManager::get(ModelHandle handle) {
+    Slot<ModelAsset>* slot = state.models.find(handle);
+    return slot ? resolve(*slot) : NULL;
+}
+
+const Mesh* AssetManager::get(MeshHandle handle) {
+    Slot<MeshAsset>* slot = state.meshes.find(handle);
+    return slot ? slot->value.mesh.get() : NULL;
+}
+
+void AssetManager::update() {
+    if (state.loader) state.loader->update();
+    TextureStreamer::update();
+}
+
+void AssetManager::shutdown() {
+    state.loader.reset();
+    TextureStreamer::shutdown();
+}
+
+AssetManager::Stats AssetManager::stats() {
+    Stats s;
+    s.requests = state.requests;
+    s.loads = state.loads;
+    s.textures = state.textures.live();
+    s.models = state.models.live();
+    s.meshes = state.meshes.live();
+    return s;
+}
@@ -2,12 +2,113 @@
 #define ASSMAN_H
 
 #include <string>
+#include <vector>
 #include <GL/gl.h>
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <stdint.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <sys/stat.h>
 #include "stb_image.h"
+#include "glstate.h"
+#include "dds.h"
+#include "mappedfile.h"
 
+// Everything Texture::FromPath does before it needs a GL context, either the
+// cooked file mapped and checked or the image decoded. Fine to fill on any
+// thread. Not copyable, same as the MappedFile it may hold.
+struct TextureData {
+    std::string path;
+    int width = 0, height = 0;
+
+    // Cooked, the levels follow each other in the mapped file
+    MappedFile file;
+    uint32_t fourcc = 0;
+    GLenum compressed_format = 0;
+    uint32_t levels = 0;
+    const unsigned char* level_data = NULL;
+
+    // Not cooked, straight from stb_image
+    unsigned char* pixels = NULL;
+    int channels = 0;
+
+    // Level 1 and down for images that weren't cooked, only after buildMips
+    std::vector<std::vector<unsigned char>> mips;
+
+    TextureData() {}
+    ~TextureData() {
+        if (pixels) stbi_image_free(pixels);
+    }
+
+    TextureData(const TextureData&) = delete;
+    TextureData& operator=(const TextureData&) = delete;
+
+    uint32_t levelCount() const {
+        return compressed_format ? levels : 1 + mips.size();
+    }
+
+    int levelWidth(uint32_t level) const { return std::max(1, width >> level); }
+    int levelHeight(uint32_t level) const { return std::max(1, height >> level); }
+
+    size_t levelBytes(uint32_t level) const {
+        if (compressed_format) return DDSLevelBytes(fourcc, levelWidth(level), levelHeight(level));
+        return (size_t)levelWidth(level) * levelHeight(level) * channels;
+    }
+
+    const unsigned char* levelData(uint32_t level) const {
+        if (!compressed_format) return level == 0 ? pixels : mips[level - 1].data();
+
+        const unsigned char* data = level_data;
+        for (uint32_t i = 0; i < level; i++) data += levelBytes(i);
+        return data;
+    }
+
+    // Roughly what it will take on the GPU, mips included
+    size_t bytes() const {
+        if (compressed_format) {
+            size_t total = 0;
+            for (uint32_t i = 0; i < levels; i++) total += levelBytes(i);
+            return total;
+        }
+        return (size_t)width * height * 4 * 4 / 3;
+    }
+
+    // The rest of the chain down to 1x1, a 2x2 box over the bytes as they
+    // are like glGenerateMipmap does. Cooked textures bring their own.
+    void buildMips() {
+        if (compressed_format || pixels == NULL || !mips.empty()) return;
+
+        for (uint32_t level = 1; levelWidth(level - 1) > 1 || levelHeight(level - 1) > 1; level++) {
+            const unsigned char* src = levelData(level - 1);
+            int sw = levelWidth(level - 1), sh = levelHeight(level - 1);
+            int w = levelWidth(level), h = levelHeight(level);
+
+            std::vector<unsigned char> dst((size_t)w * h * channels);
+
+            for (int y = 0; y < h; y++) {
+                int y0 = std::min(y * 2, sh - 1), y1 = std::min(y * 2 + 1, sh - 1);
+                for (int x = 0; x < w; x++) {
+                    int x0 = std::min(x * 2, sw - 1), x1 = std::min(x * 2 + 1, sw - 1);
+                    for (int c = 0; c < channels; c++) {
+                        int sum = src[((size_t)y0 * sw + x0) * channels + c] + src[((size_t)y0 * sw + x1) * channels + c]
+                                + src[((size_t)y1 * sw + x0) * channels + c] + src[((size_t)y1 * sw + x1) * channels + c];
+                        dst[((size_t)y * w + x) * channels + c] = (sum + 2) / 4;
+                    }
+                }
+            }
+
+            mips.push_back(dst);
+        }
+    }
+};
+
+// Just the GL name and what it is used for, cheap to copy into every mesh.
+// Where it came from is AssetManager's business.
 struct Texture {
-    unsigned int id;
+    unsigned int id = 0;
 
     enum class Type {
         DIFFUSE,
@@ -17,51 +118,139 @@ struct Texture {
     };
 
     Texture::Type type = Texture::Type::UNSET;
-    std::string path;
 
-    static Texture FromPath(std::string path) {
-        int w, h, dim;
-        unsigned char* img_data = stbi_load(path.c_str(), &w, &h, &dim, 0);
+    // For whatever is bound to unit 0
+    static void setSampling() {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
 
-        Texture t;
+    // What tools/cook.cpp made of path, if it is there and no older than path
+    static bool decodeCooked(const std::string& path, TextureData& data) {
+        std::string cooked = path + ".dds";
+
+        struct stat source_stat, cooked_stat;
+        if (stat(cooked.c_str(), &cooked_stat) != 0) return false;
+        if (stat(path.c_str(), &source_stat) == 0 && cooked_stat.st_mtime < source_stat.st_mtime) return false;
+
+        if (!data.file.open(cooked)) return false;
+
+        const size_t header_size = sizeof(uint32_t) + sizeof(DDSHeader);
+        if (data.file.size() < header_size) return false;
+
+        uint32_t magic;
+        DDSHeader header;
+        std::memcpy(&magic, data.file.data(), sizeof(magic));
+        std::memcpy(&header, data.file.data() + sizeof(magic), sizeof(header));
+
+        if (magic != DDS_MAGIC || header.size != sizeof(DDSHeader) || !(header.format.flags & DDPF_FOURCC)) return false;
+
+        GLenum format;
+        switch (header.format.fourcc) {
+        case DDS_FOURCC_BC1:
+            format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;  break;
+        case DDS_FOURCC_BC3:
+            format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+        case DDS_FOURCC_BC5:
+            format = GL_COMPRESSED_RG_RGTC2;           break;
+        default:
+            return false;
+        }
+
+        // RGTC is core, S3TC is an extension, though every desktop driver has it
+        if (format != GL_COMPRESSED_RG_RGTC2 && !GLEW_EXT_texture_compression_s3tc) return false;
+
+        data.fourcc = header.format.fourcc;
+        data.compressed_format = format;
+        data.width = header.width;
+        data.height = header.height;
+        data.levels = header.mip_count ? header.mip_count : 1;
+        data.level_data = data.file.data() + header_size;
+
+        // Check the whole chain is there before anything gets created from it
+        if (header_size + data.bytes() > data.file.size()) {
+            fprintf(stderr, "Error: cooked texture \'%s\' is truncated, using \'%s\'\n", cooked.c_str(), path.c_str());
+            data.compressed_format = 0;
+            data.file.close();
+            return false;
+        }
 
-        if (img_data == NULL) {
+        return true;
+    }
+
+    // The CPU half of FromPath, false if there is nothing to upload
+    static bool Decode(const std::string& path, TextureData& data) {
+        data.path = path;
+
+        if (decodeCooked(path, data)) return true;
+
+        data.pixels = stbi_load(path.c_str(), &data.width, &data.height, &data.channels, 0);
+
+        if (data.pixels == NULL) {
             fprintf(stderr, "Error: Texture at path \'%s\' failed to load.\n", path.c_str());
-            stbi_image_free(img_data);
-            return t;
+            return false;
         }
 
-        GLenum format;
+        return true;
+    }
 
-        switch (dim) {
+    // Matching format for uncompressed data
+    static GLenum pixelFormat(const TextureData& data) {
+        switch (data.channels) {
         case 1:
-            format = GL_RED;  break;
+            return GL_RED;
         case 3:
-            format = GL_RGB;  break;
+            return GL_RGB;
         case 4:
-            format = GL_RGBA; break;
+            return GL_RGBA;
         default:
-            fprintf(stderr, "Error: could not determine pixel format for \'%s\', defaulting to GL_RGB", path.c_str());
-            format = GL_RGB;  break;
+            fprintf(stderr, "Error: could not determine pixel format for \'%s\', defaulting to GL_RGB", data.path.c_str());
+            return GL_RGB;
         }
+    }
 
-        glGenTextures(1, &t.id);
-        glBindTexture(GL_TEXTURE_2D, t.id);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, format, GL_UNSIGNED_BYTE, img_data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    // The GL half of FromPath, main thread only
+    static Texture FromData(const TextureData& data) {
+        Texture t;
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        if (data.compressed_format) {
+            glGenTextures(1, &t.id);
+            GLState::bindTexture(0, GL_TEXTURE_2D, t.id);
+
+            for (uint32_t i = 0; i < data.levels; i++) {
+                glCompressedTexImage2D(
+                    GL_TEXTURE_2D, i, data.compressed_format, data.levelWidth(i), data.levelHeight(i),
+                    0, data.levelBytes(i), data.levelData(i)
+                );
+            }
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, data.levels - 1);
+            setSampling();
+            return t;
+        }
+
+        if (data.pixels == NULL) return t;
 
-        stbi_image_free(img_data);
+        GLenum format = pixelFormat(data);
+
+        glGenTextures(1, &t.id);
+        GLState::bindTexture(0, GL_TEXTURE_2D, t.id);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, data.width, data.height, 0, format, GL_UNSIGNED_BYTE, data.pixels);
+        glGenerateMipmap(GL_TEXTURE_2D);
 
-        t.path = path;
+        setSampling();
 
         return t;
     }
 
+    static Texture FromPath(std::string path) {
+        TextureData data;
+        Decode(path, data);
+        return FromData(data);
+    }
+
     static Texture DiffuseFromPath(std::string path) {
         Texture t = Texture::FromPath(path);
         t.type = Texture::Type::DIFFUSE;
@@ -81,4 +270,93 @@ struct Texture {
     }
 };
 
+// Normalized absolute form of path, so that different spellings of the same
+// file share one cache entry. Falls back to path as given if it doesn't exist.
+inline std::string CanonicalPath(const std::string& path) {
+#ifdef _WIN32
+    char resolved[_MAX_PATH];
+    if (_fullpath(resolved, path.c_str(), sizeof(resolved))) return resolved;
+#else
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved)) return resolved;
+#endif
+    return path;
+}
+
+class Model;
+class Mesh;
+
+// Index into one of AssetManager's tables plus the generation of the slot
+// when it was handed out, so a handle to something unloaded is caught
+// instead of silently pointing at whatever reused the slot
+template <typename T>
+struct Handle {
+    uint32_t index = 0;
+    uint32_t generation = 0; // Never 0 for a real handle
+
+    bool valid() const { return generation != 0; }
+    bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+typedef Handle<Texture> TextureHandle;
+typedef Handle<Model> ModelHandle;
+typedef Handle<Mesh> MeshHandle;
+
+// Process wide cache of everything loaded from disk, plus named meshes.
+// Asking for the same canonical path twice returns the same handle and
+// costs one load and one GPU allocation.
+//
+// Every texture(), model() and mesh() call adds a reference that release()
+// gives back, whatever drops to zero is unloaded. unload() does it right
+// away, references or not, after which get() on old handles returns NULL.
+//
+// Loading goes through an AssetLoader, so requests made up front decode in
+// parallel and get() only waits for what isn't done yet. Main thread only.
+class AssetManager {
+public:
+    struct Stats {
+        unsigned int requests; // Every texture(), model() and mesh() call
+        unsigned int loads;    // The ones that weren't already cached
+        unsigned int textures, models, meshes; // Currently loaded
+    };
+
+    static TextureHandle texture(const std::string& path);
+    static ModelHandle model(const std::string& path);
+
+    // Meshes built in code, make only runs the first time name is asked for
+    static MeshHandle mesh(const std::string& name, const std::function<Mesh()>& make);
+
+    static void retain(TextureHandle handle);
+    static void retain(ModelHandle handle);
+    static void retain(MeshHandle handle);
+
+    static void release(TextureHandle handle);
+    static void release(ModelHandle handle);
+    static void release(MeshHandle handle);
+
+    static void unload(TextureHandle handle);
+    static void unload(ModelHandle handle);
+    static void unload(MeshHandle handle);
+
+    // True once get() won't have to wait
+    static bool ready(TextureHandle handle);
+    static bool ready(ModelHandle handle);
+
+    // NULL for stale handles, waits on anything still loading. Textures can
+    // be used right away, their bigger levels fill in over the next frames.
+    static const Texture* get(TextureHandle handle);
+    static Model* get(ModelHandle handle);
+    static const Mesh* get(MeshHandle handle);
+
+    // Once a frame, finishes whatever loaded in the background and streams
+    // in the next TEXTURE_UPLOAD_BUDGET bytes of texels
+    static void update();
+
+    // Stops the loader threads, before the GL context goes away
+    static void shutdown();
+
+    static Stats stats();
+};
+
 #endif
@@ -0,0 +1,155 @@
+#ifndef BEZIER_H
+#define BEZIER_H
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define BEZIER_SSE
+#include <xmmintrin.h>
+#endif
+
+// Curves with up to this many control points are evaluated with de
+// Casteljau in a buffer on the stack, longer ones with the Bernstein form
+#define BEZIER_SCRATCH_POINTS 16
+
+// Parameters wrap around, only the fraction is used: at(1.25) is at(0.25)
+inline float BezierWrap(double t) {
+    return (float)(t - (long)t);
+}
+
+// Fixed number of control points, N of them. The curve is kept in the
+// power basis, sum of coefficient k * t^k, so at() is N - 1 multiply-adds
+// with no temporaries. Only meant for low degrees, the power basis loses
+// precision as the degree goes up.
+template <class T, int N = 0>
+struct Bezier {
+    static_assert(N >= 1 && N <= 8, "use Bezier<T> for long curves");
+
+    Bezier() {}
+
+    explicit Bezier(const T (&points)[N]) {
+        set(points);
+    }
+
+    // N points
+    void set(const T* points) {
+        for (int i = 0; i < N; i++) {
+            control_points[i] = points[i];
+        }
+
+        // coefficient k = C(n, k) * sum over i <= k of (-1)^(k - i) * C(k, i) * P_i
+        const int n = N - 1;
+        float n_choose_k = 1.0f;
+        for (int k = 0; k <= n; k++) {
+            T sum = T(0.0f);
+            float k_choose_i = 1.0f;
+            for (int i = 0; i <= k; i++) {
+                float sign = (k - i) & 1 ? -1.0f : 1.0f;
+                sum += control_points[i] * (sign * k_choose_i);
+                k_choose_i = k_choose_i * (k - i) / (i + 1);
+            }
+            coefficients[k] = sum * n_choose_k;
+            n_choose_k = n_choose_k * (n - k) / (k + 1);
+        }
+    }
+
+    const T& point(int i) const { return control_points[i]; }
+
+    T at(double t) const {
+        float x = BezierWrap(t);
+        T r = coefficients[N - 1];
+        for (int k = N - 2; k >= 0; k--) {
+            r = r * x + coefficients[k];
+        }
+        return r;
+    }
+
+    // out[i] = at(ts[i]). Four parameters at a time where there's SSE, for
+    // T made of floats only.
+    void at(const double* ts, T* out, size_t count) const {
+        size_t i = 0;
+
+#ifdef BEZIER_SSE
+        static_assert(sizeof(T) % sizeof(float) == 0, "batched Bezier needs float components");
+        const int C = sizeof(T) / sizeof(float);
+        const float* a = reinterpret_cast<const float*>(coefficients);
+
+        for (; i + 4 <= count; i += 4) {
+            __m128 x = _mm_setr_ps(BezierWrap(ts[i]), BezierWrap(ts[i + 1]), BezierWrap(ts[i + 2]), BezierWrap(ts[i + 3]));
+
+            for (int c = 0; c < C; c++) {
+                __m128 r = _mm_set1_ps(a[(N - 1) * C + c]);
+                for (int k = N - 2; k >= 0; k--) {
+                    r = _mm_add_ps(_mm_mul_ps(r, x), _mm_set1_ps(a[k * C + c]));
+                }
+
+                float lanes[4];
+                _mm_storeu_ps(lanes, r);
+                for (int lane = 0; lane < 4; lane++) {
+                    reinterpret_cast<float*>(&out[i + lane])[c] = lanes[lane];
+                }
+            }
+        }
+#endif
+
+        for (; i < count; i++) {
+            out[i] = at(ts[i]);
+        }
+    }
+
+private:
+    T control_points[N];
+    T coefficients[N];
+};
+
+// Any number of control points, decided at runtime
+template <class T>
+struct Bezier<T, 0> {
+    std::vector<T> control_points;
+
+    T at(double t) const {
+        float x = BezierWrap(t);
+        size_t count = control_points.size();
+
+        if (count == 0) return T(0.0f);
+
+        if (count <= BEZIER_SCRATCH_POINTS) {
+            // de Casteljau, each level overwrites the one before it in place
+            T scratch[BEZIER_SCRATCH_POINTS];
+            for (size_t i = 0; i < count; i++) {
+                scratch[i] = control_points[i];
+            }
+            for (size_t level = count - 1; level > 0; level--) {
+                for (size_t i = 0; i < level; i++) {
+                    scratch[i] = glm::mix(scratch[i], scratch[i + 1], x);
+                }
+            }
+            return scratch[0];
+        }
+
+        // Bernstein polynomials, nested so the powers and binomials come
+        // along one step at a time. O(n) and no scratch at all.
+        size_t n = count - 1;
+        float u = 1.0f - x;
+        float x_power = 1.0f;
+        float n_choose_i = 1.0f;
+        T r = control_points[0] * u;
+        for (size_t i = 1; i < n; i++) {
+            x_power *= x;
+            n_choose_i = n_choose_i * (n - i + 1) / i;
+            r = (r + control_points[i] * (x_power * n_choose_i)) * u;
+        }
+        return r + control_points[n] * (x_power * x);
+    }
+
+    // out[i] = at(ts[i])
+    void at(const double* ts, T* out, size_t count) const {
+        for (size_t i = 0; i < count; i++) {
+            out[i] = at(ts[i]);
+        }
+    }
+};
+
+#endif
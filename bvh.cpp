@@ -0,0 +1,330 @@
+#include "bvh.h"
+
+#include <cmath>
+#include <algorithm>
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF_SIZE 4
+#define BVH_STACK_SIZE 64
+
+static float surface_area(glm::vec3 min, glm::vec3 max) {
+    glm::vec3 e = max - min;
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+// What the traversal needs per ray, the inverse direction worked out once
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 dir;
+    glm::vec3 inv_dir;
+};
+
+// Slab test, returns the entry distance or INFINITY on a miss or when the
+// box starts beyond max_t. Written out per axis, this is most of a pick.
+static inline float ray_aabb(const Ray& r, const glm::vec3& min, const glm::vec3& max, float max_t) {
+    float tx0 = (min.x - r.origin.x) * r.inv_dir.x, tx1 = (max.x - r.origin.x) * r.inv_dir.x;
+    float ty0 = (min.y - r.origin.y) * r.inv_dir.y, ty1 = (max.y - r.origin.y) * r.inv_dir.y;
+    float tz0 = (min.z - r.origin.z) * r.inv_dir.z, tz1 = (max.z - r.origin.z) * r.inv_dir.z;
+
+    float enter = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+    float exit = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), max_t));
+
+    return enter <= exit ? enter : INFINITY;
+}
+
+// Entry distance or INFINITY. A ray starting inside the sphere misses it,
+// otherwise whatever the camera stands in would win every pick.
+static inline float ray_sphere(const Ray& r, const BVH::Bounds& s) {
+    float x = s.center.x - r.origin.x, y = s.center.y - r.origin.y, z = s.center.z - r.origin.z;
+    float c = x * x + y * y + z * z - s.radius * s.radius;
+    if (c < 0.0f) return INFINITY;
+
+    float b = r.dir.x * x + r.dir.y * y + r.dir.z * z;
+    float test = b * b - c;
+
+    if (b < 0.0f || test < 0.0f) return INFINITY;
+
+    return b - std::sqrt(test);
+}
+
+void BVH::build(const std::vector<Bounds>& input) {
+    spheres = input;
+    nodes.clear();
+    order.resize(spheres.size());
+    leaf_of.resize(spheres.size());
+
+    if (spheres.empty()) return;
+
+    std::vector<glm::vec3> centroids(spheres.size());
+    for (size_t i = 0; i < spheres.size(); i++) {
+        order[i] = i;
+        centroids[i] = spheres[i].center;
+    }
+
+    nodes.reserve(2 * spheres.size());
+
+    Node root;
+    root.first = 0;
+    root.count = spheres.size();
+    root.parent = -1;
+    nodes.push_back(root);
+    refit_leaf(0);
+
+    subdivide(0, centroids);
+}
+
+void BVH::refit_leaf(int n) {
+    Node& node = nodes[n];
+    node.min = glm::vec3(INFINITY);
+    node.max = glm::vec3(-INFINITY);
+
+    for (int i = node.first; i < node.first + node.count; i++) {
+        const Bounds& s = spheres[order[i]];
+        node.min = glm::min(node.min, s.center - glm::vec3(s.radius));
+        node.max = glm::max(node.max, s.center + glm::vec3(s.radius));
+        leaf_of[order[i]] = n;
+    }
+}
+
+void BVH::subdivide(int n, const std::vector<glm::vec3>& centroids) {
+    int first = nodes[n].first;
+    int count = nodes[n].count;
+
+    if (count <= BVH_MAX_LEAF_SIZE) return;
+
+    glm::vec3 cmin = glm::vec3(INFINITY);
+    glm::vec3 cmax = glm::vec3(-INFINITY);
+    for (int i = first; i < first + count; i++) {
+        cmin = glm::min(cmin, centroids[order[i]]);
+        cmax = glm::max(cmax, centroids[order[i]]);
+    }
+
+    // Try every bin boundary on every axis, keep the cheapest split
+    int best_axis = -1;
+    int best_split = 0;
+    float best_cost = surface_area(nodes[n].min, nodes[n].max) * count;
+
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = cmax[axis] - cmin[axis];
+        if (extent <= 0.0f) continue;
+
+        struct Bin {
+            glm::vec3 min, max;
+            int count;
+        } bins[BVH_BINS];
+
+        for (int b = 0; b < BVH_BINS; b++) {
+            bins[b].min = glm::vec3(INFINITY);
+            bins[b].max = glm::vec3(-INFINITY);
+            bins[b].count = 0;
+        }
+
+        float scale = BVH_BINS / extent;
+        for (int i = first; i < first + count; i++) {
+            const Bounds& s = spheres[order[i]];
+            int b = glm::min(BVH_BINS - 1, (int)((centroids[order[i]][axis] - cmin[axis]) * scale));
+            bins[b].min = glm::min(bins[b].min, s.center - glm::vec3(s.radius));
+            bins[b].max = glm::max(bins[b].max, s.center + glm::vec3(s.radius));
+            bins[b].count++;
+        }
+
+        // Sweep from the left, then from the right, to get both sides of each split
+        float left_area[BVH_BINS - 1], right_area[BVH_BINS - 1];
+        int left_count[BVH_BINS - 1], right_count[BVH_BINS - 1];
+
+        glm::vec3 lmin = glm::vec3(INFINITY), lmax = glm::vec3(-INFINITY);
+        glm::vec3 rmin = glm::vec3(INFINITY), rmax = glm::vec3(-INFINITY);
+        int lsum = 0, rsum = 0;
+
+        for (int b = 0; b < BVH_BINS - 1; b++) {
+            lsum += bins[b].count;
+            lmin = glm::min(lmin, bins[b].min);
+            lmax = glm::max(lmax, bins[b].max);
+            left_count[b] = lsum;
+            left_area[b] = lsum ? surface_area(lmin, lmax) : 0.0f;
+
+            int r = BVH_BINS - 1 - b;
+            rsum += bins[r].count;
+            rmin = glm::min(rmin, bins[r].min);
+            rmax = glm::max(rmax, bins[r].max);
+            right_count[r - 1] = rsum;
+            right_area[r - 1] = rsum ? surface_area(rmin, rmax) : 0.0f;
+        }
+
+        for (int b = 0; b < BVH_BINS - 1; b++) {
+            float cost = left_area[b] * left_count[b] + right_area[b] * right_count[b];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    // Splitting isn't worth it
+    if (best_axis == -1) return;
+
+    float scale = BVH_BINS / (cmax[best_axis] - cmin[best_axis]);
+    int* mid = std::partition(&order[first], &order[first] + count, [&](int i) {
+        int b = glm::min(BVH_BINS - 1, (int)((centroids[i][best_axis] - cmin[best_axis]) * scale));
+        return b <= best_split;
+    });
+
+    int left_count = mid - &order[first];
+    if (left_count == 0 || left_count == count) return;
+
+    int left = nodes.size();
+
+    Node l, r;
+    l.first = first;
+    l.count = left_count;
+    l.parent = n;
+    r.first = first + left_count;
+    r.count = count - left_count;
+    r.parent = n;
+
+    nodes.push_back(l);
+    nodes.push_back(r);
+
+    nodes[n].first = left;
+    nodes[n].count = 0;
+
+    refit_leaf(left);
+    refit_leaf(left + 1);
+
+    subdivide(left, centroids);
+    subdivide(left + 1, centroids);
+}
+
+void BVH::update(int i, const Bounds& sphere) {
+    spheres[i] = sphere;
+
+    int n = leaf_of[i];
+    refit_leaf(n);
+
+    for (n = nodes[n].parent; n != -1; n = nodes[n].parent) {
+        const Node& l = nodes[nodes[n].first];
+        const Node& r = nodes[nodes[n].first + 1];
+        nodes[n].min = glm::min(l.min, r.min);
+        nodes[n].max = glm::max(l.max, r.max);
+    }
+}
+
+int BVH::raycast(glm::vec3 origin, glm::vec3 dir, float& t) const {
+    t = INFINITY;
+    int hit = -1;
+
+    if (nodes.empty()) return hit;
+
+    Ray r;
+    r.origin = origin;
+    r.dir = dir;
+    r.inv_dir = 1.0f / dir;
+
+    // Nodes along with where the ray enters them, so one pushed before t
+    // tightened gets dropped without touching it again
+    int stack[BVH_STACK_SIZE];
+    float stack_t[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top] = 0;
+    stack_t[top++] = 0.0f;
+
+    while (top > 0) {
+        --top;
+        if (stack_t[top] >= t) continue;
+
+        const Node& node = nodes[stack[top]];
+
+        if (node.count > 0) {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                float ts = ray_sphere(r, spheres[order[i]]);
+                if (ts < t) {
+                    t = ts;
+                    hit = order[i];
+                }
+            }
+            continue;
+        }
+
+        // Push the farther child first so the nearer one is visited next
+        // and tightens t before the other gets tested
+        int a = node.first, b = node.first + 1;
+        float ta = ray_aabb(r, nodes[a].min, nodes[a].max, t);
+        float tb = ray_aabb(r, nodes[b].min, nodes[b].max, t);
+
+        if (ta > tb) {
+            std::swap(a, b);
+            std::swap(ta, tb);
+        }
+
+        if (tb < t && top < BVH_STACK_SIZE) {
+            stack[top] = b;
+            stack_t[top++] = tb;
+        }
+        if (ta < t && top < BVH_STACK_SIZE) {
+            stack[top] = a;
+            stack_t[top++] = ta;
+        }
+    }
+
+    return hit;
+}
+
+void BVH::overlap_sphere(glm::vec3 center, float radius, std::vector<int>& out) const {
+    if (nodes.empty()) return;
+
+    int stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+
+        // Closest point of the box to the center
+        glm::vec3 closest = glm::clamp(center, node.min, node.max);
+        glm::vec3 d = closest - center;
+        if (glm::dot(d, d) > radius * radius) continue;
+
+        if (node.count > 0) {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                const Bounds& s = spheres[order[i]];
+                float r = s.radius + radius;
+                glm::vec3 to = s.center - center;
+                if (glm::dot(to, to) <= r * r) out.push_back(order[i]);
+            }
+        }
+        else if (top + 2 <= BVH_STACK_SIZE) {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+        }
+    }
+}
+
+void BVH::overlap_aabb(glm::vec3 min, glm::vec3 max, std::vector<int>& out) const {
+    if (nodes.empty()) return;
+
+    int stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+
+        if (node.max.x < min.x || node.min.x > max.x) continue;
+        if (node.max.y < min.y || node.min.y > max.y) continue;
+        if (node.max.z < min.z || node.min.z > max.z) continue;
+
+        if (node.count > 0) {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                const Bounds& s = spheres[order[i]];
+                glm::vec3 closest = glm::clamp(s.center, min, max);
+                glm::vec3 d = closest - s.center;
+                if (glm::dot(d, d) <= s.radius * s.radius) out.push_back(order[i]);
+            }
+        }
+        else if (top + 2 <= BVH_STACK_SIZE) {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+        }
+    }
+}
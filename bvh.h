@@ -0,0 +1,52 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Bounding volume hierarchy over spheres, addressed by the index they were
+// built with. Built top-down with a binned surface area heuristic and
+// refitted in place when a sphere moves, so it only needs rebuilding when
+// spheres are added or removed.
+class BVH {
+public:
+    struct Bounds {
+        glm::vec3 center;
+        float radius;
+    };
+
+    void build(const std::vector<Bounds>& spheres);
+
+    // Moves sphere i and refits every node on the path to the root
+    void update(int i, const Bounds& sphere);
+
+    // Index of the nearest sphere hit by the ray, -1 if none. Spheres
+    // the ray starts inside don't count. dir has to be normalized, t
+    // receives the distance to the hit.
+    int raycast(glm::vec3 origin, glm::vec3 dir, float& t) const;
+
+    // Appends the index of every sphere overlapping the query volume
+    void overlap_sphere(glm::vec3 center, float radius, std::vector<int>& out) const;
+    void overlap_aabb(glm::vec3 min, glm::vec3 max, std::vector<int>& out) const;
+
+    size_t size() const { return spheres.size(); }
+
+private:
+    struct Node {
+        glm::vec3 min;
+        glm::vec3 max;
+        int first;  // First child if count == 0, otherwise first entry in `order`
+        int count;  // Number of spheres in a leaf, 0 for interior nodes
+        int parent;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Bounds> spheres;
+    std::vector<int> order;   // Sphere indices, grouped by leaf
+    std::vector<int> leaf_of; // Leaf node holding each sphere
+
+    void subdivide(int node, const std::vector<glm::vec3>& centroids);
+    void refit_leaf(int node);
+};
+
+#endif
@@ -7,6 +7,8 @@
 
 #include <vector>
 
+#include "geometry.h"
+
 class Camera {
 public:
     static constexpr float DEFAULT_YAW = -90.0f;
@@ -15,6 +17,8 @@ public:
     static constexpr float DEFAULT_SENSITIVITY = 10.0f;
     static constexpr float DEFAULT_ZOOM = 70.0f;
     static constexpr float ASPECT_RATIO = 1024.0f / 768.0f; //TODO
+    static constexpr float NEAR_PLANE = 0.1f;
+    static constexpr float FAR_PLANE = 100.0f;
 
     enum Movement {
         FORWARD,
@@ -91,7 +95,11 @@ public:
     }
 
     glm::mat4 getProjectionMatrix() const {
-        return glm::perspective(glm::radians(zoom), aspect_ratio, 0.1f, 100.0f);
+        return glm::perspective(glm::radians(zoom), aspect_ratio, NEAR_PLANE, FAR_PLANE);
+    }
+
+    Frustum getFrustum() const {
+        return Frustum::FromMatrix(getProjectionMatrix() * getViewMatrix());
     }
 
     void setPosition(glm::vec3 pos) {
@@ -0,0 +1,203 @@
+#include "clusters.h"
+#include "threadpool.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+// Tile a position in normalized device coordinates falls in, along an axis with n tiles
+int tileAt(float ndc, int n) {
+    int t = (int)std::floor((ndc + 1.0f) * 0.5f * n);
+    return glm::clamp(t, 0, n - 1);
+}
+
+// Tiles the view space box around a sphere covers, between depths near and
+// far (both positive). Dividing by the nearest and furthest depth is enough
+// as every corner of the box is in front of the eye. False when it is off
+// screen.
+bool tileRect(const glm::vec3& center, float r, float near, float far, float px, float py, int w, int h, int* rect) {
+    float left   = std::min((center.x - r) * px / near, (center.x - r) * px / far);
+    float right  = std::max((center.x + r) * px / near, (center.x + r) * px / far);
+    float bottom = std::min((center.y - r) * py / near, (center.y - r) * py / far);
+    float top    = std::max((center.y + r) * py / near, (center.y + r) * py / far);
+
+    if (right < -1.0f || left > 1.0f || top < -1.0f || bottom > 1.0f) return false;
+
+    rect[0] = tileAt(left, w);
+    rect[1] = tileAt(right, w);
+    rect[2] = tileAt(bottom, h);
+    rect[3] = tileAt(top, h);
+    return true;
+}
+
+float distanceSquared(const glm::vec3& p, const glm::vec3& min, const glm::vec3& max) {
+    glm::vec3 d = glm::max(glm::max(min - p, p - max), glm::vec3(0.0f));
+    return glm::dot(d, d);
+}
+
+}
+
+LightClusters::LightClusters(int x, int y, int z) : x(x), y(y), z(z) {
+    ranges.resize(count());
+    slice_pairs.resize(z);
+    slice_indices.resize(z);
+    slice_counts.resize(z);
+    last_stats = Stats();
+}
+
+int LightClusters::slice(float depth) const {
+    if (depth <= near_plane) return 0;
+    int s = (int)std::floor(glm::log(depth / near_plane) * sliceScale());
+    return std::min(s, z - 1);
+}
+
+void LightClusters::buildBoxes() {
+    boxes.resize(count());
+    slice_depths.resize(z + 1);
+    for (int k = 0; k <= z; k++) {
+        slice_depths[k] = near_plane * glm::pow(far_plane / near_plane, (float)k / z);
+    }
+
+    // A view space point at depth d lands on x_ndc = x_view * P[0][0] / d,
+    // so the edges of a tile are straight lines out of the eye
+    float sx = 1.0f / projection[0][0];
+    float sy = 1.0f / projection[1][1];
+
+    for (int k = 0; k < z; k++) {
+        float d0 = slice_depths[k], d1 = slice_depths[k + 1];
+
+        for (int j = 0; j < y; j++) {
+            float ny0 = -1.0f + 2.0f * j / y, ny1 = -1.0f + 2.0f * (j + 1) / y;
+
+            for (int i = 0; i < x; i++) {
+                float nx0 = -1.0f + 2.0f * i / x, nx1 = -1.0f + 2.0f * (i + 1) / x;
+
+                Box& b = boxes[((size_t)k * y + j) * x + i];
+                b.min = glm::vec3(
+                    std::min(nx0 * d0, nx0 * d1) * sx,
+                    std::min(ny0 * d0, ny0 * d1) * sy,
+                    -d1
+                );
+                b.max = glm::vec3(
+                    std::max(nx1 * d0, nx1 * d1) * sx,
+                    std::max(ny1 * d0, ny1 * d1) * sy,
+                    -d0
+                );
+            }
+        }
+    }
+}
+
+void LightClusters::assign(
+    const glm::mat4& view, const glm::mat4& projection, float near_plane, float far_plane,
+    const std::vector<glm::vec4>& lights, ThreadPool* pool
+) {
+    if (projection != this->projection || near_plane != this->near_plane || far_plane != this->far_plane) {
+        this->projection = projection;
+        this->near_plane = near_plane;
+        this->far_plane = far_plane;
+        buildBoxes();
+    }
+
+    // Whittle every light down to a range of slices first, so the per
+    // cluster tests below only see lights that are nearly there anyway
+    candidates.clear();
+    for (size_t i = 0; i < lights.size(); i++) {
+        const glm::vec4& l = lights[i];
+        glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(l), 1.0f));
+        float r = l.w;
+        float depth = -center.z;
+
+        if (r <= 0.0f || depth + r < near_plane || depth - r > far_plane) continue;
+
+        // Only what is beyond the near plane can ever be drawn
+        float dn = std::max(depth - r, near_plane), df = std::min(depth + r, far_plane);
+        int rect[4];
+        if (!tileRect(center, r, dn, df, projection[0][0], projection[1][1], x, y, rect)) continue;
+
+        Candidate c;
+        c.center = center;
+        c.radius = r;
+        c.light = i;
+        c.z0 = slice(dn);
+        c.z1 = slice(df);
+
+        candidates.push_back(c);
+    }
+
+    ranges.resize(count());
+
+    ThreadPool::ForEach(pool, z, [this](size_t k) { assignSlice((int)k); });
+
+    // Each slice's offsets start from 0, shift them to where it ends up
+    indices.clear();
+    last_stats = Stats();
+    last_stats.lights = candidates.size();
+
+    size_t per_slice = (size_t)x * y;
+    for (int k = 0; k < z; k++) {
+        uint32_t base = indices.size();
+        for (size_t c = 0; c < per_slice; c++) {
+            ClusterRange& r = ranges[k * per_slice + c];
+            r.offset += base;
+            last_stats.busiest = std::max(last_stats.busiest, (unsigned int)r.count);
+        }
+        indices.insert(indices.end(), slice_indices[k].begin(), slice_indices[k].end());
+    }
+    last_stats.references = indices.size();
+}
+
+// Only writes to this slice's own vectors and ranges, so slices can run side by side
+void LightClusters::assignSlice(int k) {
+    size_t per_slice = (size_t)x * y;
+    std::vector<Pair>& pairs = slice_pairs[k];
+    std::vector<uint32_t>& counts = slice_counts[k];
+    std::vector<uint32_t>& out = slice_indices[k];
+
+    pairs.clear();
+    counts.assign(per_slice, 0);
+
+    for (size_t i = 0; i < candidates.size(); i++) {
+        const Candidate& c = candidates[i];
+        if (k < c.z0 || k > c.z1) continue;
+
+        // A light spanning many slices covers much less of the screen in
+        // some of them, the ones nearer the eye in particular
+        float depth = -c.center.z;
+        float dn = std::max(depth - c.radius, slice_depths[k]);
+        float df = std::min(depth + c.radius, slice_depths[k + 1]);
+        int rect[4];
+        if (!tileRect(c.center, c.radius, dn, df, projection[0][0], projection[1][1], x, y, rect)) continue;
+
+        float r2 = c.radius * c.radius;
+        for (int j = rect[2]; j <= rect[3]; j++) {
+            for (int t = rect[0]; t <= rect[1]; t++) {
+                uint32_t cluster = j * x + t;
+                const Box& b = boxes[k * per_slice + cluster];
+                if (distanceSquared(c.center, b.min, b.max) > r2) continue;
+
+                Pair p;
+                p.cluster = cluster;
+                p.candidate = i;
+                pairs.push_back(p);
+                counts[cluster]++;
+            }
+        }
+    }
+
+    // Counting sort by cluster, stable so each cluster's lights stay in order
+    uint32_t offset = 0;
+    for (size_t c = 0; c < per_slice; c++) {
+        ClusterRange& r = ranges[k * per_slice + c];
+        r.offset = offset;
+        r.count = counts[c];
+        counts[c] = offset;
+        offset += r.count;
+    }
+
+    out.resize(pairs.size());
+    for (const Pair& p : pairs) {
+        out[counts[p.cluster]++] = candidates[p.candidate].light;
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef CLUSTERS_H
+#define CLUSTERS_H
+
+#include <vector>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+class ThreadPool;
+
+// Default grid, tiles across and down the screen and depth slices
+#define CLUSTERS_X 16
+#define CLUSTERS_Y 9
+#define CLUSTERS_Z 24
+
+// Where a cluster's lights are in LightClusters::indices. Matches the
+// uvec2 in shaders/lighting.glsl.
+struct ClusterRange {
+    uint32_t offset;
+    uint32_t count;
+};
+
+// The view frustum cut into froxels, X x Y tiles across the screen and Z
+// slices in depth, spaced exponentially so near slices are thin and far
+// ones thick. assign() works out which point lights reach which froxel, so
+// a fragment only has to loop over the lights of the one it is in.
+//
+// Clusters are numbered (z * Y + y) * X + x, with tile (0, 0) at the
+// bottom left like gl_FragCoord. Nothing in here touches GL.
+class LightClusters {
+public:
+    struct Stats {
+        unsigned int lights;     // Touching the frustum at all
+        unsigned int references; // Light indices across all clusters
+        unsigned int busiest;    // Most lights in one cluster
+    };
+
+    std::vector<ClusterRange> ranges; // One per cluster
+    std::vector<uint32_t> indices;    // Into the lights passed to assign()
+
+    LightClusters(int x = CLUSTERS_X, int y = CLUSTERS_Y, int z = CLUSTERS_Z);
+
+    // Lights are xyz world position and w radius, a light does nothing
+    // beyond its radius. projection has to be a symmetric perspective one
+    // with these planes. Slices go out to pool when there is one, the
+    // result is the same either way.
+    void assign(
+        const glm::mat4& view, const glm::mat4& projection, float near_plane, float far_plane,
+        const std::vector<glm::vec4>& lights, ThreadPool* pool = NULL
+    );
+
+    int width() const { return x; }
+    int height() const { return y; }
+    int depth() const { return z; }
+    size_t count() const { return (size_t)x * y * z; }
+
+    // Slice a view space depth (positive, distance in front of the camera) falls in
+    int slice(float depth) const;
+
+    // What shaders need to find their slice: slice = log(depth / near) * scale
+    float sliceScale() const { return z / glm::log(far_plane / near_plane); }
+
+    const Stats& stats() const { return last_stats; }
+
+private:
+    struct Box {
+        glm::vec3 min, max;
+    };
+
+    // A light's view space sphere and the slices it may touch
+    struct Candidate {
+        glm::vec3 center;
+        float radius;
+        uint32_t light;
+        int z0, z1;
+    };
+
+    // One light reaching one cluster, the cluster counted within its slice
+    struct Pair {
+        uint32_t cluster;
+        uint32_t candidate;
+    };
+
+    int x, y, z;
+    float near_plane = 0.0f, far_plane = 0.0f;
+    glm::mat4 projection = glm::mat4(0.0f);
+
+    // View space bounds per cluster and where each slice starts, only
+    // change with the projection
+    std::vector<Box> boxes;
+    std::vector<float> slice_depths;
+
+    std::vector<Candidate> candidates;
+
+    // Per slice, filled in parallel and stitched together afterwards
+    std::vector<std::vector<Pair>> slice_pairs; // Unsorted
+    std::vector<std::vector<uint32_t>> slice_indices;
+    std::vector<std::vector<uint32_t>> slice_counts;
+
+    Stats last_stats;
+
+    void buildBoxes();
+    void assignSlice(int slice);
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef DDS_H
+#define DDS_H
+
+#include <stdint.h>
+
+// Just enough of the DDS container for what tools/cook.cpp writes: one 2D
+// texture, a full mip chain, block compressed, identified by FourCC. Any DDS
+// viewer can open the files, which is the only reason not to roll our own.
+
+#define DDS_MAGIC 0x20534444 // "DDS "
+
+#define DDS_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+#define DDS_FOURCC_BC1 DDS_FOURCC('D', 'X', 'T', '1')
+#define DDS_FOURCC_BC3 DDS_FOURCC('D', 'X', 'T', '5')
+#define DDS_FOURCC_BC5 DDS_FOURCC('A', 'T', 'I', '2')
+
+#define DDSD_CAPS        0x1
+#define DDSD_HEIGHT      0x2
+#define DDSD_WIDTH       0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE  0x80000
+
+#define DDPF_FOURCC 0x4
+
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP  0x400000
+
+struct DDSPixelFormat {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourcc;
+    uint32_t rgb_bit_count;
+    uint32_t r_mask, g_mask, b_mask, a_mask;
+};
+
+// Follows the magic, the mip levels follow this, largest first
+struct DDSHeader {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t linear_size; // Bytes in the top level
+    uint32_t depth;
+    uint32_t mip_count;
+    uint32_t reserved[11];
+    DDSPixelFormat format;
+    uint32_t caps, caps2, caps3, caps4;
+    uint32_t reserved2;
+};
+
+// Bytes per 4x4 block for the formats above
+inline uint32_t DDSBlockBytes(uint32_t fourcc) {
+    return fourcc == DDS_FOURCC_BC1 ? 8 : 16;
+}
+
+inline uint32_t DDSLevelBytes(uint32_t fourcc, uint32_t width, uint32_t height) {
+    return ((width + 3) / 4) * ((height + 3) / 4) * DDSBlockBytes(fourcc);
+}
+
+#endif
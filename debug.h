@@ -8,7 +8,8 @@ class Debug {
     Model light_debug;
 
     void setup_models() {
-        Mesh light_sphere = Mesh::Sphere();
+        // Same sphere as the sky, see main.cpp
+        Mesh light_sphere = *AssetManager::get(AssetManager::mesh("sphere", []() { return Mesh::Sphere(); }));
         light_sphere.material = Material::DebugLight();
         light_debug = Model::FromMesh(light_sphere);
     }
@@ -17,13 +18,13 @@ class Debug {
         glGenVertexArrays(1, &line_vao);
         glGenBuffers(1, &line_vbo);
 
-        glBindVertexArray(line_vao);
+        GLState::bindVertexArray(line_vao);
         glBindBuffer(GL_ARRAY_BUFFER, line_vbo);
         glBufferData(GL_ARRAY_BUFFER, 2 * 3 * sizeof(float), NULL, GL_DYNAMIC_DRAW);
 
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-        glBindVertexArray(0);
+        GLState::bindVertexArray(0);
     }
 
 public:
@@ -33,31 +34,33 @@ public:
         d.setup_models();
         return d;
     }
-    void draw_debug_sphere(Shader shader, glm::vec3 p) {
-        Entity e_sphere = Entity::FromModel(&light_debug);
-        e_sphere.setScale(glm::vec3(0.2f));
-        e_sphere.setPosition(p);
-        e_sphere.draw(shader);
+    // Straight to the shader, a throwaway Entity each call would leave a
+    // Transforms slot behind every frame
+    void draw_debug_sphere(const Shader& shader, glm::vec3 p) {
+        glm::mat4 m = glm::translate(glm::mat4(1.0f), p);
+        m = glm::scale(m, glm::vec3(0.2f));
+
+        shader.use();
+        shader.setModelMatrix(m * light_debug.transform);
+        light_debug.draw(shader);
     }
 
-    void draw_point_light(Shader shader, PointLight light) {
-        Entity e_light = Entity::FromModel(&light_debug);
-        e_light.setScale(glm::vec3(0.2f));
-        e_light.setPosition(light.position);
-        e_light.draw(shader);
+    void draw_point_light(const Shader& shader, PointLight light) {
+        draw_debug_sphere(shader, glm::vec3(light.position));
     }
 
-    void draw_line(Shader shader, glm::vec3 p, glm::vec3 q) {
-        shader.setMat4("uModelMatrix", glm::mat4(1.0f));
-        glBindVertexArray(line_vao);
+    void draw_line(const Shader& shader, glm::vec3 p, glm::vec3 q) {
+        shader.setModelMatrix(glm::mat4(1.0f));
+        shader.set(shader.uPositionOffset, glm::vec3(0.0f));
+        shader.set(shader.uPositionScale, glm::vec3(1.0f));
+        GLState::bindVertexArray(line_vao);
         glBindBuffer(GL_ARRAY_BUFFER, line_vbo);
         glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(p), &p);
         glBufferSubData(GL_ARRAY_BUFFER, sizeof(p), sizeof(q), &q);
         glDrawArrays(GL_LINES, 0, 2);
-        glBindVertexArray(0);
     }
 
-    void draw_grid(Shader shader) {
+    void draw_grid(const Shader& shader) {
         int min = -10;
         int max = 10;
         for (int i = min; i <= max; i++) {
@@ -1,45 +1,44 @@
 #include "models.h"
 #include "shader.h"
 #include "geometry.h"
+#include "transform.h"
 #include <glm/gtc/matrix_transform.hpp>
 
 #ifndef ENTITY_H
 #define ENTITY_H
 
+// A single object drawn on its own, like the player's hand. Whatever is
+// part of the level lives in the Scene's EntityStore instead.
 class Entity {
 private:
-    glm::vec3 position, rotation, scale;
-    glm::mat4 model_matrix;
+    // Position, rotation, scale and the matrices built from them live in
+    // Transforms, see transform.h
+    TransformId transform;
 
 public:
     Model* model;
-    Sphere bounding_sphere;
     bool is_selected;
 
     static Entity FromModel(Model* model) {
         Entity e;
         e.is_selected = false;
         e.model = model;
-        e.setPRS(glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(1.0f));
-        //e.model_transform = glm::mat4(1.0f);
-        e.bounding_sphere.radius = 1.0f;
-        e.bounding_sphere.center = glm::vec3(0.0f);
+        e.transform = Transforms::create();
+        Transforms::setOffset(e.transform, model->transform);
         return e;
     }
 
-    void draw(Shader shader) {
+    void draw(const Shader& shader) {
         shader.use();
 
-        // Assumes having properly recalculated the model matrix
-        shader.setModelMatrix(model_matrix);
+        // As of the last Transforms::update()
+        shader.setModelMatrix(getModelMatrix());
 
-        // Boolean check much cheaper than setting
-        // Allows us to not have to store the handle to uSelected explicitly
-        // since the actual set is exceedingly rare
+        // Boolean check much cheaper than setting, the actual set is exceedingly rare
         if (is_selected) {
-            shader.setBool("uSelected", true);
+            shader.set(shader.uSelected, true);
             model->draw(shader);
-            shader.setBool("uSelected", false);
+            shader.set(shader.uSelected, false);
         }
         else {
             model->draw(shader);
@@ -50,64 +49,57 @@ public:
         // Saves a lot of cycles, but might bite us in the butt at some point
     }
 
-    float ray_test(glm::vec3 p, glm::vec3 dir) {
-        // TODO: account for transformations
-        //p = glm::inverse(model_matrix)
-        return bounding_sphere.ray_test(p, dir);
+    const glm::mat4& getModelMatrix() const {
+        return Transforms::model(transform);
     }
 
-    // Saves a LOT of time if most entities are static
-    void recalculate_matrix() {
-        model_matrix = glm::mat4(1.0f);
-        model_matrix = glm::translate(model_matrix, position);
-        model_matrix = glm::scale(model_matrix, scale);
-        // TODO: Quaternions
-        model_matrix = glm::rotate(model_matrix, rotation.z, glm::vec3(0, 0, 1));
-        model_matrix = glm::rotate(model_matrix, rotation.y, glm::vec3(0, 1, 0));
-        model_matrix = glm::rotate(model_matrix, rotation.x, glm::vec3(1, 0, 0));
-        model_matrix = model_matrix * model->transform;
+    TransformId getTransform() const {
+        return transform;
     }
 
-    void setPRS(glm::vec3 pos, glm::vec3 rot, glm::vec3 scl) {
-        position = pos;
-        bounding_sphere.center = pos;
-        rotation = rot;
-        scale = scl;
-        recalculate_matrix();
+    // Attaches to another transform, so this one moves along with it
+    void setParent(TransformId parent) {
+        Transforms::setParent(transform, parent);
     }
 
-    glm::vec3 getPosition() {
-        return position;
+    // None of the setters do any matrix math, they only mark the transform dirty
+    void setPRS(glm::vec3 pos, glm::quat rot, glm::vec3 scl) {
+        Transforms::setPosition(transform, pos);
+        Transforms::setRotation(transform, rot);
+        Transforms::setScale(transform, scl);
+    }
+
+    glm::vec3 getPosition() const {
+        return Transforms::position(transform);
     }
 
     void translate(glm::vec3 delta) {
-        position += delta;
-        bounding_sphere.center = position;
-        recalculate_matrix();
+        Transforms::setPosition(transform, getPosition() + delta);
     }
 
     void setPosition(glm::vec3 pos) {
-        bounding_sphere.center = pos;
-        position = pos;
-        recalculate_matrix();
+        Transforms::setPosition(transform, pos);
+    }
+
+    glm::quat getRotation() const {
+        return Transforms::rotation(transform);
     }
 
-    glm::vec3 getRotation() {
-        return rotation;
+    void setRotation(glm::quat rot) {
+        Transforms::setRotation(transform, rot);
     }
 
-    void setRotation(glm::vec3 rot) {
-        rotation = rot;
-        recalculate_matrix();
+    // Euler angles in radians, see EulerRotation
+    void setRotation(glm::vec3 angles) {
+        Transforms::setRotation(transform, EulerRotation(angles));
     }
 
-    glm::vec3 getScale() {
-        return scale;
+    glm::vec3 getScale() const {
+        return Transforms::scale(transform);
     }
 
     void setScale(glm::vec3 scl) {
-        scale = scl;
-        recalculate_matrix();
+        Transforms::setScale(transform, scl);
     }
 };
 #endif
@@ -0,0 +1,106 @@
+#include "entitystore.h"
+
+void EntityStore::reserve(size_t count) {
+    ids.reserve(count);
+    transforms.reserve(count);
+    renderables.reserve(count);
+    bounds.reserve(count);
+    selected.reserve(count);
+    pickable.reserve(count);
+    slots.reserve(count);
+}
+
+EntityId EntityStore::create(Model* model, glm::vec3 position, glm::quat rotation, glm::vec3 scale) {
+    if (free.empty()) {
+        free.push_back(slots.size());
+        slots.push_back(Slot());
+    }
+
+    EntityId id;
+    id.index = free.back();
+    free.pop_back();
+
+    Slot& slot = slots[id.index];
+    slot.generation++;
+    if (slot.generation == 0) slot.generation = 1;
+    slot.dense = ids.size();
+    id.generation = slot.generation;
+
+    TransformId t = Transforms::create();
+    Transforms::setPosition(t, position);
+    Transforms::setRotation(t, rotation);
+    Transforms::setScale(t, scale);
+    Transforms::setOffset(t, model->transform);
+
+    Renderable r;
+    r.model = model;
+    r.batch = NULL;
+    r.batch_slot = -1;
+
+    // Proper bounds come with the first Transforms::update()
+    BVH::Bounds b;
+    b.center = position;
+    b.radius = 0.0f;
+
+    ids.push_back(id);
+    transforms.push_back(t);
+    renderables.push_back(r);
+    bounds.push_back(b);
+    selected.push_back(0);
+    pickable.push_back(1);
+
+    layout_version++;
+    return id;
+}
+
+void EntityStore::destroy(EntityId id) {
+    int i = index(id);
+    if (i < 0) return;
+
+    Transforms::destroy(transforms[i]);
+
+    // The last entity fills the hole
+    int last = ids.size() - 1;
+    if (i != last) {
+        ids[i] = ids[last];
+        transforms[i] = transforms[last];
+        renderables[i] = renderables[last];
+        bounds[i] = bounds[last];
+        selected[i] = selected[last];
+        pickable[i] = pickable[last];
+        slots[ids[i].index].dense = i;
+    }
+
+    ids.pop_back();
+    transforms.pop_back();
+    renderables.pop_back();
+    bounds.pop_back();
+    selected.pop_back();
+    pickable.pop_back();
+
+    slots[id.index].dense = -1;
+    free.push_back(id.index);
+
+    layout_version++;
+}
+
+void EntityStore::setPickable(EntityId id, bool pickable) {
+    int i = index(id);
+    if (i < 0 || this->pickable[i] == pickable) return;
+
+    this->pickable[i] = pickable;
+
+    // The scene's BVH only holds pickable entities
+    layout_version++;
+}
+
+int EntityStore::index(EntityId id) const {
+    if (!id.valid() || id.index >= slots.size()) return -1;
+    const Slot& slot = slots[id.index];
+    return slot.generation == id.generation ? slot.dense : -1;
+}
+
+TransformId EntityStore::transform(EntityId id) const {
+    int i = index(id);
+    return i < 0 ? NO_TRANSFORM : transforms[i];
+}
@@ -0,0 +1,103 @@
+#ifndef ENTITYSTORE_H
+#define ENTITYSTORE_H
+
+#include <vector>
+#include <stdint.h>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "assman.h"
+#include "models.h"
+#include "transform.h"
+#include "instancing.h"
+#include "bvh.h"
+
+class Entity;
+
+// Same scheme as the asset handles, a stale id is caught instead of
+// silently meaning whatever reused its slot
+typedef Handle<Entity> EntityId;
+
+// What the scene draws an entity with, the batch and slot are filled in
+// by Scene::rebuild_batches
+struct Renderable {
+    Model* model;
+    InstanceBatch* batch;
+    int batch_slot;
+};
+
+// Sphere around a model's bounding box, carried along by its model matrix
+inline BVH::Bounds WorldBounds(const Model* model, const glm::mat4& model_matrix) {
+    glm::vec3 local_center = 0.5f * (model->bounds_min + model->bounds_max);
+    glm::vec3 half_extent = 0.5f * (model->bounds_max - model->bounds_min);
+
+    float max_scale = glm::max(
+        glm::length(glm::vec3(model_matrix[0])),
+        glm::max(glm::length(glm::vec3(model_matrix[1])), glm::length(glm::vec3(model_matrix[2])))
+    );
+
+    BVH::Bounds b;
+    b.center = glm::vec3(model_matrix * glm::vec4(local_center, 1.0f));
+    b.radius = glm::length(half_extent) * max_scale;
+    return b;
+}
+
+// The scene's entities, one component per array. Live entities are packed
+// at the front of every array, so a pass over one component is a straight
+// walk through memory, and a destroy moves the last entity into the hole.
+// Ids go through a slot table to find their dense index.
+//
+// Dense indices are only good until the next create() or destroy(), see
+// layout(). The transforms are owned here and live in Transforms.
+class EntityStore {
+public:
+    // Dense arrays, all size() long
+    std::vector<EntityId>    ids;
+    std::vector<TransformId> transforms;
+    std::vector<Renderable>  renderables;
+    std::vector<BVH::Bounds> bounds;
+    std::vector<unsigned char> selected;
+
+    // Whether picking and the scene's queries see it, cleared for level
+    // geometry that the camera is usually standing inside
+    std::vector<unsigned char> pickable;
+
+    // Room for this many without reallocating any of the arrays
+    void reserve(size_t count);
+
+    EntityId create(
+        Model* model,
+        glm::vec3 position = glm::vec3(0.0f),
+        glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+        glm::vec3 scale = glm::vec3(1.0f)
+    );
+    void destroy(EntityId id);
+
+    void setPickable(EntityId id, bool pickable);
+
+    bool alive(EntityId id) const { return index(id) >= 0; }
+
+    // Into the dense arrays, -1 for a dead or stale id
+    int index(EntityId id) const;
+
+    TransformId transform(EntityId id) const;
+
+    size_t size() const { return ids.size(); }
+
+    // Bumped by every create(), destroy() and setPickable(), for whoever
+    // holds on to dense indices
+    unsigned int layout() const { return layout_version; }
+
+private:
+    struct Slot {
+        uint32_t generation = 0;
+        int dense = -1;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free;
+    unsigned int layout_version = 0;
+};
+
+#endif
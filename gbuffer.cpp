@@ -0,0 +1,96 @@
+#include "gbuffer.h"
+
+#include <cstdio>
+
+#include "glstate.h"
+
+namespace {
+
+GLuint target(GLenum format, int width, int height) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    GLState::bindTexture(0, GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+
+    // Only ever read with texelFetch, but a texture without mips has to say so
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    return texture;
+}
+
+}
+
+void GBuffer::release() {
+    if (fbo == 0) return;
+
+    GLuint textures[4] = { albedo, normal, specular, depth };
+    glDeleteTextures(4, textures);
+    glDeleteFramebuffers(1, &fbo);
+
+    for (GLuint texture : textures) GLState::forgetTexture(texture);
+    fbo = 0;
+}
+
+void GBuffer::resize(int width, int height) {
+    if (width == this->width && height == this->height && fbo != 0) return;
+
+    release();
+    this->width = width;
+    this->height = height;
+
+    albedo   = target(GL_SRGB8_ALPHA8, width, height);
+    normal   = target(GL_RG16, width, height);
+    specular = target(GL_RGBA8, width, height);
+    depth    = target(GL_DEPTH24_STENCIL8, width, height);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, specular, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+
+    const GLenum outputs[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(3, outputs);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Error: G-buffer of %d x %d is incomplete\n", width, height);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (empty_vao == 0) glGenVertexArrays(1, &empty_vao);
+}
+
+void GBuffer::bind() {
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void GBuffer::light(const Shader& shader) {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    shader.use();
+    GLState::bindTexture(GBUFFER_ALBEDO_UNIT, GL_TEXTURE_2D, albedo);
+    GLState::bindTexture(GBUFFER_NORMAL_UNIT, GL_TEXTURE_2D, normal);
+    GLState::bindTexture(GBUFFER_SPECULAR_UNIT, GL_TEXTURE_2D, specular);
+    GLState::bindTexture(GBUFFER_DEPTH_UNIT, GL_TEXTURE_2D, depth);
+
+    // Every pixel exactly once, whatever is in the window's depth buffer
+    glDisable(GL_DEPTH_TEST);
+    GLState::bindVertexArray(empty_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glEnable(GL_DEPTH_TEST);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Meshes without textures of their own don't rebind these units, and
+    // the next geometry pass would be sampling the targets it renders to
+    GLState::bindTexture(GBUFFER_ALBEDO_UNIT, GL_TEXTURE_2D, 0);
+    GLState::bindTexture(GBUFFER_NORMAL_UNIT, GL_TEXTURE_2D, 0);
+    GLState::bindTexture(GBUFFER_SPECULAR_UNIT, GL_TEXTURE_2D, 0);
+    GLState::bindTexture(GBUFFER_DEPTH_UNIT, GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,50 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <GL/glew.h>
+
+#include "shader.h"
+
+// Units the lighting pass reads the G-buffer from, written out as
+// bindings in shaders/deferred.frag
+#define GBUFFER_ALBEDO_UNIT   0
+#define GBUFFER_NORMAL_UNIT   1
+#define GBUFFER_SPECULAR_UNIT 2
+#define GBUFFER_DEPTH_UNIT    3
+
+// Render targets for the deferred path. The geometry pass (scene drawn
+// with shaders/gbuffer.frag) fills them, then light() shades every pixel
+// once into the window with shaders/deferred.frag. 12 bytes a pixel:
+//
+//   albedo    SRGB8_ALPHA8      diffuse, alpha is 1 where selected
+//   normal    RG16              world space, octahedral
+//   specular  RGBA8             specular, alpha is shininess / 255
+//   depth     DEPTH24_STENCIL8  same as the window's, so it blits across
+//
+// Position comes back from depth. The GL objects are made on the first
+// resize(), so one of these can be a global. Main thread only.
+class GBuffer {
+public:
+    // Remakes the targets when the size changed, cheap otherwise
+    void resize(int width, int height);
+
+    // Makes the G-buffer the draw target and clears it
+    void bind();
+
+    // Lights every pixel the geometry pass drew, into the window, then
+    // copies depth across so the sky and anything else drawn forward
+    // afterwards still sits behind the scene. shader is deferred.frag.
+    void light(const Shader& shader);
+
+private:
+    GLuint fbo = 0;
+    GLuint albedo = 0, normal = 0, specular = 0, depth = 0;
+    int width = 0, height = 0;
+
+    // Bound for the fullscreen triangle, which has no vertex data
+    GLuint empty_vao = 0;
+
+    void release();
+};
+
+#endif
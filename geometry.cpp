@@ -1,6 +1,11 @@
 #include "geometry.h"
 #include <cstdio>
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define GEOMETRY_SSE
+#include <xmmintrin.h>
+#endif
+
 float Point::ray_test(glm::vec3 p, glm::vec3 d) {
     glm::vec3 to_center = glm::vec3(center - p);
     // If d is collinear with the vector from p
@@ -22,12 +27,17 @@ float Point::ray_test(glm::vec3 p, glm::vec3 d) {
 float Sphere::ray_test(glm::vec3 p, glm::vec3 d) {
     // Want to find:
     // ||(p+dt) - center|| - radius = 0
-    // (p+dt)^2 - 2*(p+dt)center + center^2
+    // With d normalized this is t^2 - 2bt + c = 0 where
+    // b = dot(d, center - p) and c = ||center - p||^2 - radius^2
     // Then quadratic formula comes in and saves us
-    // t = -b +/- sqrt(b^2 - c)
+    // t = b +/- sqrt(b^2 - c)
+    //
+    // Note(j): This used to return -b +/- ..., i.e. hits along -d, and the
+    // caller flipped its ray to compensate. Returns the nearest hit in front.
     float b, c, test;
 
-    b = glm::dot(glm::normalize(d), center - p);
+    d = glm::normalize(d);
+    b = glm::dot(d, center - p);
     c = glm::dot(center - p, center - p) - radius * radius;
 
     test = b * b - c;
@@ -35,15 +45,13 @@ float Sphere::ray_test(glm::vec3 p, glm::vec3 d) {
     if (test >= 0) {
         float t1, t2, sqrt_test;
         sqrt_test = glm::sqrt(test);
-        t1 = -b + sqrt_test;
-        t2 = -b - sqrt_test;
-
-        glm::vec3 res1 = p + t1 * d;
-        glm::vec3 res2 = p + t2 * d;
+        t1 = b - sqrt_test;
+        t2 = b + sqrt_test;
 
-        if (test == 0)
+        if (t1 >= 0)
             return t1;
-        return t1 < t2 ? t1 : t2;
+        if (t2 >= 0) // p is inside the sphere
+            return t2;
     }
 
     return INFINITY;
@@ -53,4 +61,83 @@ float Plane::ray_test(glm::vec3 p, glm::vec3 d) {
     // Want to find:
     // dot(normal, dt+p) - dot(normal, center) = 0
     return dot(center - p, normal) / dot(d, normal);
-}
\ No newline at end of file
+}
+
+// Gribb & Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix"
+Frustum Frustum::FromMatrix(const glm::mat4& m) {
+    // glm is column major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++) {
+        rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    }
+
+    Frustum f;
+    f.planes[0] = rows[3] + rows[0]; // Left
+    f.planes[1] = rows[3] - rows[0]; // Right
+    f.planes[2] = rows[3] + rows[1]; // Bottom
+    f.planes[3] = rows[3] - rows[1]; // Top
+    f.planes[4] = rows[3] + rows[2]; // Near
+    f.planes[5] = rows[3] - rows[2]; // Far
+
+    // Normalized so that plane distances are actual distances to compare radii with
+    for (int i = 0; i < 6; i++) {
+        f.planes[i] /= glm::length(glm::vec3(f.planes[i]));
+    }
+
+    return f;
+}
+
+bool Frustum::intersects_sphere(glm::vec3 center, float radius) const {
+    for (int i = 0; i < 6; i++) {
+        if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Frustum::cull_spheres(
+    const float* x, const float* y, const float* z, const float* r,
+    size_t count, std::vector<unsigned int>& visible
+) const {
+    size_t i = 0;
+
+#ifdef GEOMETRY_SSE
+    __m128 px[6], py[6], pz[6], pw[6];
+    for (int p = 0; p < 6; p++) {
+        px[p] = _mm_set1_ps(planes[p].x);
+        py[p] = _mm_set1_ps(planes[p].y);
+        pz[p] = _mm_set1_ps(planes[p].z);
+        pw[p] = _mm_set1_ps(planes[p].w);
+    }
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 cx = _mm_loadu_ps(x + i);
+        __m128 cy = _mm_loadu_ps(y + i);
+        __m128 cz = _mm_loadu_ps(z + i);
+        __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(r + i));
+
+        // All lanes start inside, each plane can only knock lanes out
+        __m128 inside = _mm_cmpeq_ps(cx, cx);
+
+        for (int p = 0; p < 6; p++) {
+            __m128 d = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(px[p], cx), _mm_mul_ps(py[p], cy)),
+                _mm_add_ps(_mm_mul_ps(pz[p], cz), pw[p])
+            );
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, neg_r));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for (int lane = 0; lane < 4; lane++) {
+            if (mask & (1 << lane)) visible.push_back(i + lane);
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        if (intersects_sphere(glm::vec3(x[i], y[i], z[i]), r[i])) {
+            visible.push_back(i);
+        }
+    }
+}
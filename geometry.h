@@ -1,4 +1,6 @@
 #include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
 
 #ifndef GEOMETRY_H
 #define GEOMETRY_H
@@ -32,6 +34,24 @@ struct Plane : public Geometry {
 
     float ray_test(glm::vec3 p, glm::vec3 d);
 };
+
+// Six inward facing planes as (normal, distance), in world space if
+// extracted from projection * view
+struct Frustum {
+    glm::vec4 planes[6];
+
+    static Frustum FromMatrix(const glm::mat4& m);
+
+    bool intersects_sphere(glm::vec3 center, float radius) const;
+
+    // Appends the index of every sphere at least partly inside, four at a time.
+    // Spheres are given as separate arrays of centers and radii.
+    void cull_spheres(
+        const float* x, const float* y, const float* z, const float* r,
+        size_t count, std::vector<unsigned int>& visible
+    ) const;
+};
+
 //
 //struct Pill : public Geometry {
 //}
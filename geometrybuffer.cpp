@@ -0,0 +1,293 @@
+#include "geometrybuffer.h"
+#include "glstate.h"
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+namespace {
+
+// Enough for the maze and a couple of models before the first grow
+const size_t INITIAL_VERTICES = 1 << 16;
+const size_t INITIAL_INDICES  = 1 << 18;
+
+const GLuint VERTEX_BINDING = 0;
+const GLuint INSTANCE_BINDING = 1;
+
+const size_t NO_SPAN = (size_t)-1;
+
+// Released elements, in vertices or indices
+struct Span {
+    size_t start, count;
+};
+
+struct Pool {
+    GLuint vao;
+    GLuint vbo, ebo;
+
+    size_t vertex_capacity, vertex_count;
+    size_t index_capacity, index_count;
+
+    // Sorted by start, neighbours merged
+    std::vector<Span> free_vertices, free_indices;
+};
+
+struct State {
+    Pool pools[GEOMETRY_POOL_COUNT];
+
+    // Whatever was last passed to bindInstanceStream, so pools made later pick it up
+    GLuint stream;
+
+    // A single zeroed (instance, draw) pair, bound whenever nothing else
+    // is so that plain draws still read from a real buffer
+    GLuint default_stream;
+
+    unsigned int allocations;
+};
+
+State state;
+
+unsigned int poolIndex(VertexFormat format, GLenum index_type) {
+    return format * 2 + (index_type == GL_UNSIGNED_SHORT ? 1 : 0);
+}
+
+VertexFormat poolFormat(unsigned int pool) {
+    return (VertexFormat)(pool / 2);
+}
+
+size_t poolIndexSize(unsigned int pool) {
+    return pool % 2 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// Replaces *buffer with a bigger one holding the same first `used` bytes
+void grow(GLuint* buffer, size_t used, size_t new_size) {
+    GLuint bigger;
+    glGenBuffers(1, &bigger);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, bigger);
+    glBufferData(GL_COPY_WRITE_BUFFER, new_size, NULL, GL_STATIC_DRAW);
+
+    if (used > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, *buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+    }
+
+    glDeleteBuffers(1, buffer);
+    *buffer = bigger;
+}
+
+// First fit out of what was released, NO_SPAN if nothing is big enough
+size_t take(std::vector<Span>& spans, size_t count) {
+    for (size_t i = 0; i < spans.size(); i++) {
+        Span& s = spans[i];
+        if (s.count < count) continue;
+
+        size_t start = s.start;
+        s.start += count;
+        s.count -= count;
+        if (s.count == 0) spans.erase(spans.begin() + i);
+        return start;
+    }
+    return NO_SPAN;
+}
+
+void give(std::vector<Span>& spans, size_t start, size_t count) {
+    if (count == 0) return;
+
+    Span s = { start, count };
+    std::vector<Span>::iterator it = std::lower_bound(spans.begin(), spans.end(), s,
+        [](const Span& a, const Span& b) { return a.start < b.start; });
+    it = spans.insert(it, s);
+
+    // Merge with the one after, then the one before
+    std::vector<Span>::iterator next = it + 1;
+    if (next != spans.end() && it->start + it->count == next->start) {
+        it->count += next->count;
+        spans.erase(next);
+    }
+    if (it != spans.begin()) {
+        std::vector<Span>::iterator prev = it - 1;
+        if (prev->start + prev->count == it->start) {
+            prev->count += it->count;
+            spans.erase(it);
+        }
+    }
+}
+
+void attribute(GLuint location, GLint size, GLenum type, GLboolean normalized, size_t offset) {
+    glEnableVertexAttribArray(location);
+    glVertexAttribFormat(location, size, type, normalized, offset);
+    glVertexAttribBinding(location, VERTEX_BINDING);
+}
+
+// Both formats feed the same shader inputs, see shaders/shader.vert for the decoding
+void setupAttributes(VertexFormat format) {
+    if (format == VERTEX_PACKED) {
+        attribute(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, position));
+        attribute(1, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, normal));
+        attribute(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, tangent));
+        attribute(4, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, uv));
+        // No bitangent, the sign in the tangent's w is enough to rebuild it
+    }
+    else {
+        attribute(0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Position));
+        attribute(1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Normal));
+        attribute(2, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Tangent));
+        attribute(3, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Bitangent));
+        attribute(4, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, TexCoords));
+    }
+}
+
+void setup(unsigned int index) {
+    Pool& pool = state.pools[index];
+    VertexFormat format = poolFormat(index);
+
+    if (state.default_stream == 0) {
+        GLuint zero[2] = { 0, 0 };
+        glGenBuffers(1, &state.default_stream);
+        glBindBuffer(GL_ARRAY_BUFFER, state.default_stream);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(zero), zero, GL_STATIC_DRAW);
+    }
+
+    glGenVertexArrays(1, &pool.vao);
+    GLState::bindVertexArray(pool.vao);
+
+    setupAttributes(format);
+
+    glEnableVertexAttribArray(INSTANCE_STREAM_LOCATION);
+    glVertexAttribIFormat(INSTANCE_STREAM_LOCATION, 2, GL_UNSIGNED_INT, 0);
+    glVertexAttribBinding(INSTANCE_STREAM_LOCATION, INSTANCE_BINDING);
+    glVertexBindingDivisor(INSTANCE_BINDING, 1);
+    glBindVertexBuffer(INSTANCE_BINDING, state.stream ? state.stream : state.default_stream, 0, 2 * sizeof(GLuint));
+
+    grow(&pool.vbo, 0, INITIAL_VERTICES * VertexFormatStride(format));
+    grow(&pool.ebo, 0, INITIAL_INDICES * poolIndexSize(index));
+    pool.vertex_capacity = INITIAL_VERTICES;
+    pool.index_capacity = INITIAL_INDICES;
+
+    glBindVertexBuffer(VERTEX_BINDING, pool.vbo, 0, VertexFormatStride(format));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.ebo);
+}
+
+}
+
+MeshRange GeometryBuffer::allocate(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, VertexFormat format) {
+    PreparedMesh prepared;
+    PrepareMesh(vertices, indices, format, prepared);
+
+    return upload(
+        prepared.format, prepared.dequantize,
+        prepared.vertex_data.data(), prepared.vertex_count,
+        prepared.index_data.data(), prepared.index_count, prepared.index_size
+    );
+}
+
+MeshRange GeometryBuffer::upload(
+    VertexFormat format, const PositionDequantize& dequantize,
+    const void* vertex_data, size_t vertex_count,
+    const void* index_data, size_t index_count, size_t index_size
+) {
+    GLenum index_type = index_size == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    unsigned int index = poolIndex(format, index_type);
+    Pool& pool = state.pools[index];
+
+    if (pool.vao == 0) {
+        setup(index);
+    }
+
+    size_t stride = VertexFormatStride(format);
+
+    // The element buffer binding is VAO state, so it has to be ours that is bound
+    GLState::bindVertexArray(pool.vao);
+
+    // Released space first, then the end of the pool
+    size_t vertex_start = take(pool.free_vertices, vertex_count);
+    size_t index_start = take(pool.free_indices, index_count);
+
+    if (vertex_start == NO_SPAN && pool.vertex_count + vertex_count > pool.vertex_capacity) {
+        size_t capacity = pool.vertex_capacity;
+        while (capacity < pool.vertex_count + vertex_count) capacity *= 2;
+
+        grow(&pool.vbo, pool.vertex_count * stride, capacity * stride);
+        glBindVertexBuffer(VERTEX_BINDING, pool.vbo, 0, stride);
+        pool.vertex_capacity = capacity;
+    }
+
+    if (index_start == NO_SPAN && pool.index_count + index_count > pool.index_capacity) {
+        size_t capacity = pool.index_capacity;
+        while (capacity < pool.index_count + index_count) capacity *= 2;
+
+        grow(&pool.ebo, pool.index_count * index_size, capacity * index_size);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.ebo);
+        pool.index_capacity = capacity;
+    }
+
+    if (vertex_start == NO_SPAN) {
+        vertex_start = pool.vertex_count;
+        pool.vertex_count += vertex_count;
+    }
+    if (index_start == NO_SPAN) {
+        index_start = pool.index_count;
+        pool.index_count += index_count;
+    }
+
+    MeshRange r;
+    r.format = format;
+    r.index_type = index_type;
+    r.pool = index;
+    r.dequantize = dequantize;
+    r.base_vertex = vertex_start;
+    r.vertex_count = vertex_count;
+    r.first_index = index_start;
+    r.index_count = index_count;
+    r.id = state.allocations++;
+
+    if (vertex_count > 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, pool.vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, vertex_start * stride, vertex_count * stride, vertex_data);
+    }
+
+    if (index_count > 0) {
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, index_start * index_size, index_count * index_size, index_data);
+    }
+
+    return r;
+}
+
+void GeometryBuffer::release(const MeshRange& range) {
+    Pool& pool = state.pools[range.pool];
+    give(pool.free_vertices, range.base_vertex, range.vertex_count);
+    give(pool.free_indices, range.first_index, range.index_count);
+}
+
+GLuint GeometryBuffer::vertexArray(unsigned int pool) {
+    return state.pools[pool].vao;
+}
+
+void GeometryBuffer::bindInstanceStream(GLuint buffer) {
+    if (buffer == state.stream) return;
+    state.stream = buffer;
+
+    for (unsigned int i = 0; i < GEOMETRY_POOL_COUNT; i++) {
+        if (state.pools[i].vao == 0) continue;
+
+        GLState::bindVertexArray(state.pools[i].vao);
+        glBindVertexBuffer(INSTANCE_BINDING, buffer ? buffer : state.default_stream, 0, 2 * sizeof(GLuint));
+    }
+}
+
+size_t GeometryBuffer::vertexBytes() {
+    size_t bytes = 0;
+    for (unsigned int i = 0; i < GEOMETRY_POOL_COUNT; i++) {
+        bytes += state.pools[i].vertex_count * VertexFormatStride(poolFormat(i));
+    }
+    return bytes;
+}
+
+size_t GeometryBuffer::indexBytes() {
+    size_t bytes = 0;
+    for (unsigned int i = 0; i < GEOMETRY_POOL_COUNT; i++) {
+        bytes += state.pools[i].index_count * poolIndexSize(i);
+    }
+    return bytes;
+}
@@ -0,0 +1,82 @@
+#ifndef GEOMETRYBUFFER_H
+#define GEOMETRYBUFFER_H
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "vertexformat.h"
+
+// Where a mesh ended up inside the shared buffers
+struct MeshRange {
+    VertexFormat format;
+    GLenum index_type; // GL_UNSIGNED_SHORT when the mesh has few enough vertices
+
+    // Which VAO to draw from, one per format and index type
+    unsigned int pool;
+
+    // Identity unless the format is VERTEX_PACKED
+    PositionDequantize dequantize;
+
+    GLint base_vertex;
+    GLsizei vertex_count;
+    GLuint first_index;
+    GLsizei index_count;
+
+    // Allocation order, stable for the life of the program. Used in sort keys.
+    unsigned int id;
+};
+
+// Layout fixed by the GL spec for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint  base_vertex;
+    GLuint base_instance;
+};
+
+// Per-instance uvec2 attribute read with a divisor of 1, so a draw's
+// base_instance selects where in the stream it starts. Must match
+// aInstance in shaders/shader.vert.
+#define INSTANCE_STREAM_LOCATION 5
+
+#define GEOMETRY_POOL_COUNT (VERTEX_FORMAT_COUNT * 2)
+
+// Every mesh's vertices and indices live in one big VBO/EBO pair behind a
+// VAO, so switching meshes is just a different offset and whole passes can
+// go out through glMultiDrawElementsIndirect. There is one such pool per
+// vertex format and index type, since a single multi-draw can't mix them.
+// Most meshes are loaded once up front and never freed, the ones that come
+// and go (maze chunks, anything the AssetManager unloads) hand their range
+// back with release().
+class GeometryBuffer {
+public:
+    // Copies the mesh in, packing it into `format` and growing the buffers
+    // if needed. See PrepareMesh.
+    static MeshRange allocate(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, VertexFormat format);
+
+    // Same, for data that is already in its GPU layout. The pointers are
+    // only read during the call, so they may point into a mapped file.
+    static MeshRange upload(
+        VertexFormat format, const PositionDequantize& dequantize,
+        const void* vertex_data, size_t vertex_count,
+        const void* index_data, size_t index_count, size_t index_size
+    );
+
+    // The range goes back to its pool for later allocations to reuse. Nothing
+    // may draw from it after this.
+    static void release(const MeshRange& range);
+
+    static GLuint vertexArray(unsigned int pool);
+
+    // Points the per-instance attribute of every pool at a stream of (instance, draw) pairs
+    static void bindInstanceStream(GLuint buffer);
+
+    // Bytes used across all pools, released ranges included
+    static size_t vertexBytes();
+    static size_t indexBytes();
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "glstate.h"
+
+#include <vector>
+#include <cstring>
+
+namespace {
+
+// Big enough for a mat4, the largest thing we set through Shader::set
+struct CachedUniform {
+    bool valid;
+    unsigned char value[64];
+};
+
+// Never a valid GL name, used after invalidate() so the next bind can't match
+const GLuint UNKNOWN = 0xFFFFFFFF;
+
+// Zero-initialized, which happens to match the state of a fresh context
+struct State {
+    GLuint program;
+    GLuint vao;
+    GLuint active_unit;
+    GLuint textures[MAX_TRACKED_TEXTURE_UNITS];
+
+    // Indexed by [program][location], program names are small integers in practice
+    std::vector<std::vector<CachedUniform> > uniforms;
+
+    GLState::Stats stats;
+};
+
+State state;
+
+}
+
+void GLState::useProgram(GLuint program) {
+    if (state.program == program) {
+        state.stats.program_elided++;
+        return;
+    }
+
+    glUseProgram(program);
+    state.program = program;
+    state.stats.program_binds++;
+}
+
+void GLState::bindVertexArray(GLuint vao) {
+    if (state.vao == vao) {
+        state.stats.vao_elided++;
+        return;
+    }
+
+    glBindVertexArray(vao);
+    state.vao = vao;
+    state.stats.vao_binds++;
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    // Only 2D textures are shadowed, they are all we use
+    bool tracked = unit < MAX_TRACKED_TEXTURE_UNITS && target == GL_TEXTURE_2D;
+
+    if (tracked && state.textures[unit] == texture) {
+        state.stats.texture_elided++;
+        return;
+    }
+
+    if (state.active_unit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        state.active_unit = unit;
+    }
+
+    glBindTexture(target, texture);
+    state.stats.texture_binds++;
+
+    if (tracked) {
+        state.textures[unit] = texture;
+    }
+}
+
+bool GLState::uniformChanged(GLuint program, GLint location, const void* value, size_t size) {
+    // Setting location -1 is a no-op anyway
+    if (location < 0) return false;
+
+    // Can't compare what we can't store, let it through
+    if (size > sizeof(CachedUniform::value) || program == 0) return true;
+
+    if (program >= state.uniforms.size()) {
+        state.uniforms.resize(program + 1);
+    }
+
+    std::vector<CachedUniform>& program_uniforms = state.uniforms[program];
+
+    if ((size_t)location >= program_uniforms.size()) {
+        CachedUniform empty;
+        empty.valid = false;
+        program_uniforms.resize(location + 1, empty);
+    }
+
+    CachedUniform& cached = program_uniforms[location];
+
+    if (cached.valid && std::memcmp(cached.value, value, size) == 0) {
+        state.stats.uniform_elided++;
+        return false;
+    }
+
+    std::memcpy(cached.value, value, size);
+    cached.valid = true;
+    state.stats.uniform_sets++;
+
+    return true;
+}
+
+void GLState::forgetTexture(GLuint texture) {
+    for (int i = 0; i < MAX_TRACKED_TEXTURE_UNITS; i++) {
+        if (state.textures[i] == texture) state.textures[i] = 0;
+    }
+}
+
+void GLState::invalidate() {
+    // Uniform values live in the program objects, so those remain correct
+    state.program = UNKNOWN;
+    state.vao = UNKNOWN;
+    state.active_unit = UNKNOWN;
+    for (int i = 0; i < MAX_TRACKED_TEXTURE_UNITS; i++) {
+        state.textures[i] = UNKNOWN;
+    }
+}
+
+const GLState::Stats& GLState::stats() {
+    return state.stats;
+}
+
+void GLState::resetStats() {
+    std::memset(&state.stats, 0, sizeof(state.stats));
+}
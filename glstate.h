@@ -0,0 +1,52 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/glew.h>
+#include <cstddef>
+
+// Maximum texture units we keep track of, anything above is passed straight through
+#define MAX_TRACKED_TEXTURE_UNITS 16
+
+// Shadows the bits of GL state we change per draw call so that binding
+// something that is already bound never reaches the driver. Everything
+// that binds programs, VAOs or textures has to go through here, otherwise
+// the shadow copy goes stale (call invalidate() if that can't be helped).
+class GLState {
+public:
+    struct Stats {
+        unsigned int program_binds, program_elided;
+        unsigned int vao_binds, vao_elided;
+        unsigned int texture_binds, texture_elided;
+        unsigned int uniform_sets, uniform_elided;
+
+        unsigned int issued() const {
+            return program_binds + vao_binds + texture_binds + uniform_sets;
+        }
+
+        unsigned int elided() const {
+            return program_elided + vao_elided + texture_elided + uniform_elided;
+        }
+    };
+
+    static void useProgram(GLuint program);
+    static void bindVertexArray(GLuint vao);
+    static void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+    // True if the uniform at this location of program holds something other
+    // than value, in which case the caller should set it. Keyed on the
+    // program the value is for, not whichever one happens to be bound.
+    static bool uniformChanged(GLuint program, GLint location, const void* value, size_t size);
+
+    // Call after glDeleteTextures. GL unbinds a deleted texture from every
+    // unit, and the name can come back for a new texture, so units still
+    // shadowing it would elide a bind that is needed.
+    static void forgetTexture(GLuint texture);
+
+    // Forget everything, the next bind of each kind always goes through
+    static void invalidate();
+
+    static const Stats& stats();
+    static void resetStats();
+};
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "models.h"
+#include "shader.h"
+#include "geometry.h"
+#include "bvh.h"
+
+// Must match the binding of InstanceBuffer in shaders/shader.vert
+#define INSTANCE_BUFFER_BINDING 3
+
+// Laid out for std430, mirrored by `struct Instance` in shader.vert
+struct Instance {
+    glm::mat4 model_matrix;
+    glm::vec4 flags; // x: selected
+};
+
+// Every entity sharing a Model gets a slot in one of these, so the whole
+// group goes out as one indirect command per mesh instead of one draw per
+// entity. All batches share one instance buffer owned by the Scene, each
+// batch's slots start at `first` in it.
+class InstanceBatch {
+private:
+    size_t first;
+
+    // Half-open range of slots that changed since the last upload
+    size_t dirty_begin, dirty_end;
+
+    // Bounding spheres kept apart from the instances so culling can stream
+    // through them four at a time
+    std::vector<float> sphere_x, sphere_y, sphere_z, sphere_r;
+
+    std::vector<std::pair<float, unsigned int> > by_depth;
+
+    void markDirty(size_t slot) {
+        dirty_begin = std::min(dirty_begin, slot);
+        dirty_end = std::max(dirty_end, slot + 1);
+    }
+
+    void setSphere(size_t slot, const BVH::Bounds& sphere) {
+        sphere_x[slot] = sphere.center.x;
+        sphere_y[slot] = sphere.center.y;
+        sphere_z[slot] = sphere.center.z;
+        sphere_r[slot] = sphere.radius;
+    }
+
+public:
+    Model* model;
+    std::vector<Instance> instances;
+
+    // Slots that survived culling this frame, nearest first
+    std::vector<unsigned int> visible;
+
+    static InstanceBatch FromModel(Model* model) {
+        InstanceBatch b;
+        b.model = model;
+        b.first = 0;
+        b.dirty_begin = 0;
+        b.dirty_end = 0;
+        return b;
+    }
+
+    // Moves the batch to a new spot in the shared buffer, everything goes up again
+    void place(size_t first) {
+        this->first = first;
+        dirty_begin = 0;
+        dirty_end = instances.size();
+    }
+
+    // Index of a slot in the shared instance buffer
+    unsigned int bufferIndex(unsigned int slot) const {
+        return first + slot;
+    }
+
+    int add(const glm::mat4& model_matrix, const BVH::Bounds& bounds, bool selected) {
+        Instance i;
+        i.model_matrix = model_matrix;
+        i.flags = glm::vec4(selected ? 1.0f : 0.0f, 0.0f, 0.0f, 0.0f);
+        instances.push_back(i);
+
+        sphere_x.push_back(0.0f);
+        sphere_y.push_back(0.0f);
+        sphere_z.push_back(0.0f);
+        sphere_r.push_back(0.0f);
+        setSphere(instances.size() - 1, bounds);
+
+        markDirty(instances.size() - 1);
+        return instances.size() - 1;
+    }
+
+    void setMatrix(int slot, const glm::mat4& model_matrix, const BVH::Bounds& bounds) {
+        instances[slot].model_matrix = model_matrix;
+        setSphere(slot, bounds);
+        markDirty(slot);
+    }
+
+    void setSelected(int slot, bool selected) {
+        instances[slot].flags.x = selected ? 1.0f : 0.0f;
+        markDirty(slot);
+    }
+
+    // Fills `visible` with the slots inside the frustum, sorted front to back
+    // so that the nearest instances lay down depth first
+    void cull(const Frustum& frustum, glm::vec3 eye) {
+        visible.clear();
+        if (instances.empty()) return;
+
+        frustum.cull_spheres(&sphere_x[0], &sphere_y[0], &sphere_z[0], &sphere_r[0], instances.size(), visible);
+
+        by_depth.resize(visible.size());
+        for (size_t i = 0; i < visible.size(); i++) {
+            unsigned int slot = visible[i];
+            glm::vec3 d = glm::vec3(sphere_x[slot], sphere_y[slot], sphere_z[slot]) - eye;
+            by_depth[i] = std::make_pair(glm::dot(d, d), slot);
+        }
+
+        std::sort(by_depth.begin(), by_depth.end());
+
+        for (size_t i = 0; i < visible.size(); i++) {
+            visible[i] = by_depth[i].second;
+        }
+    }
+
+    // Distance from p to the nearest visible instance, used as the sort depth of the batch
+    float nearestDistance(glm::vec3 p) const {
+        if (visible.empty()) return INFINITY;
+        unsigned int slot = visible[0];
+        return glm::length(glm::vec3(sphere_x[slot], sphere_y[slot], sphere_z[slot]) - p);
+    }
+
+    // Only pushes the slots touched since last time. The buffer has to be
+    // bound to GL_SHADER_STORAGE_BUFFER and big enough, see Scene::rebuild_batches.
+    void upload() {
+        if (dirty_begin >= dirty_end) return;
+
+        glBufferSubData(
+            GL_SHADER_STORAGE_BUFFER,
+            (first + dirty_begin) * sizeof(Instance),
+            (dirty_end - dirty_begin) * sizeof(Instance),
+            &instances[dirty_begin]
+        );
+
+        dirty_begin = instances.size();
+        dirty_end = 0;
+    }
+};
+
+#endif
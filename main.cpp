@@ -1,5 +1,7 @@
 #include <cstdlib>
 #include <stdio.h>
+#include <string.h>
+#include <memory>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/ext.hpp>
@@ -12,6 +14,11 @@
 #include "animation.h"
 #include "player.h"
 #include "maze.h"
+#include "mazestream.h"
+#include "rng.h"
+#include "gbuffer.h"
+#include "ubo.h"
+#include "glstate.h"
 
 #include "input.h"
 #include "debug.h"
@@ -63,48 +70,82 @@ Camera* activeCamera;
 
 Scene  scene;
 
-int main() {
+UniformBuffer<FrameConstants> frameConstants = UniformBuffer<FrameConstants>::AtBinding(FRAME_CONSTANTS_BINDING);
+
+int main(int argc, char** argv) {
+    // --endless walks a maze that is made as you go instead of a fixed one,
+    // --lights N sets how many small lights wander around it, --deferred
+    // shades through a G-buffer instead of in one forward pass. --bench N
+    // draws N frames from a fixed camera, prints GPU time per frame and
+    // quits, see `make renderbench`.
+    bool endless = false;
+    bool deferred = false;
+    int wandering_light_count = 256;
+    int bench_frames = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--endless") == 0) endless = true;
+        else if (strcmp(argv[i], "--deferred") == 0) deferred = true;
+        else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc) wandering_light_count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) bench_frames = atoi(argv[++i]);
+    }
+
     init();
 
     debug = Debug::init();
 
     currentMode = GameMode::PLAY;
 
-    // Shader Setup
-    ourShader = Shader::FromPath("shaders/shader.vert", "shaders/shader.frag");
-    debugShader = Shader::FromPath("shaders/debug.vert", "shaders/debug.frag");
-    Shader skyBoxShader = Shader::FromPath("shaders/skybox.vert", "shaders/skybox.frag");
+    // Everything that comes off disk starts loading here, in the background,
+    // while the shaders below compile
+    ModelHandle statue_handle = AssetManager::model("res/statue/12330_Statue_v1_L2.obj");
+    ModelHandle hand_handle = AssetManager::model("res/hand/hand.obj");
+    TextureHandle wall_diffuse_handle = AssetManager::texture("res/brickwall/brickwall.jpg");
+    TextureHandle wall_normal_handle = AssetManager::texture("res/brickwall/brickwall_normal.jpg");
+    TextureHandle floor_diffuse_handle = AssetManager::texture("res/Brick_Wall_009/Brick_Wall_009_COLOR.jpg");
+    TextureHandle floor_normal_handle = AssetManager::texture("res/Brick_Wall_009/Brick_Wall_009_NORM.jpg");
+
+    // Shader Setup, these finish on their own time too, see the main loop.
+    // The deferred path draws the scene into a G-buffer with the same
+    // vertex shader, then lights it in one fullscreen pass.
+    ourShader = Shader::Compile("shaders/shader.vert", deferred ? "shaders/gbuffer.frag" : "shaders/shader.frag");
+    Shader lightingShader;
+    if (deferred) lightingShader = Shader::Compile("shaders/deferred.vert", "shaders/deferred.frag");
+    GBuffer gbuffer;
+    int framebuffer_width = WIDTH, framebuffer_height = HEIGHT;
+    debugShader = Shader::Compile("shaders/debug.vert", "shaders/debug.frag");
+    Shader skyBoxShader = Shader::Compile("shaders/skybox.vert", "shaders/skybox.frag");
 
     debugCamera = Camera::Default();
     debugCamera.position = glm::vec3(0.0f, 3.0f, 3.0f);
 
     // SOME MISCELLANEOUS MODELS AND MESHES
-    vector<Model> statues;
-    Model statue = Model::FromPath("res/statue/12330_Statue_v1_L2.obj");
+    std::vector<Model> statues;
+    Model& statue = *AssetManager::get(statue_handle);
     statue.transform = glm::rotate(statue.transform, glm::radians(-90.0f), glm::vec3(1, 0, 0));
     statue.transform = glm::scale(statue.transform, glm::vec3(1.5f));
     statues.push_back(statue);
 
-    Model sphere_model = Model::FromMesh(Mesh::Sphere());
-    Mesh skySphere = Mesh::Sphere();
+    // Shared with the debug light, see Debug::setup_models
+    Mesh skySphere = *AssetManager::get(AssetManager::mesh("sphere", []() { return Mesh::Sphere(); }));
 
     // PLAYER MODEL AND ENTITY
-    Model hand = Model::FromPath("res/hand/hand.obj");
+    Model& hand = *AssetManager::get(hand_handle);
     for (Mesh &mesh : hand.meshes) {
         mesh.material = Material::Hand();
     }
 
-    Entity player_entity = Entity::FromModel(&hand);
-    player_entity.model->transform = glm::rotate(
-        player_entity.model->transform,
+    // Before the entity exists, it takes the model's transform as its offset
+    hand.transform = glm::rotate(
+        hand.transform,
         glm::radians(-90.0f),
         glm::vec3(1.0f, 0.0f, 0.0f)
     );
-    player_entity.model->transform = glm::rotate(
-        player_entity.model->transform,
+    hand.transform = glm::rotate(
+        hand.transform,
         glm::radians(195.0f),
         glm::vec3(0.0f, 0.0f, 1.0f)
     );
+    Entity player_entity = Entity::FromModel(&hand);
     player = Player::FromEntity(player_entity);
 
     // LIGHTS
@@ -123,10 +164,14 @@ int main() {
     scene.directional_lights.push_back(dlight);
 
     // SETUP MAP 
-    Texture wall_diffuse_texture  = Texture::DiffuseFromPath("res/brickwall/brickwall.jpg");
-    Texture wall_normal_texture   = Texture::NormalFromPath("res/brickwall/brickwall_normal.jpg");
-    Texture floor_diffuse_texture = Texture::DiffuseFromPath("res/Brick_Wall_009/Brick_Wall_009_COLOR.jpg");
-    Texture floor_normal_texture  = Texture::NormalFromPath("res/Brick_Wall_009/Brick_Wall_009_NORM.jpg");
+    Texture wall_diffuse_texture  = *AssetManager::get(wall_diffuse_handle);
+    Texture wall_normal_texture   = *AssetManager::get(wall_normal_handle);
+    Texture floor_diffuse_texture = *AssetManager::get(floor_diffuse_handle);
+    Texture floor_normal_texture  = *AssetManager::get(floor_normal_handle);
+    wall_diffuse_texture.type  = Texture::Type::DIFFUSE;
+    wall_normal_texture.type   = Texture::Type::NORMAL;
+    floor_diffuse_texture.type = Texture::Type::DIFFUSE;
+    floor_normal_texture.type  = Texture::Type::NORMAL;
 
     Mesh tile_mesh = Mesh::Cube();
 
@@ -138,83 +183,133 @@ int main() {
     tile_mesh.normalTexture = floor_normal_texture;
     Model tile_floor = Model::FromMesh(tile_mesh);
 
-    // (width, height) here is in number of nodes
-    // for the DFS algorithm, so this actually creates
-    // a (2*width+1) * (2*height+1) tile map
-    Maze maze = Maze::Default(30, 30);
+    float map_scale = 1.0f;
 
-    printf("Map dimensions: (%d, %d):", maze.tiles.size(), maze.tiles[0].size());
+    // Only there in endless mode, spawns chunks as the player gets near them
+    std::unique_ptr<MazeStream> maze_stream;
+    Model maze_model;
 
-    float map_scale = 1.0f;
+    if (endless) {
+        MazeStream::Models maze_models = { &tile_wall, &tile_floor, &statue };
+        maze_stream.reset(new MazeStream(30, 1, maze_models, map_scale));
+        maze_stream->origin = glm::vec3(-10.0f, 0.0f, -10.0f) * map_scale;
 
-    // Some hardcoded fun
-    for (int i = 0; i < maze.tiles.size(); i++) {
-        for (int j = 0; j < maze.tiles[0].size(); j++) {
-            Entity* e = new Entity;
-            glm::vec3 pos = glm::vec3(0.0f);
-            pos.x = (i - 10) * map_scale;
-            pos.z = (j - 10) * map_scale;
-
-            switch (maze.tiles[i][j]) {
-            case Maze::TileType::FLOOR:
-                *e = Entity::FromModel(&tile_floor);
-                pos.y = (-0.5f + 0.01f * (rand() % 3)) * map_scale;
-                break;
-
-            case Maze::TileType::WALL:
-                *e = Entity::FromModel(&tile_wall);
-                pos.y = (0.5f) * map_scale;
-                break;
-
-            case Maze::TileType::STATUE:
-                *e = Entity::FromModel(&tile_floor);
-                pos.y = (-0.5f + 0.01f * (rand() % 3)) * map_scale;
-
-                Entity* s = new Entity;
-                *s = Entity::FromModel(&statue);
-                s->setRotation(glm::vec3(0.0f, glm::radians((float)(rand() % 360)), 0.0f));
-                s->setPosition(pos + glm::vec3(0.0f, 0.50f, 0.0f) * map_scale);
-                s->setScale(glm::vec3(map_scale));
-                scene.entities.push_back(s);
+        printf("Map dimensions: (%d, endless)\n", 2 * 30 + 1);
+    }
+    else {
+        // (width, height) here is in number of nodes
+        // for the DFS algorithm, so this actually creates
+        // a (2*width+1) * (2*height+1) tile map
+        Maze maze = Maze::Default(30, 30);
+        Grid<Maze::TileType> tiles = maze.tiles();
+
+        printf("Map dimensions: (%d, %d):", tiles.width, tiles.height);
+
+        // Walls and floor as one model, greedy meshed, statues on their own
+        MazeGeometry geometry = MeshMaze(tiles);
+        printf(" %zu triangles instead of %zu\n", geometry.triangles(), MazeCubeTriangles(tiles));
+        OptimizeMaze(geometry);
+
+        glm::vec3 corner = glm::vec3(-10.0f, 0.0f, -10.0f) * map_scale;
+        maze_model = MazeModel(geometry, tile_wall, tile_floor);
+        EntityId level = scene.entities.create(&maze_model, corner, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(map_scale));
+
+        // Its bounds cover the whole level, clicks are for the statues
+        scene.entities.setPickable(level, false);
+
+        for (int i = 0; i < tiles.width; i++) {
+            for (int j = 0; j < tiles.height; j++) {
+                if (tiles(i, j) != Maze::TileType::STATUE) continue;
+
+                scene.entities.create(
+                    &statue,
+                    corner + glm::vec3((float)i, 0.0f, (float)j) * map_scale,
+                    EulerRotation(glm::vec3(0.0f, glm::radians((float)(rand() % 360)), 0.0f)),
+                    glm::vec3(map_scale)
+                );
             }
+        }
+    }
 
-            e->setPosition(pos);
-            e->setScale(glm::vec3(map_scale));
-
-            scene.entities.push_back(e);
+    // LIGHT PATHS, closed loops through the corners at constant speed,
+    // once round every five seconds
+    std::vector<glm::vec4> corners1 = {
+        glm::vec4(2.0f, 1.0f, 2.0f, 1.0f),
+        glm::vec4(9.0f, 1.0f, 2.0f, 1.0f),
+        glm::vec4(9.0f, 1.0f, 9.0f, 1.0f),
+        glm::vec4(2.0f, 1.0f, 9.0f, 1.0f)
+    };
+    std::vector<glm::vec4> corners2 = {
+        glm::vec4(8.0f, 1.5f, 2.0f, 1.0f),
+        glm::vec4(2.0f, 1.5f, 2.0f, 1.0f),
+        glm::vec4(2.0f, 1.5f, 8.0f, 1.0f),
+        glm::vec4(8.0f, 1.5f, 8.0f, 1.0f)
+    };
+
+    Animations<glm::vec4> light_paths;
+    Animations<glm::vec4>::PathId path1 = light_paths.addPath(Spline<glm::vec4>::CatmullRom(corners1, true));
+    Animations<glm::vec4>::PathId path2 = light_paths.addPath(Spline<glm::vec4>::CatmullRom(corners2, true));
+    Animations<glm::vec4>::TrackId light1 = light_paths.add(path1, light_paths.pathLength(path1) / 5.0f);
+    Animations<glm::vec4>::TrackId light2 = light_paths.add(path2, light_paths.pathLength(path2) / 5.0f);
+
+    // WANDERING LIGHTS, each going round its own little loop somewhere over
+    // the maze. Small radius so only a few reach any one fragment, the
+    // clusters in Scene keep the rest out of the shader.
+    std::vector<Animations<glm::vec4>::TrackId> wanderers;
+    Rng light_rng = Rng::Stream(1, 0);
+    for (int i = 0; i < wandering_light_count; i++) {
+        glm::vec3 center = glm::vec3(-10.0f, 0.0f, -10.0f) * map_scale
+            + glm::vec3(light_rng.unit() * 61.0f, 0.4f + light_rng.unit(), light_rng.unit() * 61.0f) * map_scale;
+        float size = (0.5f + light_rng.unit() * 1.5f) * map_scale;
+
+        std::vector<glm::vec4> loop;
+        for (int k = 0; k < 4; k++) {
+            float a = glm::radians(90.0f * k) + light_rng.unit();
+            loop.push_back(glm::vec4(center + glm::vec3(glm::cos(a), 0.0f, glm::sin(a)) * size, 1.0f));
         }
+
+        Animations<glm::vec4>::PathId path = light_paths.addPath(Spline<glm::vec4>::CatmullRom(loop, true));
+        float length = light_paths.pathLength(path);
+        wanderers.push_back(light_paths.add(path, 0.5f + light_rng.unit() * 1.5f, PlayMode::LOOP, light_rng.unit() * length));
+
+        PointLight p = PointLight::Default();
+        p.radius = (1.5f + light_rng.unit() * 1.5f) * map_scale;
+        p.position = light_paths.value(wanderers.back());
+
+        // Bright and saturated, one channel held back
+        glm::vec3 color = glm::vec3(light_rng.unit(), light_rng.unit(), light_rng.unit());
+        color[light_rng.below(3)] = 0.0f;
+        p.color = glm::vec4(color / glm::max(glm::max(color.x, color.y), glm::max(color.z, 0.01f)), 1.0f);
+        scene.point_lights.push_back(p);
     }
 
-    // LIGHT BEZIERS
-    Bezier<glm::vec4> b1;
-    b1.control_points.push_back(glm::vec4(2.0f, 1.0f, 2.0f, 1.0f));
-    b1.control_points.push_back(glm::vec4(9.0f, 1.0f, 2.0f, 1.0f));
-    b1.control_points.push_back(glm::vec4(9.0f, 1.0f, 9.0f, 1.0f));
-    b1.control_points.push_back(glm::vec4(2.0f, 1.0f, 9.0f, 1.0f));
-    b1.control_points.push_back(glm::vec4(2.0f, 1.0f, 2.0f, 1.0f));
-
-    Bezier<glm::vec4> b2;
-    b2.control_points.push_back(glm::vec4(8.0f, 1.5f, 2.0f, 1.0f));
-    b2.control_points.push_back(glm::vec4(2.0f, 1.5f, 2.0f, 1.0f));
-    b2.control_points.push_back(glm::vec4(2.0f, 1.5f, 8.0f, 1.0f));
-    b2.control_points.push_back(glm::vec4(8.0f, 1.5f, 8.0f, 1.0f));
-    b2.control_points.push_back(glm::vec4(2.0f, 1.5f, 2.0f, 1.0f));
-    b2.control_points.push_back(glm::vec4(8.0f, 1.5f, 2.0f, 1.0f));
-
-    Bezier<float> b3;
-    b3.control_points.push_back(1.0f);
-    b3.control_points.push_back(0.0f);
-    b3.control_points.push_back(0.0f);
-    b3.control_points.push_back(1.0f);
+    // LIGHT COLOURS
+    const float fade[4] = { 1.0f, 0.0f, 0.0f, 1.0f };
+    Bezier<float, 4> b3(fade);
 
     // Some final GL setup
     glViewport(0, 0, WIDTH, HEIGHT);
     glEnable(GL_FRAMEBUFFER_SRGB);
     glEnable(GL_CULL_FACE);
 
+    // The benchmark times the scene passes on the GPU, geometry through to
+    // the last light (G-buffer clear included), leaving out the sky. Two
+    // queries so reading last frame's never waits on this one.
+    const int BENCH_WARMUP = 60;
+    GLuint bench_queries[2] = { 0, 0 };
+    int bench_frame = 0;
+    double bench_gpu_ms = 0.0, bench_cpu_ms = 0.0;
+    if (bench_frames > 0) {
+        glfwSwapInterval(0);
+        glGenQueries(2, bench_queries);
+    }
+
     while (!glfwWindowShouldClose(window)) {
         // Who doesn't love pointer juggling
-        if (currentMode == GameMode::PLAY) {
+        if (bench_frames > 0) {
+            activeCamera = &debugCamera;
+        }
+        else if (currentMode == GameMode::PLAY) {
             activeCamera = &player.camera;
         }
         else if (currentMode == GameMode::DEBUG) {
@@ -225,8 +320,19 @@ int main() {
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        // Same frames on every run: fixed steps, and one slow turn over the
+        // maze looking down into the corridors
+        if (bench_frames > 0) {
+            deltaTime = 1.0f / 60.0f;
+            debugCamera.position = glm::vec3(20.0f, 3.0f, 20.0f) * map_scale;
+            debugCamera.setRotation(360.0f * bench_frame / bench_frames, -30.0f);
+        }
+
         processInput(window);
 
+        // Whatever finished loading since last frame
+        AssetManager::update();
+
         if (currentMode == GameMode::PLAY) {
             player.processInput(window, deltaTime);
         }
@@ -234,25 +340,60 @@ int main() {
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        ourShader.use();
-        ourShader.setCamera(*activeCamera);
+        // Nothing gets drawn until every program has linked, asking
+        // doesn't wait on the compiler
+        bool shaders_ready = ourShader.poll() & debugShader.poll() & skyBoxShader.poll() & (!deferred || lightingShader.poll());
+        if (!shaders_ready) {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+            continue;
+        }
 
-        scene.point_lights[0].position = b1.at(glfwGetTime() / 5.0);
-        scene.point_lights[1].position = b2.at(glfwGetTime() / 5.0);
+        frameConstants.upload(FrameConstants::FromCamera(*activeCamera));
 
-        float at1 = b3.at(glfwGetTime() / 5.0);
-        float at2 = b3.at(glfwGetTime() / 5.0 + 0.66);
-        float at3 = b3.at(glfwGetTime() / 5.0 + 0.33);
+        light_paths.update(deltaTime);
+        scene.point_lights[0].position = light_paths.value(light1);
+        scene.point_lights[1].position = light_paths.value(light2);
+        for (size_t i = 0; i < wanderers.size(); i++) {
+            scene.point_lights[2 + i].position = light_paths.value(wanderers[i]);
+        }
+
+        double phases[3] = { glfwGetTime() / 5.0, glfwGetTime() / 5.0 + 0.66, glfwGetTime() / 5.0 + 0.33 };
+        float at[3];
+        b3.at(phases, at, 3);
+
+        scene.point_lights[0].color = glm::vec4(at[0], at[1], at[2], 1.0f);
+        scene.point_lights[1].color = glm::vec4(at[1], at[2], at[0], 1.0f);
+
+        if (maze_stream) {
+            maze_stream->update(player.entity.getPosition(), scene.entities);
+        }
+
+        // Every matrix that changed since last frame, in one go
+        Transforms::update();
 
-        scene.point_lights[0].color = glm::vec4(at1, at2, at3, 1.0f);
-        scene.point_lights[1].color = glm::vec4(at2, at3, at1, 1.0f);
+        scene.update();
 
-        scene.draw(ourShader);
+        if (bench_frames > 0) glBeginQuery(GL_TIME_ELAPSED, bench_queries[bench_frame & 1]);
+
+        if (deferred) {
+            glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+            gbuffer.resize(framebuffer_width, framebuffer_height);
+            gbuffer.bind();
+        }
+
+        ourShader.use();
+        scene.draw(ourShader, *activeCamera);
         player.draw(ourShader);
 
+        if (deferred) {
+            gbuffer.light(lightingShader);
+        }
+
+        if (bench_frames > 0) glEndQuery(GL_TIME_ELAPSED);
+
         if (currentMode == GameMode::DEBUG) {
             debugShader.use();
-            debugShader.setCamera(*activeCamera);
 
             for (PointLight p : scene.point_lights) {
                 debug.draw_point_light(debugShader, p);
@@ -261,19 +402,66 @@ int main() {
             debug.draw_grid(debugShader);
         }
 
+        // The sphere faces outward, shared with the debug lights, and the
+        // sky is seen from inside it
         glDepthFunc(GL_LEQUAL);
+        glCullFace(GL_FRONT);
 
         skyBoxShader.use();
-        skyBoxShader.setCamera(*activeCamera);
         skySphere.draw(skyBoxShader);
 
+        glCullFace(GL_BACK);
         glDepthFunc(GL_LESS);
 
+        if (currentMode == GameMode::DEBUG) {
+            const GLState::Stats& stats = GLState::stats();
+            const RenderQueue::Stats& queue_stats = scene.queue_stats();
+            Transforms::Stats transform_stats = Transforms::stats();
+            MazeStream::Stats maze_stats = maze_stream ? maze_stream->stats() : MazeStream::Stats();
+            const LightClusters::Stats& light_stats = scene.light_stats();
+            char title[640];
+            snprintf(title, sizeof(title),
+                "OpenGL-Testing | GL calls: %u issued, %u elided (program %u/%u, vao %u/%u, texture %u/%u, uniform %u/%u)"
+                " | queue: %u draws in %u multi-draws, %u -> %u state changes"
+                " | transforms: %u/%u rebuilt | chunks: %u resident, %u pending"
+                " | lights: %u on screen, %u per cluster at most",
+                stats.issued(), stats.elided(),
+                stats.program_binds, stats.program_elided,
+                stats.vao_binds, stats.vao_elided,
+                stats.texture_binds, stats.texture_elided,
+                stats.uniform_sets, stats.uniform_elided,
+                queue_stats.items, queue_stats.multi_draws, queue_stats.state_changes_unsorted, queue_stats.state_changes_sorted,
+                transform_stats.worlds, transform_stats.live,
+                maze_stats.resident, maze_stats.pending,
+                light_stats.lights, light_stats.busiest
+            );
+            glfwSetWindowTitle(window, title);
+        }
+        GLState::resetStats();
+
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        if (bench_frames > 0) {
+            if (bench_frame > BENCH_WARMUP) {
+                GLuint64 elapsed;
+                glGetQueryObjectui64v(bench_queries[(bench_frame - 1) & 1], GL_QUERY_RESULT, &elapsed);
+                bench_gpu_ms += elapsed / 1e6;
+                bench_cpu_ms += (glfwGetTime() - currentFrame) * 1e3;
+            }
+
+            if (++bench_frame > BENCH_WARMUP + bench_frames) {
+                printf("%s, %zu point lights: %.3f ms GPU scene, %.3f ms CPU frame, over %d frames\n",
+                    deferred ? "deferred" : "forward", scene.point_lights.size(),
+                    bench_gpu_ms / bench_frames, bench_cpu_ms / bench_frames, bench_frames);
+                glfwSetWindowShouldClose(window, true);
+            }
+        }
     }
 
     // Cleanup
+    if (maze_stream) maze_stream->clear(scene.entities);
+    AssetManager::shutdown();
     glfwDestroyWindow(window);
     glfwTerminate();
 
@@ -330,12 +518,13 @@ void mouse_callback(
     GLFWwindow* window, double xpos, double ypos
 ) {
     if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
-        if (scene.selected_entity) {
+        TransformId selected = scene.entities.transform(scene.selected_entity);
+        if (selected != NO_TRANSFORM) {
             glm::vec3 cursor_pos = Input::getCursorWorldPosition(window, *activeCamera);
             glm::vec3 dir = glm::normalize(activeCamera->position - cursor_pos);
-            float t = Plane::PointNormal(scene.selected_entity->getPosition(), activeCamera->front)
+            float t = Plane::PointNormal(Transforms::position(selected), activeCamera->front)
                 .ray_test(cursor_pos, dir);
-            scene.selected_entity->setPosition(cursor_pos + t * dir);
+            Transforms::setPosition(selected, cursor_pos + t * dir);
         }
     }
 }
@@ -347,7 +536,7 @@ void mouse_button_callback(
     case GLFW_MOUSE_BUTTON_LEFT:
         if (action == GLFW_PRESS) {
             glm::vec3 cursor_pos = Input::getCursorWorldPosition(window, *activeCamera);
-            glm::vec3 dir = glm::normalize(activeCamera->position - cursor_pos);
+            glm::vec3 dir = glm::normalize(cursor_pos - activeCamera->position);
             scene.select_by_ray_cast(cursor_pos, dir);
         }
     }
@@ -0,0 +1,90 @@
+#include "mappedfile.h"
+
+#include <cstdio>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() {
+    bytes = NULL;
+    length = 0;
+#ifndef _WIN32
+    mapping = NULL;
+#endif
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (size > 0) {
+        buffer.resize(size);
+        if (fread(&buffer[0], 1, size, f) == (size_t)size) {
+            bytes = &buffer[0];
+            length = size;
+        }
+    }
+
+    fclose(f);
+
+    if (!bytes) buffer.clear();
+    return bytes != NULL;
+}
+
+void MappedFile::close() {
+    buffer.clear();
+    bytes = NULL;
+    length = 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) {
+            mapping = m;
+            bytes = (const unsigned char*)m;
+            length = st.st_size;
+        }
+    }
+
+    // The mapping stays valid without the descriptor
+    ::close(fd);
+
+    return bytes != NULL;
+}
+
+void MappedFile::close() {
+    if (mapping) {
+        munmap(mapping, length);
+    }
+
+    mapping = NULL;
+    bytes = NULL;
+    length = 0;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Read-only view of a whole file. Memory mapped where we can, so the pages
+// only get read in as they are touched, and plainly read into memory on
+// Windows. Not copyable, pass it around by reference.
+class MappedFile {
+private:
+    const unsigned char* bytes;
+    size_t length;
+
+#ifdef _WIN32
+    std::vector<unsigned char> buffer;
+#else
+    void* mapping;
+#endif
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // False if the file can't be opened or is empty
+    bool open(const std::string& path);
+    void close();
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+#endif
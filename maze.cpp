@@ -0,0 +1,434 @@
+#include "maze.h"
+#include "threadpool.h"
+
+#include <deque>
+#include <memory>
+#include <algorithm>
+
+namespace {
+
+// Nodes per side of a Wilson block, and the most nodes a division region
+// may have before it is split off as a task of its own. Fixed rather than
+// derived from the thread count, so the maze only depends on the seed.
+const int WILSON_BLOCK = 128;
+const size_t DIVISION_REGION = 1 << 16;
+
+// East, west, south, north
+const int DX[4] = { 1, -1, 0, 0 };
+const int DY[4] = { 0, 0, 1, -1 };
+
+// The backtracker keeps the direction it came from in the bits above the passages
+const int BACK_SHIFT = 2;
+const uint8_t PASSAGE_BITS = Maze::EAST | Maze::SOUTH;
+
+// Opens the passage from (x, y) in direction d. Only ever writes to the
+// byte of one of the two nodes involved.
+void carve(Grid<uint8_t>& g, int x, int y, int d) {
+    switch (d) {
+    case 0: g(x, y)     |= Maze::EAST;  break;
+    case 1: g(x - 1, y) |= Maze::EAST;  break;
+    case 2: g(x, y)     |= Maze::SOUTH; break;
+    case 3: g(x, y - 1) |= Maze::SOUTH; break;
+    }
+}
+
+struct Region {
+    int x, y, w, h;
+};
+
+// Divides until every region is a single row or column, which is a tree on
+// its own. With `spill`, regions of at most spill_below nodes are handed
+// back instead of divided.
+void divide(Grid<uint8_t>& g, Region start, Rng& rng, std::vector<Region>* spill, size_t spill_below) {
+    std::vector<Region> stack;
+    stack.push_back(start);
+
+    while (!stack.empty()) {
+        Region r = stack.back();
+        stack.pop_back();
+
+        if (r.w < 2 || r.h < 2) continue;
+
+        if (spill && (size_t)r.w * r.h <= spill_below) {
+            spill->push_back(r);
+            continue;
+        }
+
+        bool vertical = r.w > r.h || (r.w == r.h && rng.below(2));
+
+        if (vertical) {
+            int wall = r.x + rng.below(r.w - 1);
+            int gap = r.y + rng.below(r.h);
+            for (int y = r.y; y < r.y + r.h; y++) {
+                if (y != gap) g(wall, y) &= ~Maze::EAST;
+            }
+
+            Region a = { r.x, r.y, wall - r.x + 1, r.h };
+            Region b = { wall + 1, r.y, r.x + r.w - wall - 1, r.h };
+            stack.push_back(a);
+            stack.push_back(b);
+        }
+        else {
+            int wall = r.y + rng.below(r.h - 1);
+            int gap = r.x + rng.below(r.w);
+            for (int x = r.x; x < r.x + r.w; x++) {
+                if (x != gap) g(x, wall) &= ~Maze::SOUTH;
+            }
+
+            Region a = { r.x, r.y, r.w, wall - r.y + 1 };
+            Region b = { r.x, wall + 1, r.w, r.y + r.h - wall - 1 };
+            stack.push_back(a);
+            stack.push_back(b);
+        }
+    }
+}
+
+// Wilson's algorithm confined to one rectangle of g
+void wilson(Grid<uint8_t>& g, Region r, Rng rng) {
+    size_t n = (size_t)r.w * r.h;
+    if (n == 0) return;
+
+    std::vector<uint8_t> dir(n);
+    BitGrid in_tree(r.w, r.h);
+
+    in_tree.set(rng.below(n));
+
+    for (size_t start = 0; start < n; start++) {
+        if (in_tree.test(start)) continue;
+
+        // Walk until the tree is hit. Revisiting a cell overwrites its
+        // direction, which is what erases the loops.
+        size_t c = start;
+        while (!in_tree.test(c)) {
+            int x = c % r.w, y = c / r.w;
+            int d, nx, ny;
+            do {
+                d = rng.below(4);
+                nx = x + DX[d];
+                ny = y + DY[d];
+            } while (nx < 0 || nx >= r.w || ny < 0 || ny >= r.h);
+
+            dir[c] = d;
+            c = (size_t)ny * r.w + nx;
+        }
+
+        // Then follow the surviving directions and add the path
+        c = start;
+        while (!in_tree.test(c)) {
+            int x = c % r.w, y = c / r.w;
+            int d = dir[c];
+            in_tree.set(c);
+            carve(g, r.x + x, r.y + y, d);
+            c = (size_t)(y + DY[d]) * r.w + (x + DX[d]);
+        }
+    }
+}
+
+Maze empty(int width, int height, uint64_t seed) {
+    Maze m;
+    m.passages = Grid<uint8_t>(width, height, 0);
+    m.seed = seed;
+    return m;
+}
+
+}
+
+Maze::TileType Maze::tile(int x, int y) const {
+    bool odd_x = x & 1, odd_y = y & 1;
+    bool open = false;
+
+    if (x > 0 && y > 0 && x < tileWidth() - 1 && y < tileHeight() - 1) {
+        if (odd_x && odd_y) open = true;
+        else if (odd_x) open = passages(x / 2, y / 2 - 1) & SOUTH;
+        else if (odd_y) open = passages(x / 2 - 1, y / 2) & EAST;
+    }
+
+    return open ? FLOOR : Wall(seed, x, y);
+}
+
+Maze::TileType Maze::Wall(uint64_t seed, int64_t x, int64_t y) {
+    uint64_t h = Rng::Mix(seed ^ Rng::Mix(((uint64_t)(uint32_t)x << 32) | (uint32_t)y));
+    return h % 10 == 0 ? STATUE : WALL;
+}
+
+Grid<Maze::TileType> Maze::tiles() const {
+    Grid<TileType> out(tileWidth(), tileHeight());
+    for (int y = 0; y < out.height; y++) {
+        for (int x = 0; x < out.width; x++) {
+            out(x, y) = tile(x, y);
+        }
+    }
+    return out;
+}
+
+bool Maze::isPerfect() const {
+    int w = width(), h = height();
+    size_t n = (size_t)w * h;
+    if (n == 0) return false;
+
+    size_t edges = 0;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint8_t p = passages(x, y);
+            if (p & ~PASSAGE_BITS) return false;
+            if ((p & EAST) && x == w - 1) return false;
+            if ((p & SOUTH) && y == h - 1) return false;
+            edges += (p & EAST ? 1 : 0) + (p & SOUTH ? 1 : 0);
+        }
+    }
+    if (edges != n - 1) return false;
+
+    // n - 1 edges and connected means a tree
+    BitGrid seen(w, h);
+    std::deque<uint32_t> queue;
+    seen.set(0);
+    queue.push_back(0);
+    size_t reached = 0;
+
+    while (!queue.empty()) {
+        uint32_t c = queue.front();
+        queue.pop_front();
+        reached++;
+
+        int x = c % w, y = c / w;
+        uint32_t next[4];
+        int count = 0;
+        if (passages(x, y) & EAST) next[count++] = c + 1;
+        if (passages(x, y) & SOUTH) next[count++] = c + w;
+        if (x > 0 && (passages(x - 1, y) & EAST)) next[count++] = c - 1;
+        if (y > 0 && (passages(x, y - 1) & SOUTH)) next[count++] = c - w;
+
+        for (int i = 0; i < count; i++) {
+            if (seen.test(next[i])) continue;
+            seen.set(next[i]);
+            queue.push_back(next[i]);
+        }
+    }
+
+    return reached == n;
+}
+
+Maze Maze::Backtracker(int width, int height, uint64_t seed) {
+    Maze m = empty(width, height, seed);
+    Grid<uint8_t>& g = m.passages;
+    BitGrid visited(width, height);
+    Rng rng(seed);
+
+    int x = width / 2, y = height / 2;
+    visited.set(x, y);
+
+    for (;;) {
+        int options[4];
+        int count = 0;
+        for (int d = 0; d < 4; d++) {
+            int nx = x + DX[d], ny = y + DY[d];
+            if (nx < 0 || nx >= width || ny < 0 || ny >= height) continue;
+            if (visited.test(nx, ny)) continue;
+            options[count++] = d;
+        }
+
+        if (count > 0) {
+            int d = options[rng.below(count)];
+            carve(g, x, y, d);
+            x += DX[d];
+            y += DY[d];
+            visited.set(x, y);
+
+            // Opposite direction plus one, 0 marks the start
+            g(x, y) |= ((d ^ 1) + 1) << BACK_SHIFT;
+            continue;
+        }
+
+        int back = g(x, y) >> BACK_SHIFT;
+        if (back == 0) break;
+
+        g(x, y) &= PASSAGE_BITS;
+        x += DX[back - 1];
+        y += DY[back - 1];
+    }
+
+    return m;
+}
+
+Maze Maze::RecursiveDivision(int width, int height, uint64_t seed, ThreadPool* pool) {
+    Maze m = empty(width, height, seed);
+    Grid<uint8_t>& g = m.passages;
+
+    // Start with every passage open and wall things off
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            g(x, y) = (x < width - 1 ? EAST : 0) | (y < height - 1 ? SOUTH : 0);
+        }
+    }
+
+    // The top of the recursion is serial, it's only a handful of long walls
+    Rng rng(seed);
+    std::vector<Region> regions;
+    Region all = { 0, 0, width, height };
+    divide(g, all, rng, &regions, DIVISION_REGION);
+
+    // Regions only ever write to their own nodes
+    ThreadPool::ForEach(pool, regions.size(), [&g, &regions, seed](size_t i) {
+        Rng region_rng = Rng::Stream(seed, i);
+        divide(g, regions[i], region_rng, NULL, 0);
+    });
+
+    return m;
+}
+
+Maze Maze::Wilson(int width, int height, uint64_t seed, ThreadPool* pool) {
+    Maze m = empty(width, height, seed);
+    Grid<uint8_t>& g = m.passages;
+
+    int blocks_x = (width + WILSON_BLOCK - 1) / WILSON_BLOCK;
+    int blocks_y = (height + WILSON_BLOCK - 1) / WILSON_BLOCK;
+
+    ThreadPool::ForEach(pool, (size_t)blocks_x * blocks_y, [&g, blocks_x, width, height, seed](size_t i) {
+        Region r;
+        r.x = (i % blocks_x) * WILSON_BLOCK;
+        r.y = (i / blocks_x) * WILSON_BLOCK;
+        r.w = std::min(WILSON_BLOCK, width - r.x);
+        r.h = std::min(WILSON_BLOCK, height - r.y);
+        wilson(g, r, Rng::Stream(seed, i));
+    });
+
+    // A maze of blocks decides which neighbouring blocks get a door between them
+    Grid<uint8_t> joins(blocks_x, blocks_y, 0);
+    Region all_blocks = { 0, 0, blocks_x, blocks_y };
+    wilson(joins, all_blocks, Rng(seed));
+
+    Rng rng(Rng::Stream(seed, (uint64_t)-1));
+    for (int by = 0; by < blocks_y; by++) {
+        for (int bx = 0; bx < blocks_x; bx++) {
+            int x0 = bx * WILSON_BLOCK, y0 = by * WILSON_BLOCK;
+            int x1 = std::min(x0 + WILSON_BLOCK, width), y1 = std::min(y0 + WILSON_BLOCK, height);
+
+            if (joins(bx, by) & EAST) g(x1 - 1, y0 + rng.below(y1 - y0)) |= EAST;
+            if (joins(bx, by) & SOUTH) g(x0 + rng.below(x1 - x0), y1 - 1) |= SOUTH;
+        }
+    }
+
+    return m;
+}
+
+EllerRows::EllerRows(int width, int band_rows, uint64_t seed, int64_t band)
+    : width(width), band_rows(band_rows), seed(seed), band(band), in_band(0),
+      sets(width), parent(width), remaining(2 * width), relabel(2 * width), flags(2 * width) {
+    startBand();
+}
+
+void EllerRows::startBand() {
+    in_band = 0;
+    rng = Rng::Stream(seed, (uint64_t)band * 2);
+
+    // Everything with a door above is already connected through there,
+    // the rest start out on their own
+    Doors(width, seed, band, flags.data());
+    for (int x = 0; x < width; x++) {
+        sets[x] = flags[x] ? 0 : width + x;
+    }
+    compact();
+}
+
+// Renumbers the sets in order of first appearance, which keeps them below
+// width and so usable as indices into the scratch arrays
+void EllerRows::compact() {
+    const uint32_t NONE = 0xFFFFFFFF;
+    std::fill(relabel.begin(), relabel.end(), NONE);
+
+    uint32_t count = 0;
+    for (int x = 0; x < width; x++) {
+        uint32_t& r = relabel[sets[x]];
+        if (r == NONE) r = count++;
+        sets[x] = r;
+    }
+}
+
+uint32_t EllerRows::find(uint32_t s) {
+    while (parent[s] != s) {
+        parent[s] = parent[parent[s]];
+        s = parent[s];
+    }
+    return s;
+}
+
+void EllerRows::next(uint8_t* row) {
+    bool last = in_band == band_rows - 1;
+    std::fill(row, row + width, 0);
+
+    // Join neighbours that aren't connected yet, on the last row all of
+    // them. Sets are merged union-find style and resolved afterwards, a
+    // relabelling pass per join would be O(width^2) a row.
+    for (int x = 0; x < width; x++) {
+        parent[x] = x;
+    }
+
+    for (int x = 0; x + 1 < width; x++) {
+        uint32_t a = find(sets[x]), b = find(sets[x + 1]);
+        if (a == b) continue;
+        if (!last && rng.below(2)) continue;
+
+        row[x] |= Maze::EAST;
+        parent[b] = a;
+    }
+
+    for (int x = 0; x < width; x++) {
+        sets[x] = find(sets[x]);
+    }
+
+    if (last) {
+        Doors(width, seed, band + 1, flags.data());
+        for (int x = 0; x < width; x++) {
+            if (flags[x]) row[x] |= Maze::SOUTH;
+        }
+
+        band++;
+        startBand();
+        return;
+    }
+
+    // Every set goes down at least once, or it would be cut off for good.
+    // Otherwise it's a coin flip per node.
+    std::fill(remaining.begin(), remaining.begin() + width, 0);
+    std::fill(flags.begin(), flags.begin() + width, 0);
+    for (int x = 0; x < width; x++) {
+        remaining[sets[x]]++;
+    }
+
+    for (int x = 0; x < width; x++) {
+        uint32_t s = sets[x];
+        remaining[s]--;
+
+        bool down = rng.below(2) || (remaining[s] == 0 && !flags[s]);
+        if (down) {
+            row[x] |= Maze::SOUTH;
+            flags[s] = 1;
+        }
+        else {
+            sets[x] = width + x;
+        }
+    }
+
+    compact();
+    in_band++;
+}
+
+void EllerRows::Doors(int width, uint64_t seed, int64_t band, uint8_t* open) {
+    Rng rng = Rng::Stream(seed, (uint64_t)band * 2 + 1);
+
+    int count = 0;
+    for (int x = 0; x < width; x++) {
+        open[x] = rng.below(4) == 0;
+        count += open[x];
+    }
+    if (count == 0) open[rng.below(width)] = 1;
+}
+
+Grid<uint8_t> EllerRows::Band(int width, int band_rows, uint64_t seed, int64_t band) {
+    Grid<uint8_t> g(width, band_rows, 0);
+    EllerRows rows(width, band_rows, seed, band);
+    for (int y = 0; y < band_rows; y++) {
+        rows.next(&g(0, y));
+    }
+    return g;
+}
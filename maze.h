@@ -2,116 +2,158 @@
 #define MAZE_H
 
 #include <vector>
-#include <stack>
-#include <cstdlib>
-#include <algorithm>
+#include <stdint.h>
 
-using namespace std;
+#include <glm/glm.hpp>
 
+#include "rng.h"
+
+class ThreadPool;
+
+// Row major, x fastest
+template <typename T>
+class Grid {
+public:
+    int width = 0, height = 0;
+    std::vector<T> cells;
+
+    Grid() {}
+    Grid(int width, int height, T value = T()) : width(width), height(height), cells((size_t)width * height, value) {}
+
+    T& operator()(int x, int y) { return cells[(size_t)y * width + x]; }
+    const T& operator()(int x, int y) const { return cells[(size_t)y * width + x]; }
+};
+
+// One bit per cell
+class BitGrid {
+public:
+    int width = 0, height = 0;
+    std::vector<uint64_t> words;
+
+    BitGrid() {}
+    BitGrid(int width, int height) : width(width), height(height), words(((size_t)width * height + 63) / 64, 0) {}
+
+    bool test(size_t i) const { return (words[i >> 6] >> (i & 63)) & 1; }
+    void set(size_t i) { words[i >> 6] |= (uint64_t)1 << (i & 63); }
+
+    bool test(int x, int y) const { return test((size_t)y * width + x); }
+    void set(int x, int y) { set((size_t)y * width + x); }
+};
+
+// A perfect maze over a grid of nodes, every node reachable from every
+// other by exactly one path. Stored as one byte per node saying whether
+// the passage to its east and south neighbour is open, which is all the
+// generators touch. The tile layout the game uses, (2w+1) x (2h+1) with
+// walls between nodes, is derived from that on demand.
+//
+// Every generator is seeded and gives the same maze for the same seed no
+// matter how many threads it had.
 class Maze {
 public:
-    enum TileType {
+    enum TileType : uint8_t {
         FLOOR,
         WALL,
         STATUE
     };
 
-    vector<vector<TileType> > tiles;
-    glm::vec3 start_location;
-    glm::vec3 end_location;
+    enum Passage : uint8_t {
+        EAST = 1,
+        SOUTH = 2
+    };
 
-    static Maze Default(int width, int height) {
-        Maze m;
-        m.tiles = gen_maze(width, height);
-        return m;
-    }
+    Grid<uint8_t> passages;
+    uint64_t seed;
 
-    //private:
-    static vector<vector<TileType> > gen_maze(int w, int h) {
-        struct P {
-            int x, y;
-        };
+    glm::vec3 start_location;
+    glm::vec3 end_location;
 
-        // Goddamn MSVC doesn't understand runtime sized stack-allocated arrays
-        // bool marked[w][h] <-- apparently only available on GCC >:(
-        // This irritates me a lot because this makes the code considerably less performant though it doesn't matter much here
-        vector<vector<bool>> marked(w);
+    int width() const { return passages.width; }
+    int height() const { return passages.height; }
 
-        for (int i = 0; i < w; i++) {
-            marked[i].resize(h);
-            for (int j = 0; j < h; j++) {
-                marked[i][j] = false;
-            }
-        }
+    bool open(int x, int y, Passage p) const { return passages(x, y) & p; }
 
-        P mdim;
-        mdim.x = 2 * w + 1;
-        mdim.y = 2 * h + 1;
+    int tileWidth() const { return 2 * width() + 1; }
+    int tileHeight() const { return 2 * height() + 1; }
 
-        vector<vector<TileType>> maze(mdim.x);
+    // About one wall in ten is a statue instead, decided by hashing the
+    // position with the seed so it needs no storage
+    TileType tile(int x, int y) const;
 
-        for (int i = 0; i < mdim.x; i++) {
-            maze[i].resize(mdim.y);
-            for (int j = 0; j < mdim.y; j++) {
-                maze[i][j] = (rand() % 10) < 9 ? TileType::WALL : TileType::STATUE;
-            }
-        }
+    // WALL or STATUE, for a wall tile at (x, y) of a maze with this seed
+    static TileType Wall(uint64_t seed, int64_t x, int64_t y);
 
-        P start;
-        start.x = w / 2;
-        start.y = h / 2;
+    // Every tile at once, one byte each. Only sensible for small mazes.
+    Grid<TileType> tiles() const;
 
-        stack<P> s;
-        s.push(start);
+    // Exactly width * height - 1 open passages and everything connected
+    bool isPerfect() const;
 
-        marked[start.x][start.y] = true;
+    // The one the game uses
+    static Maze Default(int width, int height, uint64_t seed = 1) {
+        return Backtracker(width, height, seed);
+    }
 
-        while (!s.empty()) {
-            P curr = s.top();
-            s.pop();
+    // Depth first, long winding corridors. Inherently serial, but needs no
+    // stack since the way back is kept in the node bytes.
+    static Maze Backtracker(int width, int height, uint64_t seed);
 
-            maze[2 * curr.x + 1][2 * curr.y + 1] = TileType::FLOOR;
+    // Splits the grid with a wall that has one gap and recurses on both
+    // halves, long straight walls. Regions below a size are independent
+    // and go out to pool when there is one.
+    static Maze RecursiveDivision(int width, int height, uint64_t seed, ThreadPool* pool = NULL);
 
-            vector<P> nbors;
-            for (int i = -1; i <= 1; i++) {
-                for (int j = -1; j <= 1; j++) {
-                    if (j == 0 && i == 0) continue;
-                    if (j != 0 && i != 0) continue;
+    // Loop erased random walks, which on their own would give a uniformly
+    // random maze. Run per block here so blocks can go out to pool, then
+    // the blocks are joined along a random spanning tree of their own, so
+    // the result is uniform within blocks rather than across them.
+    static Maze Wilson(int width, int height, uint64_t seed, ThreadPool* pool = NULL);
+};
 
-                    P n;
-                    n.x = curr.x + i;
-                    n.y = curr.y + j;
+// Eller's algorithm, for a maze `width` nodes wide that goes on downwards
+// for as long as rows are asked for. Only the set each node of the current
+// row belongs to is kept, so memory is O(width) however far it runs.
+//
+// Rows come in bands of band_rows. The last row of a band joins all of its
+// sets, like the last row of a finite Eller maze does, and the doors down
+// into the next band are picked from the seed and band number alone. So
+// every band starts out from the same kind of state: it can be made on its
+// own, on any thread and in any order, and comes out the same as when the
+// rows above were made first.
+class EllerRows {
+public:
+    EllerRows(int width, int band_rows, uint64_t seed, int64_t band = 0);
 
-                    if (n.x < 0 || n.x >= w) continue;
-                    if (n.y < 0 || n.y >= h) continue;
-                    if (marked[n.x][n.y]) continue;
+    // Fills in the passages of the next row, width bytes. The last row of a
+    // band gets SOUTH on its doors into the next one.
+    void next(uint8_t* row);
 
-                    marked[n.x][n.y] = true;
+    // The row next() fills in, counted from the top of band 0
+    int64_t row() const { return band * band_rows + in_band; }
 
-                    maze[2 * curr.x + 1 + i][2 * curr.y + 1 + j] = TileType::FLOOR;
-                    nbors.push_back(n);
-                }
-            }
+    // Which nodes of the last row of band - 1 have a passage down into
+    // band, width bytes of 0 or 1 and never all 0
+    static void Doors(int width, uint64_t seed, int64_t band, uint8_t* open);
 
-            random_shuffle(nbors.begin(), nbors.end());
+    // Just the one band, width x band_rows nodes
+    static Grid<uint8_t> Band(int width, int band_rows, uint64_t seed, int64_t band);
 
-            for (P n : nbors) {
-                s.push(n);
-            }
-        }
+private:
+    int width, band_rows;
+    uint64_t seed;
+    int64_t band;
+    int in_band;
+    Rng rng;
 
-        vector<vector<TileType>> out;
+    // Per node of the current row, numbered from 0 and below width between rows
+    std::vector<uint32_t> sets;
 
-        for (int i = 0; i < mdim.x; i++) {
-            vector<TileType> temp;
-            for (int j = 0; j < mdim.y; j++) {
-                temp.push_back(maze[i][j]);
-            }
-            out.push_back(temp);
-        }
+    // Scratch, per set or per node
+    std::vector<uint32_t> parent, remaining, relabel;
+    std::vector<uint8_t> flags;
 
-        return out;
-    }
+    void startBand();
+    void compact();
+    uint32_t find(uint32_t s);
 };
 
 #endif
@@ -0,0 +1,152 @@
+#include "mazemesh.h"
+
+#include <algorithm>
+
+namespace {
+
+struct Quads {
+    std::vector<Vertex>& vertices;
+    std::vector<unsigned int>& indices;
+
+    // From corner along du and dv, with uv going from uv to uv + size.
+    // Winding follows the normal so culling still works.
+    void add(glm::vec3 corner, glm::vec3 du, glm::vec3 dv, glm::vec2 uv, glm::vec2 size, glm::vec3 normal) {
+        unsigned int first = vertices.size();
+
+        Vertex v;
+        v.Normal = normal;
+        v.Tangent = glm::normalize(du);
+        v.Bitangent = glm::normalize(dv);
+
+        v.Position = corner;
+        v.TexCoords = uv;
+        vertices.push_back(v);
+
+        v.Position = corner + du;
+        v.TexCoords = uv + glm::vec2(size.x, 0.0f);
+        vertices.push_back(v);
+
+        v.Position = corner + du + dv;
+        v.TexCoords = uv + size;
+        vertices.push_back(v);
+
+        v.Position = corner + dv;
+        v.TexCoords = uv + glm::vec2(0.0f, size.y);
+        vertices.push_back(v);
+
+        bool ccw = glm::dot(glm::cross(du, dv), normal) > 0.0f;
+        unsigned int order[6] = { 0, 1, 2, 0, 2, 3 };
+        if (!ccw) {
+            std::swap(order[1], order[2]);
+            std::swap(order[4], order[5]);
+        }
+        for (int i = 0; i < 6; i++) {
+            indices.push_back(first + order[i]);
+        }
+    }
+};
+
+bool solid(const Grid<Maze::TileType>& tiles, int x, int y) {
+    if (x < 0 || y < 0 || x >= tiles.width || y >= tiles.height) return false;
+    return tiles(x, y) == Maze::WALL;
+}
+
+// Side faces facing (dx, dy), one quad per run of them along the other axis
+void sides(const Grid<Maze::TileType>& tiles, int dx, int dy, Quads& out) {
+    bool along_y = dx != 0;
+    int lines = along_y ? tiles.width : tiles.height;
+    int length = along_y ? tiles.height : tiles.width;
+    glm::vec3 normal((float)dx, 0.0f, (float)dy);
+    glm::vec3 up(0.0f, 1.0f, 0.0f);
+
+    for (int line = 0; line < lines; line++) {
+        int run_start = -1;
+
+        for (int i = 0; i <= length; i++) {
+            int x = along_y ? line : i;
+            int y = along_y ? i : line;
+            bool face = i < length && solid(tiles, x, y) && !solid(tiles, x + dx, y + dy);
+
+            if (face && run_start < 0) run_start = i;
+            if (face || run_start < 0) continue;
+
+            // A run just ended at i
+            float start = run_start - 0.5f;
+            float run = (float)(i - run_start);
+            glm::vec3 corner, du;
+            if (along_y) {
+                corner = glm::vec3(line + 0.5f * dx, 0.0f, start);
+                du = glm::vec3(0.0f, 0.0f, run);
+            }
+            else {
+                corner = glm::vec3(start, 0.0f, line + 0.5f * dy);
+                du = glm::vec3(run, 0.0f, 0.0f);
+            }
+
+            out.add(corner, du, up, glm::vec2(start + 0.5f, 0.0f), glm::vec2(run, 1.0f), normal);
+            run_start = -1;
+        }
+    }
+}
+
+// Wall tops, as rectangles grown along x and then down y as far as they go
+void tops(const Grid<Maze::TileType>& tiles, Quads& out) {
+    std::vector<unsigned char> done(tiles.cells.size(), 0);
+    glm::vec3 normal(0.0f, 1.0f, 0.0f);
+
+    for (int y = 0; y < tiles.height; y++) {
+        for (int x = 0; x < tiles.width; x++) {
+            if (!solid(tiles, x, y) || done[(size_t)y * tiles.width + x]) continue;
+
+            int w = 1;
+            while (x + w < tiles.width && solid(tiles, x + w, y) && !done[(size_t)y * tiles.width + x + w]) w++;
+
+            int h = 1;
+            for (; y + h < tiles.height; h++) {
+                bool full = true;
+                for (int i = x; i < x + w && full; i++) {
+                    full = solid(tiles, i, y + h) && !done[(size_t)(y + h) * tiles.width + i];
+                }
+                if (!full) break;
+            }
+
+            for (int j = y; j < y + h; j++) {
+                for (int i = x; i < x + w; i++) {
+                    done[(size_t)j * tiles.width + i] = 1;
+                }
+            }
+
+            out.add(
+                glm::vec3(x - 0.5f, 1.0f, y - 0.5f),
+                glm::vec3((float)w, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, (float)h),
+                glm::vec2((float)x, (float)y), glm::vec2((float)w, (float)h),
+                normal
+            );
+        }
+    }
+}
+
+}
+
+MazeGeometry MeshMaze(const Grid<Maze::TileType>& tiles) {
+    MazeGeometry g;
+
+    Quads walls = { g.wall_vertices, g.wall_indices };
+    sides(tiles, 1, 0, walls);
+    sides(tiles, -1, 0, walls);
+    sides(tiles, 0, 1, walls);
+    sides(tiles, 0, -1, walls);
+    tops(tiles, walls);
+
+    if (tiles.width > 0 && tiles.height > 0) {
+        Quads floor = { g.floor_vertices, g.floor_indices };
+        floor.add(
+            glm::vec3(-0.5f, 0.0f, -0.5f),
+            glm::vec3((float)tiles.width, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, (float)tiles.height),
+            glm::vec2(0.0f), glm::vec2((float)tiles.width, (float)tiles.height),
+            glm::vec3(0.0f, 1.0f, 0.0f)
+        );
+    }
+
+    return g;
+}
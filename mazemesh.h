@@ -0,0 +1,39 @@
+#ifndef MAZEMESH_H
+#define MAZEMESH_H
+
+#include <vector>
+
+#include "maze.h"
+#include "vertexformat.h"
+
+// Maze tiles as quads, in tile units with tile (x, y) centred on (x, 0, y).
+// Walls are unit cubes standing on the floor, which is the y = 0 plane.
+struct MazeGeometry {
+    std::vector<Vertex> wall_vertices;
+    std::vector<unsigned int> wall_indices;
+
+    std::vector<Vertex> floor_vertices;
+    std::vector<unsigned int> floor_indices;
+
+    size_t triangles() const {
+        return (wall_indices.size() + floor_indices.size()) / 3;
+    }
+};
+
+// Greedy meshing. Wall faces against another wall are dropped, along with
+// the bottoms, which sit on the floor. What's left is merged: coplanar
+// runs of side faces into one long quad each, the tops into rectangles.
+// UVs are in tiles so the textures repeat once per tile like they did on
+// the cubes. The floor is a single quad under everything, walls included,
+// since it can't be seen through them anyway. Statue tiles are floor.
+//
+// Faces on the edge of the grid are always kept, whatever is next to it.
+// Nothing in here touches GL.
+MazeGeometry MeshMaze(const Grid<Maze::TileType>& tiles);
+
+// What drawing the same tiles as one cube each comes to, for comparison
+inline size_t MazeCubeTriangles(const Grid<Maze::TileType>& tiles) {
+    return tiles.cells.size() * 12;
+}
+
+#endif
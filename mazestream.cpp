@@ -0,0 +1,228 @@
+#include "mazestream.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+
+#include <glm/gtc/quaternion.hpp>
+
+#include "meshopt.h"
+
+namespace {
+
+// Global tile row of a chunk's first row. Row 0 would be the wall along
+// the top of a finite maze, which an endless one doesn't have.
+int64_t firstRow(int64_t chunk) {
+    return chunk * 2 * MAZE_CHUNK_ROWS + 1;
+}
+
+// Same layout as Maze::tile, a row of nodes and the walls between them,
+// then the row of walls below with the passages south
+Grid<Maze::TileType> chunkTiles(int width, uint64_t seed, int64_t chunk) {
+    Grid<uint8_t> passages = EllerRows::Band(width, MAZE_CHUNK_ROWS, seed, chunk);
+    Grid<Maze::TileType> tiles(2 * width + 1, 2 * MAZE_CHUNK_ROWS, Maze::WALL);
+
+    int64_t first = firstRow(chunk);
+
+    for (int y = 0; y < tiles.height; y++) {
+        int node_y = y / 2;
+        bool node_row = (y & 1) == 0;
+
+        for (int x = 0; x < tiles.width; x++) {
+            bool odd_x = x & 1;
+            bool open = false;
+
+            if (node_row) {
+                if (odd_x) open = true;
+                else if (x > 0 && x < tiles.width - 1) open = passages(x / 2 - 1, node_y) & Maze::EAST;
+            }
+            else if (odd_x) {
+                open = passages(x / 2, node_y) & Maze::SOUTH;
+            }
+
+            tiles(x, y) = open ? Maze::FLOOR : Maze::Wall(seed, x, first + y);
+        }
+    }
+
+    return tiles;
+}
+
+// For the bits of decoration that used to come from rand()
+uint64_t tileHash(uint64_t seed, int64_t x, int64_t y) {
+    return Rng::Mix(~seed ^ Rng::Mix(((uint64_t)(uint32_t)x << 32) | (uint32_t)y));
+}
+
+Mesh styled(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const Mesh& like) {
+    Mesh m = Mesh::FromOptimized(vertices, indices, std::vector<Texture>());
+    m.diffuseTexture = like.diffuseTexture;
+    m.specularTexture = like.specularTexture;
+    m.normalTexture = like.normalTexture;
+    m.material = like.material;
+    return m;
+}
+
+int64_t floorDiv(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+}
+
+MazeStream::MazeStream(int width, uint64_t seed, Models models, float scale, int view_chunks, int keep_chunks)
+    : width(width), seed(seed), models(models), scale(scale),
+      view_chunks(view_chunks), keep_chunks(std::max(keep_chunks, view_chunks)), pool(1) {}
+
+int64_t MazeStream::chunkAt(const glm::vec3& position) const {
+    int64_t row = (int64_t)std::floor((position.z - origin.z) / scale + 0.5f);
+    return floorDiv(row - 1, 2 * MAZE_CHUNK_ROWS);
+}
+
+bool MazeStream::known(int64_t index) const {
+    for (const Chunk& c : resident) {
+        if (c.index == index) return true;
+    }
+    for (const Pending& p : pending) {
+        if (p.index == index) return true;
+    }
+    return false;
+}
+
+void MazeStream::update(const glm::vec3& player_position, EntityStore& entities) {
+    int64_t center = chunkAt(player_position);
+
+    // Nearest first, so what the player is standing in comes back first
+    for (int d = 0; d <= view_chunks; d++) {
+        for (int side = 0; side < (d == 0 ? 1 : 2); side++) {
+            int64_t index = side ? center - d : center + d;
+            if (known(index)) continue;
+
+            int w = width;
+            uint64_t s = seed;
+            Pending p;
+            p.index = index;
+            p.data = pool.submit([w, s, index]() {
+                ChunkData data;
+                data.tiles = chunkTiles(w, s, index);
+                data.geometry = MeshMaze(data.tiles);
+                OptimizeMaze(data.geometry);
+                return data;
+            });
+            pending.push_back(std::move(p));
+        }
+    }
+
+    // Uploading and spawning is the expensive part on this thread, one chunk
+    // a frame keeps it from piling up when several finish at once
+    bool spawned = false;
+    for (size_t i = 0; i < pending.size();) {
+        Pending& p = pending[i];
+        bool wanted = std::abs(p.index - center) <= keep_chunks;
+
+        if (p.data.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            i++;
+            continue;
+        }
+        if (wanted && spawned) {
+            i++;
+            continue;
+        }
+
+        if (wanted) {
+            spawn(p.index, p.data.get(), entities);
+            spawned = true;
+        }
+        pending.erase(pending.begin() + i);
+    }
+
+    // Whatever the player left behind
+    for (size_t i = 0; i < resident.size();) {
+        if (std::abs(resident[i].index - center) <= keep_chunks) {
+            i++;
+            continue;
+        }
+
+        evict(resident[i], entities);
+        resident[i] = std::move(resident.back());
+        resident.pop_back();
+    }
+}
+
+void MazeStream::spawn(int64_t index, const ChunkData& data, EntityStore& entities) {
+    const Grid<Maze::TileType>& tiles = data.tiles;
+
+    Chunk chunk;
+    chunk.index = index;
+    chunk.model.reset(new Model(MazeModel(data.geometry, *models.wall, *models.floor)));
+
+    int64_t first = firstRow(index);
+    glm::vec3 corner = origin + glm::vec3(0.0f, 0.0f, (float)first) * scale;
+    EntityId level = entities.create(chunk.model.get(), corner, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(scale));
+    entities.setPickable(level, false);
+    chunk.entities.push_back(level);
+
+    for (int y = 0; y < tiles.height; y++) {
+        for (int x = 0; x < tiles.width; x++) {
+            if (tiles(x, y) != Maze::STATUE) continue;
+
+            uint64_t h = tileHash(seed, x, first + y);
+            chunk.entities.push_back(entities.create(
+                models.statue,
+                corner + glm::vec3((float)x, 0.0f, (float)y) * scale,
+                EulerRotation(glm::vec3(0.0f, glm::radians((float)(h % 360)), 0.0f)),
+                glm::vec3(scale)
+            ));
+        }
+    }
+
+    resident.push_back(std::move(chunk));
+}
+
+void MazeStream::evict(Chunk& chunk, EntityStore& entities) {
+    for (EntityId id : chunk.entities) {
+        entities.destroy(id);
+    }
+    chunk.entities.clear();
+
+    // The scene's batches still point at the model, but they get rebuilt
+    // before the next draw since the entity layout changed
+    ReleaseModel(*chunk.model);
+    chunk.model.reset();
+}
+
+void MazeStream::clear(EntityStore& entities) {
+    for (Chunk& c : resident) {
+        evict(c, entities);
+    }
+    resident.clear();
+}
+
+MazeStream::Stats MazeStream::stats() const {
+    Stats s;
+    s.resident = resident.size();
+    s.pending = pending.size();
+    s.entities = 0;
+    for (const Chunk& c : resident) {
+        s.entities += c.entities.size();
+    }
+    return s;
+}
+
+void OptimizeMaze(MazeGeometry& geometry) {
+    OptimizeMesh(geometry.wall_vertices, geometry.wall_indices);
+    OptimizeMesh(geometry.floor_vertices, geometry.floor_indices);
+}
+
+Model MazeModel(const MazeGeometry& geometry, const Model& wall, const Model& floor) {
+    std::vector<Mesh> meshes;
+    meshes.push_back(styled(geometry.wall_vertices, geometry.wall_indices, wall.meshes[0]));
+    meshes.push_back(styled(geometry.floor_vertices, geometry.floor_indices, floor.meshes[0]));
+    return Model::FromMeshes(meshes);
+}
+
+void ReleaseModel(Model& model) {
+    for (const Mesh& mesh : model.meshes) {
+        GeometryBuffer::release(mesh.range());
+    }
+    model.meshes.clear();
+}
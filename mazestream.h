@@ -0,0 +1,109 @@
+#ifndef MAZESTREAM_H
+#define MAZESTREAM_H
+
+#include <vector>
+#include <future>
+#include <memory>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+#include "entitystore.h"
+#include "maze.h"
+#include "mazemesh.h"
+#include "threadpool.h"
+
+// Node rows per chunk, so twice that many tile rows
+#define MAZE_CHUNK_ROWS 8
+
+// A maze that never ends, `width` nodes across and going on forever along
+// +z and -z. Chunks are bands of EllerRows, so any chunk can be made on its
+// own from the seed and comes out the same every time it is made.
+//
+// Chunks within view_chunks of the player are made, meshed and optimized
+// on a worker thread, then uploaded and spawned as one entity each (plus statues) on
+// the main thread, at most one chunk a frame. Those further away than
+// keep_chunks are destroyed again and their geometry released, which puts
+// a bound on entity count and memory however far the player walks. Main
+// thread only, apart from the worker.
+class MazeStream {
+public:
+    // Chunk meshes take their textures and material from the first mesh
+    // of wall and floor
+    struct Models {
+        Model* wall;
+        Model* floor;
+        Model* statue;
+    };
+
+    struct Stats {
+        unsigned int resident; // Chunks with entities
+        unsigned int pending;  // Chunks still being made, or waiting their turn to spawn
+        size_t entities;
+    };
+
+    MazeStream(int width, uint64_t seed, Models models, float scale = 1.0f, int view_chunks = 2, int keep_chunks = 3);
+
+    // Once a frame, before the scene is drawn
+    void update(const glm::vec3& player_position, EntityStore& entities);
+
+    // Destroys every chunk's entities
+    void clear(EntityStore& entities);
+
+    Stats stats() const;
+
+    // Where tile (0, 0) is in the world
+    glm::vec3 origin = glm::vec3(0.0f);
+
+private:
+    // What the worker hands back
+    struct ChunkData {
+        Grid<Maze::TileType> tiles;
+        MazeGeometry geometry;
+    };
+
+    struct Chunk {
+        int64_t index;
+        std::unique_ptr<Model> model;
+        std::vector<EntityId> entities;
+    };
+
+    struct Pending {
+        int64_t index;
+        std::future<ChunkData> data;
+    };
+
+    int width;
+    uint64_t seed;
+    Models models;
+    float scale;
+    int view_chunks, keep_chunks;
+
+    std::vector<Chunk> resident;
+    std::vector<Pending> pending;
+
+    // Declared last so the worker goes away before what it uses
+    ThreadPool pool;
+
+    int64_t chunkAt(const glm::vec3& position) const;
+    bool known(int64_t index) const;
+    void spawn(int64_t index, const ChunkData& data, EntityStore& entities);
+    void evict(Chunk& chunk, EntityStore& entities);
+
+    MazeStream(const MazeStream&);
+    MazeStream& operator=(const MazeStream&);
+};
+
+// Runs OptimizeMesh over the walls and the floor, ready for MazeModel.
+// Nothing in here touches GL, so it can go along with MeshMaze on a worker.
+void OptimizeMaze(MazeGeometry& geometry);
+
+// Uploads optimized geometry as a wall mesh and a floor mesh that look
+// like the first mesh of wall and floor, without optimizing it again.
+// Main thread only.
+Model MazeModel(const MazeGeometry& geometry, const Model& wall, const Model& floor);
+
+// Hands a model's geometry back to the GeometryBuffer, once nothing draws it anymore
+void ReleaseModel(Model& model);
+
+#endif
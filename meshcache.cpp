@@ -0,0 +1,233 @@
+#include "meshcache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+namespace {
+
+const char MAGIC[4] = { 'G', 'L', 'M', 'C' };
+
+// Blobs start on this boundary so the mapped pages can be handed to GL as is
+const uint64_t BLOB_ALIGNMENT = 16;
+
+// Everything on disk is little endian and fixed size, like the machines we run on
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertex_size;        // sizeof(Vertex) when written
+    uint32_t packed_vertex_size; // sizeof(PackedVertex) when written
+
+    // Of the source, the cache is stale as soon as either differs
+    int64_t source_mtime;
+    uint64_t source_size;
+
+    float transform[16];
+    float bounds_min[3];
+    float bounds_max[3];
+
+    uint32_t mesh_count;
+    uint32_t padding;
+};
+
+struct StringRef {
+    uint64_t offset;
+    uint64_t length;
+};
+
+struct MeshRecord {
+    uint32_t format;
+    uint32_t index_size;
+    uint64_t vertex_count;
+    uint64_t index_count;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+
+    float dequantize_offset[3];
+    float dequantize_scale[3];
+
+    float diffuse[4];
+    float specular[4];
+    float shininess;
+    uint32_t padding;
+
+    StringRef textures[3]; // diffuse, specular, normal
+};
+
+bool sourceStamp(const std::string& source, int64_t& mtime, uint64_t& size) {
+    struct stat st;
+    if (stat(source.c_str(), &st) != 0) return false;
+    mtime = st.st_mtime;
+    size = st.st_size;
+    return true;
+}
+
+uint64_t align(uint64_t offset) {
+    return (offset + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1);
+}
+
+bool inBounds(uint64_t offset, uint64_t length, size_t file_size) {
+    return offset <= file_size && length <= file_size - offset;
+}
+
+}
+
+std::string MeshCache::PathFor(const std::string& source) {
+    return source + ".meshcache";
+}
+
+bool MeshCache::Read(const std::string& source, MappedFile& file, CachedModel& out) {
+    int64_t mtime;
+    uint64_t size;
+    if (!sourceStamp(source, mtime, size)) return false;
+
+    if (!file.open(PathFor(source))) return false;
+
+    const unsigned char* data = file.data();
+    size_t file_size = file.size();
+
+    FileHeader header;
+    if (file_size < sizeof(header)) return false;
+    std::memcpy(&header, data, sizeof(header));
+
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0
+        || header.version != MESH_CACHE_VERSION
+        || header.vertex_size != sizeof(Vertex)
+        || header.packed_vertex_size != sizeof(PackedVertex)
+        || header.source_mtime != mtime
+        || header.source_size != size) {
+        return false;
+    }
+
+    uint64_t records_size = (uint64_t)header.mesh_count * sizeof(MeshRecord);
+    if (!inBounds(sizeof(header), records_size, file_size)) return false;
+
+    std::memcpy(&out.transform[0][0], header.transform, sizeof(header.transform));
+    out.bounds_min = glm::vec3(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]);
+    out.bounds_max = glm::vec3(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]);
+    out.meshes.resize(header.mesh_count);
+
+    for (uint32_t i = 0; i < header.mesh_count; i++) {
+        MeshRecord r;
+        std::memcpy(&r, data + sizeof(header) + i * sizeof(MeshRecord), sizeof(r));
+
+        if (r.format >= VERTEX_FORMAT_COUNT || (r.index_size != 2 && r.index_size != 4)) return false;
+
+        CachedMesh& m = out.meshes[i];
+        m.format = (VertexFormat)r.format;
+        m.vertex_count = r.vertex_count;
+        m.index_count = r.index_count;
+        m.index_size = r.index_size;
+
+        uint64_t vertex_bytes = r.vertex_count * VertexFormatStride(m.format);
+        uint64_t index_bytes = r.index_count * r.index_size;
+        if (!inBounds(r.vertex_offset, vertex_bytes, file_size) || !inBounds(r.index_offset, index_bytes, file_size)) return false;
+
+        m.vertex_data = data + r.vertex_offset;
+        m.index_data = data + r.index_offset;
+
+        m.dequantize.offset = glm::vec3(r.dequantize_offset[0], r.dequantize_offset[1], r.dequantize_offset[2]);
+        m.dequantize.scale = glm::vec3(r.dequantize_scale[0], r.dequantize_scale[1], r.dequantize_scale[2]);
+
+        m.material.diffuse = glm::vec4(r.diffuse[0], r.diffuse[1], r.diffuse[2], r.diffuse[3]);
+        m.material.specular = glm::vec4(r.specular[0], r.specular[1], r.specular[2], r.specular[3]);
+        m.material.shininess = r.shininess;
+
+        std::string* names[3] = { &m.diffuse_texture, &m.specular_texture, &m.normal_texture };
+        for (int t = 0; t < 3; t++) {
+            if (!inBounds(r.textures[t].offset, r.textures[t].length, file_size)) return false;
+            names[t]->assign((const char*)data + r.textures[t].offset, r.textures[t].length);
+        }
+    }
+
+    return true;
+}
+
+bool MeshCache::Write(const std::string& source, const CachedModel& model) {
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+
+    if (!sourceStamp(source, header.source_mtime, header.source_size)) return false;
+
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = MESH_CACHE_VERSION;
+    header.vertex_size = sizeof(Vertex);
+    header.packed_vertex_size = sizeof(PackedVertex);
+    std::memcpy(header.transform, &model.transform[0][0], sizeof(header.transform));
+    for (int k = 0; k < 3; k++) {
+        header.bounds_min[k] = model.bounds_min[k];
+        header.bounds_max[k] = model.bounds_max[k];
+    }
+    header.mesh_count = model.meshes.size();
+
+    // Lay out the records first so every blob knows its offset, then write it all in one go
+    std::vector<MeshRecord> records(model.meshes.size());
+    std::vector<unsigned char> blobs;
+    uint64_t base = sizeof(header) + records.size() * sizeof(MeshRecord);
+
+    for (size_t i = 0; i < model.meshes.size(); i++) {
+        const CachedMesh& m = model.meshes[i];
+        MeshRecord& r = records[i];
+        std::memset(&r, 0, sizeof(r));
+
+        r.format = m.format;
+        r.index_size = m.index_size;
+        r.vertex_count = m.vertex_count;
+        r.index_count = m.index_count;
+
+        for (int k = 0; k < 3; k++) {
+            r.dequantize_offset[k] = m.dequantize.offset[k];
+            r.dequantize_scale[k] = m.dequantize.scale[k];
+        }
+        for (int k = 0; k < 4; k++) {
+            r.diffuse[k] = m.material.diffuse[k];
+            r.specular[k] = m.material.specular[k];
+        }
+        r.shininess = m.material.shininess;
+
+        size_t vertex_bytes = m.vertex_count * VertexFormatStride(m.format);
+        size_t index_bytes = m.index_count * m.index_size;
+
+        blobs.resize(align(base + blobs.size()) - base);
+        r.vertex_offset = base + blobs.size();
+        blobs.insert(blobs.end(), (const unsigned char*)m.vertex_data, (const unsigned char*)m.vertex_data + vertex_bytes);
+
+        blobs.resize(align(base + blobs.size()) - base);
+        r.index_offset = base + blobs.size();
+        blobs.insert(blobs.end(), (const unsigned char*)m.index_data, (const unsigned char*)m.index_data + index_bytes);
+
+        const std::string* names[3] = { &m.diffuse_texture, &m.specular_texture, &m.normal_texture };
+        for (int t = 0; t < 3; t++) {
+            r.textures[t].offset = base + blobs.size();
+            r.textures[t].length = names[t]->size();
+            blobs.insert(blobs.end(), names[t]->begin(), names[t]->end());
+        }
+    }
+
+    // Written under another name first so a crash can't leave a torn cache behind
+    std::string path = PathFor(source);
+    std::string temp = path + ".tmp";
+
+    FILE* f = fopen(temp.c_str(), "wb");
+    if (!f) return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    if (ok && !records.empty()) ok = fwrite(&records[0], sizeof(MeshRecord), records.size(), f) == records.size();
+    if (ok && !blobs.empty()) ok = fwrite(&blobs[0], 1, blobs.size(), f) == blobs.size();
+    ok = fclose(f) == 0 && ok;
+
+    if (!ok) {
+        remove(temp.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    remove(path.c_str());
+#endif
+    if (rename(temp.c_str(), path.c_str()) != 0) {
+        remove(temp.c_str());
+        return false;
+    }
+
+    return true;
+}
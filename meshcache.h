@@ -0,0 +1,60 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+#include "vertexformat.h"
+#include "mappedfile.h"
+#include "shader.h"
+
+// Bump whenever the layout below, Vertex, PackedVertex or OptimizeMesh changes
+#define MESH_CACHE_VERSION 1
+
+// One mesh as stored, with its GPU blobs pointing into the mapped file
+struct CachedMesh {
+    VertexFormat format;
+    PositionDequantize dequantize;
+
+    const void* vertex_data;
+    size_t vertex_count;
+
+    const void* index_data;
+    size_t index_count;
+    size_t index_size;
+
+    Material material;
+
+    // Relative to the model's directory like assimp reports them, empty when unset
+    std::string diffuse_texture;
+    std::string specular_texture;
+    std::string normal_texture;
+};
+
+struct CachedModel {
+    glm::mat4 transform;
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+    std::vector<CachedMesh> meshes;
+};
+
+// A model's meshes after import, optimization and packing, stored next to
+// the source as <source>.meshcache so that later runs can skip assimp.
+// Only the source file itself is checked for changes, not its .mtl or textures.
+class MeshCache {
+public:
+    static std::string PathFor(const std::string& source);
+
+    // Maps the cache for source into file and points `out` at it. False if
+    // there is no cache, it is stale or it was written by another version.
+    // The blobs in `out` are only valid while file stays open.
+    static bool Read(const std::string& source, MappedFile& file, CachedModel& out);
+
+    // The blobs in model only need to live for the duration of the call
+    static bool Write(const std::string& source, const CachedModel& model);
+};
+
+#endif
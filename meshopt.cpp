@@ -0,0 +1,304 @@
+#include "meshopt.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertex_count, unsigned int cache_size) {
+    VertexCacheStats stats;
+    stats.acmr = 0.0f;
+    stats.atvr = 0.0f;
+    if (indices.size() < 3) return stats;
+
+    // A vertex is in the FIFO if it went in fewer than cache_size misses ago
+    std::vector<size_t> inserted(vertex_count, 0);
+    std::vector<bool> referenced(vertex_count, false);
+    size_t misses = 0, unique = 0;
+
+    for (unsigned int v : indices) {
+        if (!referenced[v]) {
+            referenced[v] = true;
+            unique++;
+        }
+
+        if (inserted[v] == 0 || misses - inserted[v] >= cache_size) {
+            misses++;
+            inserted[v] = misses;
+        }
+    }
+
+    stats.acmr = (float)misses / (indices.size() / 3);
+    stats.atvr = (float)misses / unique;
+    return stats;
+}
+
+namespace {
+
+struct VertexHash {
+    size_t operator()(const Vertex& v) const {
+        const unsigned char* bytes = (const unsigned char*)&v;
+        size_t h = 2166136261u; // FNV-1a
+        for (size_t i = 0; i < sizeof(Vertex); i++) {
+            h = (h ^ bytes[i]) * 16777619u;
+        }
+        return h;
+    }
+};
+
+struct VertexEqual {
+    bool operator()(const Vertex& a, const Vertex& b) const {
+        return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+    }
+};
+
+}
+
+void WeldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    if (indices.empty()) {
+        indices.resize(vertices.size());
+        for (size_t i = 0; i < indices.size(); i++) indices[i] = i;
+    }
+
+    std::unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> seen;
+    seen.reserve(vertices.size());
+
+    std::vector<unsigned int> remap(vertices.size());
+    std::vector<Vertex> welded;
+    welded.reserve(vertices.size());
+
+    for (size_t i = 0; i < vertices.size(); i++) {
+        auto it = seen.find(vertices[i]);
+        if (it == seen.end()) {
+            it = seen.emplace(vertices[i], welded.size()).first;
+            welded.push_back(vertices[i]);
+        }
+        remap[i] = it->second;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        unsigned int a = remap[indices[i]];
+        unsigned int b = remap[indices[i + 1]];
+        unsigned int c = remap[indices[i + 2]];
+        if (a == b || b == c || c == a) continue;
+
+        indices[kept++] = a;
+        indices[kept++] = b;
+        indices[kept++] = c;
+    }
+    indices.resize(kept);
+
+    vertices.swap(welded);
+}
+
+void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertex_count, unsigned int cache_size, std::vector<size_t>& cluster_starts) {
+    size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) return;
+
+    // Triangles using each vertex, packed back to back
+    std::vector<unsigned int> live(vertex_count, 0);
+    for (unsigned int v : indices) live[v]++;
+
+    std::vector<unsigned int> offsets(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; v++) offsets[v + 1] = offsets[v] + live[v];
+
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangle_count; t++) {
+        for (int k = 0; k < 3; k++) {
+            adjacency[fill[indices[t * 3 + k]]++] = t;
+        }
+    }
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+
+    std::vector<size_t> cache_time(vertex_count, 0);
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<unsigned int> dead_end;
+    std::vector<unsigned int> candidates;
+
+    size_t timestamp = cache_size + 1;
+    size_t cursor = 0;
+    long fanning = indices[0];
+    bool from_dead_end = true;
+
+    while (fanning >= 0) {
+        if (from_dead_end) {
+            cluster_starts.push_back(output.size() / 3);
+        }
+
+        candidates.clear();
+
+        for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; a++) {
+            unsigned int t = adjacency[a];
+            if (emitted[t]) continue;
+
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[t * 3 + k];
+                output.push_back(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+
+                if (timestamp - cache_time[v] > cache_size) {
+                    cache_time[v] = timestamp++;
+                }
+            }
+
+            emitted[t] = true;
+        }
+
+        // Prefer the candidate that stays in the cache longest without being
+        // pushed out by the triangles it would itself emit
+        long best = -1;
+        long best_priority = -1;
+        for (unsigned int v : candidates) {
+            if (live[v] == 0) continue;
+
+            long priority = 0;
+            if (timestamp - cache_time[v] + 2 * live[v] <= cache_size) {
+                priority = timestamp - cache_time[v];
+            }
+
+            if (priority > best_priority) {
+                best_priority = priority;
+                best = v;
+            }
+        }
+
+        from_dead_end = best < 0;
+        if (best >= 0) {
+            fanning = best;
+            continue;
+        }
+
+        // Dead end, back up through recently used vertices, then scan in input order
+        fanning = -1;
+        while (!dead_end.empty()) {
+            unsigned int v = dead_end.back();
+            dead_end.pop_back();
+            if (live[v] > 0) {
+                fanning = v;
+                break;
+            }
+        }
+
+        while (fanning < 0 && cursor < vertex_count) {
+            if (live[cursor] > 0) fanning = cursor;
+            cursor++;
+        }
+    }
+
+    indices.swap(output);
+}
+
+void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, const std::vector<size_t>& cluster_starts) {
+    size_t triangle_count = indices.size() / 3;
+    if (cluster_starts.size() < 2) return;
+
+    struct Cluster {
+        size_t begin, end;
+        float sort;
+    };
+
+    std::vector<Cluster> clusters(cluster_starts.size());
+    std::vector<glm::vec3> centers(clusters.size());
+    std::vector<glm::vec3> normals(clusters.size());
+
+    // Area weighted, so a few slivers can't drag a cluster around
+    glm::vec3 mesh_center = glm::vec3(0.0f);
+    float mesh_area = 0.0f;
+
+    for (size_t c = 0; c < clusters.size(); c++) {
+        clusters[c].begin = cluster_starts[c];
+        clusters[c].end = c + 1 < clusters.size() ? cluster_starts[c + 1] : triangle_count;
+
+        glm::vec3 center = glm::vec3(0.0f);
+        glm::vec3 normal = glm::vec3(0.0f);
+        float area = 0.0f;
+
+        for (size_t t = clusters[c].begin; t < clusters[c].end; t++) {
+            glm::vec3 a = vertices[indices[t * 3 + 0]].Position;
+            glm::vec3 b = vertices[indices[t * 3 + 1]].Position;
+            glm::vec3 d = vertices[indices[t * 3 + 2]].Position;
+
+            glm::vec3 n = glm::cross(b - a, d - a);
+            float w = glm::length(n) * 0.5f;
+
+            center += (a + b + d) * (w / 3.0f);
+            normal += n;
+            area += w;
+        }
+
+        mesh_center += center;
+        mesh_area += area;
+
+        centers[c] = area > 0.0f ? center / area : glm::vec3(0.0f);
+        normals[c] = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f);
+    }
+
+    if (mesh_area > 0.0f) mesh_center /= mesh_area;
+
+    for (size_t c = 0; c < clusters.size(); c++) {
+        clusters[c].sort = glm::dot(centers[c] - mesh_center, normals[c]);
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+        return a.sort > b.sort;
+    });
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(indices.size());
+    for (const Cluster& c : clusters) {
+        sorted.insert(sorted.end(), indices.begin() + c.begin * 3, indices.begin() + c.end * 3);
+    }
+
+    indices.swap(sorted);
+}
+
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    const unsigned int UNUSED = 0xFFFFFFFF;
+    std::vector<unsigned int> remap(vertices.size(), UNUSED);
+    std::vector<Vertex> ordered;
+    ordered.reserve(vertices.size());
+
+    for (unsigned int& v : indices) {
+        if (remap[v] == UNUSED) {
+            remap[v] = ordered.size();
+            ordered.push_back(vertices[v]);
+        }
+        v = remap[v];
+    }
+
+    vertices.swap(ordered);
+}
+
+MeshOptimizationReport OptimizeMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    MeshOptimizationReport r;
+
+    // Measured on what would have been uploaded, soups as 0..n-1
+    r.vertices_before = vertices.size();
+    if (indices.empty()) {
+        std::vector<unsigned int> soup(vertices.size());
+        for (size_t i = 0; i < soup.size(); i++) soup[i] = i;
+        r.triangles_before = soup.size() / 3;
+        r.before = AnalyzeVertexCache(soup, vertices.size(), VERTEX_CACHE_SIZE);
+    }
+    else {
+        r.triangles_before = indices.size() / 3;
+        r.before = AnalyzeVertexCache(indices, vertices.size(), VERTEX_CACHE_SIZE);
+    }
+
+    WeldVertices(vertices, indices);
+
+    std::vector<size_t> clusters;
+    OptimizeVertexCache(indices, vertices.size(), VERTEX_CACHE_SIZE, clusters);
+    OptimizeOverdraw(indices, vertices, clusters);
+    OptimizeVertexFetch(vertices, indices);
+
+    r.vertices_after = vertices.size();
+    r.triangles_after = indices.size() / 3;
+    r.after = AnalyzeVertexCache(indices, vertices.size(), VERTEX_CACHE_SIZE);
+    return r;
+}
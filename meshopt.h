@@ -0,0 +1,46 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <vector>
+
+#include "vertexformat.h"
+
+// Roughly what post-transform caches hold on the hardware we care about.
+// Used both to optimize and to measure.
+#define VERTEX_CACHE_SIZE 16
+
+struct VertexCacheStats {
+    float acmr; // Cache misses per triangle, 0.5 is ideal for a regular grid, 3 means no reuse at all
+    float atvr; // Cache misses per referenced vertex, 1 is ideal
+};
+
+struct MeshOptimizationReport {
+    size_t vertices_before, vertices_after;
+    size_t triangles_before, triangles_after;
+    VertexCacheStats before, after;
+};
+
+// Simulates a FIFO post-transform cache over the triangle list
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertex_count, unsigned int cache_size);
+
+// Merges bitwise identical vertices and drops triangles that end up degenerate.
+// A mesh without indices is treated as a triangle soup.
+void WeldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+// Tipsify from "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw",
+// Sander, Nehab and Barczak 2007. Appends where each cluster of triangles starts,
+// i.e. every point where the walk hit a dead end, to cluster_starts.
+void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertex_count, unsigned int cache_size, std::vector<size_t>& cluster_starts);
+
+// Sorts the clusters from OptimizeVertexCache so that those facing away from
+// the mesh center go first, they are the ones most likely to occlude the rest
+void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, const std::vector<size_t>& cluster_starts);
+
+// Renumbers vertices in the order the index buffer first touches them,
+// dropping any that are never referenced
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+// All of the above, in order. Only triangle lists make sense here.
+MeshOptimizationReport OptimizeMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+#endif
@@ -1,50 +1,64 @@
 #include "shader.h"
 #include "models.h"
+#include "meshopt.h"
+#include "meshcache.h"
+
+#include <cstdio>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 using namespace std;
 
-void Mesh::setupMesh() {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+void Mesh::setupMesh(VertexFormat format) {
+    geometry = GeometryBuffer::allocate(vertices, indices, format);
+}
 
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+Mesh Mesh::FromGeometry(MeshRange geometry, vector<Texture> textures, Material material) {
+    Mesh m;
+    m.geometry = geometry;
+    m.draw_mode = GL_TRIANGLES;
+    m.material = material;
 
-    if (!vertices.empty()) {
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-    }
-
-    if (!indices.empty()) {
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    for (Texture t : textures) {
+        switch (t.type) {
+        case Texture::Type::DIFFUSE:
+            m.diffuseTexture = t;
+            break;
+        case Texture::Type::SPECULAR:
+            m.specularTexture = t;
+            break;
+        case Texture::Type::NORMAL:
+            m.normalTexture = t;
+            break;
+        default:
+            break;
+        }
     }
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    return m;
+}
 
-    glBindVertexArray(0);
+Mesh Mesh::FromOptimized(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures) {
+    Mesh m = FromGeometry(MeshRange(), textures, Material::Default());
+    m.vertices = vertices;
+    m.indices = indices;
+    m.setupMesh(ChooseVertexFormat(m.vertices));
+    return m;
 }
 
 Mesh::Mesh(
     vector<Vertex> vertices,
     vector<unsigned int> indices,
     vector<Texture> textures
+) : Mesh(vertices, indices, textures, ChooseVertexFormat(vertices)) {
+}
+
+Mesh::Mesh(
+    vector<Vertex> vertices,
+    vector<unsigned int> indices,
+    vector<Texture> textures,
+    VertexFormat format
 ) {
     this->vertices = vertices;
     this->indices = indices;
@@ -67,51 +81,83 @@ Mesh::Mesh(
     draw_mode = GL_TRIANGLES;
     material = Material::Default();
 
-    setupMesh();
+    optimization = OptimizeMesh(this->vertices, this->indices);
+
+    setupMesh(format);
 }
 
-void Mesh::draw(Shader shader) const {
+// Every flag is set on every draw, the state cache makes the repeats free
+void Mesh::bindTextures(const Shader& shader) const {
+    bool textured = diffuseTexture.type != Texture::Type::UNSET;
+    bool specmapped = specularTexture.type != Texture::Type::UNSET;
+    bool normaled = normalTexture.type != Texture::Type::UNSET;
 
-    if (diffuseTexture.type != Texture::Type::UNSET) {
-        shader.setBool("uTextured", true);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseTexture.id);
-        shader.setInt("uTextureDiffuse", 0);
+    shader.set(shader.uTextured, textured);
+    shader.set(shader.uSpecmapped, specmapped);
+    shader.set(shader.uNormaled, normaled);
+
+    if (textured) {
+        GLState::bindTexture(0, GL_TEXTURE_2D, diffuseTexture.id);
+        shader.set(shader.uTextureDiffuse, 0);
     }
 
-    if (specularTexture.type != Texture::Type::UNSET) {
-        shader.setBool("uSpecmapped", true);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularTexture.id);
-        shader.setInt("uTextureSpecular", 1);
+    if (specmapped) {
+        GLState::bindTexture(1, GL_TEXTURE_2D, specularTexture.id);
+        shader.set(shader.uTextureSpecular, 1);
     }
 
-    if (normalTexture.type != Texture::Type::UNSET) {
-        shader.setBool("uNormaled", true);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, normalTexture.id);
-        shader.setInt("uTextureNormal", 2);
+    if (normaled) {
+        GLState::bindTexture(2, GL_TEXTURE_2D, normalTexture.id);
+        shader.set(shader.uTextureNormal, 2);
     }
+}
 
-    glActiveTexture(GL_TEXTURE0);
+void Mesh::draw(const Shader& shader) const {
+    bindTextures(shader);
+    shader.setMaterial(material);
 
-    shader.setMaterial("uMaterial", material);
+    shader.set(shader.uPackedVertices, geometry.format == VERTEX_PACKED);
+    shader.set(shader.uPositionOffset, geometry.dequantize.offset);
+    shader.set(shader.uPositionScale, geometry.dequantize.scale);
 
-    glBindVertexArray(VAO);
+    GLState::bindVertexArray(GeometryBuffer::vertexArray(geometry.pool));
 
-    // TODO: Generalize this
-    if (indices.size() > 0) {
-        glDrawElements(draw_mode, indices.size(), GL_UNSIGNED_INT, 0);
-    }
-    else {
-        glDrawArrays(draw_mode, 0, vertices.size());
-    }
+    size_t index_size = geometry.index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    glDrawElementsBaseVertex(
+        draw_mode,
+        geometry.index_count,
+        geometry.index_type,
+        (void*)(geometry.first_index * index_size),
+        geometry.base_vertex
+    );
+}
 
-    shader.setBool("uTextured", false);
-    shader.setBool("uSpecmapped", false);
-    shader.setBool("uNormaled", false);
+static unsigned int textureName(const Texture& t) {
+    return t.type != Texture::Type::UNSET ? t.id : 0;
+}
 
-    glBindVertexArray(0);
+bool Mesh::sameTextures(const Mesh& other) const {
+    return textureName(diffuseTexture) == textureName(other.diffuseTexture)
+        && textureName(specularTexture) == textureName(other.specularTexture)
+        && textureName(normalTexture) == textureName(other.normalTexture);
+}
+
+// Meshes that bind the same textures get the same key.
+// Collisions only cost us a bit of sorting quality.
+unsigned int Mesh::textureKey() const {
+    unsigned int h = 2166136261u; // FNV-1a
+    const unsigned int words[] = {
+        textureName(diffuseTexture),
+        textureName(specularTexture),
+        textureName(normalTexture)
+    };
+    const unsigned char* bytes = (const unsigned char*)words;
+
+    for (size_t i = 0; i < sizeof(words); i++) {
+        h = (h ^ bytes[i]) * 16777619u;
+    }
+
+    return h;
 }
 
 Mesh Mesh::Cube() {
@@ -319,50 +365,48 @@ Mesh Mesh::BadCube() {
     return ret;
 }
 
+// Longitude i, latitude j. Both angles come straight from the grid indices
+// and the poles are pinned, so shared corners come out bitwise identical
+// and weld together.
+static Vertex spherePoint(int i, int j, int divisions) {
+    Vertex v;
+
+    if (j == 0 || j == divisions) {
+        v.Position = glm::vec3(0.0f, j == 0 ? -1.0f : 1.0f, 0.0f);
+    }
+    else {
+        float phi = (i % divisions) * glm::pi<float>() * 2 / divisions;
+        float theta = -glm::half_pi<float>() + j * glm::pi<float>() / divisions;
+        v.Position = glm::vec3(
+            glm::cos(phi) * glm::cos(theta),
+            glm::sin(theta),
+            glm::sin(phi) * glm::cos(theta)
+        );
+    }
+
+    v.Normal = v.Position;
+    return v;
+}
+
 Mesh Mesh::Sphere(int divisions) {
     vector<Vertex> sphere_vertices;
     vector<unsigned int> sphere_indices;
 
-    float arc = glm::pi<float>() * 2 / divisions;
-
+    // Latitude only goes pole to pole, sweeping it around the full circle
+    // like longitude used to cover the sphere twice
     for (int i = 0; i < divisions; i++) {
         for (int j = 0; j < divisions; j++) {
-            Vertex v1, v2, v3, v4;
-            float theta = j * arc;
-            float phi = i * arc;
-            v1.Position = glm::vec3(
-                glm::cos(phi) * cos(theta),
-                glm::sin(theta),
-                glm::sin(phi) * cos(theta)
-            );
-            v1.Normal = v1.Position;
-            sphere_vertices.push_back(v1);
+            Vertex v1 = spherePoint(i, j, divisions);
+            Vertex v2 = spherePoint(i, j + 1, divisions);
+            Vertex v3 = spherePoint(i + 1, j, divisions);
+            Vertex v4 = spherePoint(i + 1, j + 1, divisions);
 
-            v2.Position = glm::vec3(
-                glm::cos(phi) * cos(theta + arc),
-                glm::sin(theta + arc),
-                glm::sin(phi) * cos(theta + arc)
-            );
-            v2.Normal = v2.Position;
+            sphere_vertices.push_back(v1);
             sphere_vertices.push_back(v2);
-
-            v3.Position = glm::vec3(
-                glm::cos(phi + arc) * cos(theta),
-                glm::sin(theta),
-                glm::sin(phi + arc) * cos(theta)
-            );
-            v3.Normal = v3.Position;
             sphere_vertices.push_back(v3);
 
             sphere_vertices.push_back(v3);
             sphere_vertices.push_back(v2);
-
-            v4.Position = glm::vec3(
-                glm::cos(phi + arc) * cos(theta + arc),
-                glm::sin(theta + arc),
-                glm::sin(phi + arc) * cos(theta + arc)
-            );
-            v4.Normal = v4.Position;
             sphere_vertices.push_back(v4);
         }
     }
@@ -372,71 +416,22 @@ Mesh Mesh::Sphere(int divisions) {
     return ret;
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene) {
-    // process all the node's meshes (if any)
-    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back(processMesh(mesh, scene));
-    }
-    // then do the same for each of its children
-    for (unsigned int i = 0; i < node->mNumChildren; i++) {
-        processNode(node->mChildren[i], scene);
-    }
-}
+namespace {
 
-void Model::loadModel(string path) {
-    Assimp::Importer import;
-    const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-        cout << "ERROR::ASSIMP::" << import.GetErrorString() << endl;
-        return;
-    }
-
-    directory = path.substr(0, path.find_last_of('/'));
-
-    processNode(scene->mRootNode, scene);
-
-    float max_len = 1.0f;
-    for (Mesh m : meshes) {
-        for (Vertex v : m.vertices) {
-            max_len = glm::max(max_len, glm::length(v.Position));
-        }
-    }
-    transform = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f / max_len));
-}
-
-vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, Texture::Type texture_type) {
-    vector<Texture> textures;
-    for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
-    {
+// Only one texture of each kind is used, the last one wins like it always has
+string materialTexture(aiMaterial* mat, aiTextureType type) {
+    string name;
+    for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
         aiString str;
         mat->GetTexture(type, i, &str);
-        bool skip = false;
-
-        for (unsigned int j = 0; j < textures_loaded.size(); j++) {
-            if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0) {
-                textures.push_back(textures_loaded[j]);
-                skip = true;
-                break;
-            }
-        }
-
-        if (!skip) {   // if texture hasn't been loaded already, load it
-            Texture texture = Texture::FromPath(directory + '/' + string(str.C_Str(), str.length));
-            texture.type = texture_type;
-            texture.path = str.C_Str();
-            textures.push_back(texture);
-            textures_loaded.push_back(texture); // add to loaded textures
-        }
+        name = string(str.C_Str(), str.length);
     }
-
-    return textures;
+    return name;
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene) {
+void processMesh(aiMesh* mesh, const aiScene* scene, ModelData& data) {
     vector<unsigned int> indices;
     vector<Vertex>  vertices;
-    vector<Texture> textures;
 
     for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
         Vertex vertex;
@@ -486,36 +481,183 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene) {
             indices.push_back(face.mIndices[j]);
     }
 
+    CachedMesh c;
+    c.material = Material::Default();
+
     // process material
     if (mesh->mMaterialIndex >= 0) {
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        vector<Texture> diffuseMaps = loadMaterialTextures(material,
-            aiTextureType_DIFFUSE, Texture::Type::DIFFUSE);
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        vector<Texture> specularMaps = loadMaterialTextures(material,
-            aiTextureType_SPECULAR, Texture::Type::SPECULAR);
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        c.diffuse_texture = materialTexture(material, aiTextureType_DIFFUSE);
+        c.specular_texture = materialTexture(material, aiTextureType_SPECULAR);
         // For some reason assimp will tend to not load normals unless you
         // specifiy HEIGHT instead of NORMALS
-        vector<Texture> normalMaps = loadMaterialTextures(material,
-            aiTextureType_HEIGHT, Texture::Type::NORMAL);
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        c.normal_texture = materialTexture(material, aiTextureType_HEIGHT);
     }
 
-    return Mesh(vertices, indices, textures);
+    data.cached.meshes.push_back(c);
+    data.vertices.push_back(vertices);
+    data.indices.push_back(indices);
 }
 
-Model Model::FromPath(string path) {
+void processNode(aiNode* node, const aiScene* scene, ModelData& data) {
+    // process all the node's meshes (if any)
+    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+        processMesh(mesh, scene, data);
+    }
+    // then do the same for each of its children
+    for (unsigned int i = 0; i < node->mNumChildren; i++) {
+        processNode(node->mChildren[i], scene, data);
+    }
+}
+
+}
+
+// Meshes come straight out of the mapped cache when it is up to date,
+// otherwise assimp loads them and the cache gets (re)written
+bool Model::Parse(const string& path, ModelData& data) {
+    data.path = path;
+
+    if (MeshCache::Read(path, data.file, data.cached)) {
+        return true;
+    }
+
+    data.cached.transform = glm::mat4(1.0f);
+    data.cached.bounds_min = glm::vec3(0.0f);
+    data.cached.bounds_max = glm::vec3(0.0f);
+
+    Assimp::Importer import;
+    const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        cout << "ERROR::ASSIMP::" << import.GetErrorString() << endl;
+        return false;
+    }
+
+    processNode(scene->mRootNode, scene, data);
+
+    float max_len = 1.0f;
+    glm::vec3 bounds_min = glm::vec3(INFINITY);
+    glm::vec3 bounds_max = glm::vec3(-INFINITY);
+
+    data.prepared.resize(data.vertices.size());
+    data.reports.resize(data.vertices.size());
+
+    for (size_t i = 0; i < data.vertices.size(); i++) {
+        data.reports[i] = OptimizeMesh(data.vertices[i], data.indices[i]);
+
+        for (const Vertex& v : data.vertices[i]) {
+            max_len = glm::max(max_len, glm::length(v.Position));
+            bounds_min = glm::min(bounds_min, v.Position);
+            bounds_max = glm::max(bounds_max, v.Position);
+        }
+
+        PreparedMesh& prepared = data.prepared[i];
+        PrepareMesh(data.vertices[i], data.indices[i], ChooseVertexFormat(data.vertices[i]), prepared);
+
+        CachedMesh& c = data.cached.meshes[i];
+        c.format = prepared.format;
+        c.dequantize = prepared.dequantize;
+        c.vertex_data = prepared.vertex_data.data();
+        c.vertex_count = prepared.vertex_count;
+        c.index_data = prepared.index_data.data();
+        c.index_count = prepared.index_count;
+        c.index_size = prepared.index_size;
+    }
+
+    data.cached.transform = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f / max_len));
+
+    // Empty, treat as a point
+    if (bounds_min.x <= bounds_max.x) {
+        data.cached.bounds_min = bounds_min;
+        data.cached.bounds_max = bounds_max;
+    }
+
+    if (!data.cached.meshes.empty() && !MeshCache::Write(path, data.cached)) {
+        fprintf(stderr, "Warning: could not write mesh cache for '%s'\n", path.c_str());
+    }
+
+    return true;
+}
+
+Model Model::FromData(const ModelData& data, const TextureSource& source) {
     Model m;
-    m.transform = glm::mat4(1.0f);
-    m.loadModel(path);
+    m.directory = data.path.substr(0, data.path.find_last_of('/'));
+    m.transform = data.cached.transform;
+    m.bounds_min = data.cached.bounds_min;
+    m.bounds_max = data.cached.bounds_max;
+
+    for (size_t i = 0; i < data.cached.meshes.size(); i++) {
+        const CachedMesh& c = data.cached.meshes[i];
+
+        vector<Texture> textures;
+        if (!c.diffuse_texture.empty())  textures.push_back(m.loadTexture(c.diffuse_texture, Texture::Type::DIFFUSE, source));
+        if (!c.specular_texture.empty()) textures.push_back(m.loadTexture(c.specular_texture, Texture::Type::SPECULAR, source));
+        if (!c.normal_texture.empty())   textures.push_back(m.loadTexture(c.normal_texture, Texture::Type::NORMAL, source));
+
+        // Cache hits hand the mapped pages to the driver as they are, no copy on our side
+        MeshRange range = GeometryBuffer::upload(
+            c.format, c.dequantize,
+            c.vertex_data, c.vertex_count,
+            c.index_data, c.index_count, c.index_size
+        );
+
+        Mesh mesh = Mesh::FromGeometry(range, textures, c.material);
+
+        if (i < data.vertices.size()) {
+            mesh.vertices = data.vertices[i];
+            mesh.indices = data.indices[i];
+            mesh.optimization = data.reports[i];
+        }
+
+        m.meshes.push_back(mesh);
+    }
+
     return m;
 }
 
+// Asks source once per file per model, name is relative to the model's directory
+Texture Model::loadTexture(const string& name, Texture::Type texture_type, const TextureSource& source) {
+    auto it = textures_loaded.find(name);
+    if (it == textures_loaded.end()) {
+        string path = directory + '/' + name;
+        it = textures_loaded.emplace(name, source(path)).first;
+        texture_paths.push_back(path);
+    }
+
+    Texture texture = it->second;
+    texture.type = texture_type;
+    return texture;
+}
+
+void Model::computeBounds() {
+    bounds_min = glm::vec3(INFINITY);
+    bounds_max = glm::vec3(-INFINITY);
+
+    for (const Mesh& m : meshes) {
+        for (const Vertex& v : m.vertices) {
+            bounds_min = glm::min(bounds_min, v.Position);
+            bounds_max = glm::max(bounds_max, v.Position);
+        }
+    }
+
+    // Empty or failed to load, treat as a point
+    if (bounds_min.x > bounds_max.x) {
+        bounds_min = glm::vec3(0.0f);
+        bounds_max = glm::vec3(0.0f);
+    }
+}
+
+Model Model::FromPath(string path) {
+    ModelData data;
+    Model::Parse(path, data);
+    return Model::FromData(data, Texture::FromPath);
+}
+
 Model Model::FromMesh(Mesh mesh) {
     Model m;
     m.transform = glm::mat4(1.0f);
     m.meshes.push_back(mesh);
+    m.computeBounds();
     return m;
 }
 
@@ -523,12 +665,13 @@ Model Model::FromMeshes(vector<Mesh> meshes) {
     Model m;
     m.transform = glm::mat4(1.0f);
     m.meshes = meshes;
+    m.computeBounds();
     return m;
 }
 
-void Model::draw(Shader shader)
+void Model::draw(const Shader& shader)
 {
     for (const Mesh& m : meshes) {
         m.draw(shader);
     }
-}
\ No newline at end of file
+}
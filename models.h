@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <functional>
+#include <unordered_map>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -15,25 +17,24 @@
 
 #include "assman.h"
 #include "shader.h"
-
-struct Vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec3 Tangent;
-    glm::vec3 Bitangent;
-    glm::vec2 TexCoords;
-};
+#include "geometrybuffer.h"
+#include "meshcache.h"
+#include "meshopt.h"
 
 class Mesh {
 private:
     /*  Render data  */
-    unsigned int VAO, VBO, EBO;
+    MeshRange geometry;
 
     GLenum draw_mode;
 
     /*  Functions    */
-    void setupMesh();
+    Mesh() {}
+
+    void setupMesh(VertexFormat format);
+
 public:
+    // CPU copies, after optimization. Empty for meshes loaded from the mesh cache.
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
 
@@ -43,41 +44,107 @@ public:
 
     Material material;
 
+    // What OptimizeMesh did to it, all zero when it was never optimized
+    // here (mesh cache hits, FromGeometry). tools/vertexreport prints these.
+    MeshOptimizationReport optimization = MeshOptimizationReport();
+
+    // Picks the vertex format with ChooseVertexFormat
     Mesh(
         std::vector<Vertex> vertices,
         std::vector<unsigned int> indices,
         std::vector<Texture> textures
     );
 
-    void draw(Shader shader) const;
+    Mesh(
+        std::vector<Vertex> vertices,
+        std::vector<unsigned int> indices,
+        std::vector<Texture> textures,
+        VertexFormat format
+    );
+
+    // Already uploaded, see Model::FromData
+    static Mesh FromGeometry(MeshRange geometry, std::vector<Texture> textures, Material material);
+
+    // Already through OptimizeMesh, maybe on another thread, so this only
+    // uploads. Picks the vertex format with ChooseVertexFormat.
+    static Mesh FromOptimized(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures);
+
+    void draw(const Shader& shader) const;
+
+    // Texture bindings and the flags that go with them. Everything else about
+    // the material is per-draw data when going through the render queue.
+    void bindTextures(const Shader& shader) const;
+    bool sameTextures(const Mesh& other) const;
+
+    // Used to build render queue sort keys
+    unsigned int textureKey() const;
+    const MeshRange& range() const { return geometry; }
+    GLenum drawMode() const { return draw_mode; }
 
     static Mesh Cube();
     static Mesh BadCube();
     static Mesh Sphere(int divisions = 64);
 };
 
+// Everything Model::FromPath does before it needs a GL context: either the
+// mapped mesh cache, or an import that has been optimized, packed and
+// written back to the cache. Fine to fill on any thread, not copyable.
+struct ModelData {
+    std::string path;
+
+    // Cache hits point cached's blobs in here
+    MappedFile file;
+    CachedModel cached;
+
+    // Only after an import: what cached's blobs point into, and the CPU
+    // copies Mesh keeps, one of each per mesh
+    std::vector<PreparedMesh> prepared;
+    std::vector<std::vector<Vertex>> vertices;
+    std::vector<std::vector<unsigned int>> indices;
+    std::vector<MeshOptimizationReport> reports;
+
+    ModelData() {}
+
+    ModelData(const ModelData&) = delete;
+    ModelData& operator=(const ModelData&) = delete;
+};
+
 class Model {
+public:
+    // Turns a full path into a texture, Texture::FromPath or a loader's cache
+    typedef std::function<Texture(const std::string& path)> TextureSource;
+
 private:
     std::string directory;
-    std::vector<Texture> textures_loaded;
-
-    void processNode(aiNode* node, const aiScene* scene);
+    std::unordered_map<std::string, Texture> textures_loaded;
 
-    void loadModel(std::string path);
+    Texture loadTexture(const std::string& name, Texture::Type texture_type, const TextureSource& source);
 
-    std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, Texture::Type texture_type);
-
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+    void computeBounds();
 
 public:
 
     std::vector<Mesh> meshes;
     glm::mat4 transform;
 
+    // Axis aligned bounds of all meshes, before transform is applied
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+
+    // Full path of every texture the meshes use, once each, as passed to the TextureSource
+    std::vector<std::string> texture_paths;
+
+    // Uncached, every call loads again. AssetManager::model shares one load per file.
     static Model FromPath(std::string path);
+
+    // The two halves of FromPath. Parse only touches files, FromData needs the
+    // GL context and gets each texture from source once per model.
+    static bool Parse(const std::string& path, ModelData& data);
+    static Model FromData(const ModelData& data, const TextureSource& source);
+
     static Model FromMesh(Mesh mesh);
     static Model FromMeshes(std::vector<Mesh> meshes);
 
-    void draw(Shader shader);
+    void draw(const Shader& shader);
 };
 #endif
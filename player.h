@@ -13,7 +13,7 @@ public:
     float speed;
     float camera_theta;
     float camera_phi;
-    glm::vec3 target_rotation;
+    glm::quat target_rotation;
 
     static Player FromEntity(Entity e) {
         Player p;
@@ -22,18 +22,19 @@ public:
         p.centerCamera();
         p.camera_theta = 45.0f;
         p.camera_phi = 45.0f;
-        p.target_rotation = glm::vec3(0.0f, 0.0f, 0.0f);
+        p.target_rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
         p.speed = 2.0f;
         return p;
     }
 
-    void draw(Shader shader) {
+    void draw(const Shader& shader) {
         entity.draw(shader);
     }
 
     void processInput(GLFWwindow* window, float deltaTime) {
-        entity.setRotation(glm::mix(entity.getRotation(), target_rotation, 0.1f));
-        target_rotation = glm::vec3(0.0, glm::radians(180 + camera_theta), 0.0);
+        // Takes the short way round, which mixing Euler angles didn't once theta wrapped
+        entity.setRotation(glm::slerp(entity.getRotation(), target_rotation, 0.1f));
+        target_rotation = EulerRotation(glm::vec3(0.0f, glm::radians(180 + camera_theta), 0.0f));
 
         glm::vec3 playerDelta = glm::vec3(0.0f);
 
@@ -0,0 +1,155 @@
+#include "programcache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <cerrno>
+#endif
+
+namespace {
+
+const char MAGIC[4] = { 'G', 'L', 'P', 'B' };
+
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+
+    // Also in the file name, checked again in case two keys ever share a name
+    uint64_t key;
+
+    uint32_t format; // As glGetProgramBinary reported it
+    uint32_t length;
+};
+
+// FNV-1a, 64 bits this time since the key is all that tells programs apart
+void hash(uint64_t& h, const void* data, size_t length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < length; i++) {
+        h ^= bytes[i];
+        h *= 1099511628211ull;
+    }
+}
+
+void hash(uint64_t& h, const char* s) {
+    // Separated by the terminator so "ab" + "c" and "a" + "bc" differ
+    if (s) hash(h, s, strlen(s) + 1);
+    else hash(h, "", 1);
+}
+
+bool makeDirectory() {
+#ifdef _WIN32
+    return _mkdir(PROGRAM_CACHE_DIR) == 0 || errno == EEXIST;
+#else
+    struct stat st;
+    if (stat(PROGRAM_CACHE_DIR, &st) == 0) return S_ISDIR(st.st_mode);
+    return mkdir(PROGRAM_CACHE_DIR, 0755) == 0;
+#endif
+}
+
+}
+
+bool ProgramCache::Supported() {
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+uint64_t ProgramCache::Key(const std::vector<std::string>& sources) {
+    uint64_t h = 14695981039346656037ull;
+
+    uint32_t version = PROGRAM_CACHE_VERSION;
+    hash(h, &version, sizeof(version));
+
+    hash(h, (const char*)glGetString(GL_VENDOR));
+    hash(h, (const char*)glGetString(GL_RENDERER));
+    hash(h, (const char*)glGetString(GL_VERSION));
+
+    for (const std::string& source : sources) {
+        hash(h, source.c_str(), source.size() + 1);
+    }
+
+    return h;
+}
+
+std::string ProgramCache::PathFor(uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return std::string(PROGRAM_CACHE_DIR) + "/" + name;
+}
+
+bool ProgramCache::Read(uint64_t key, GLuint program) {
+    FILE* f = fopen(PathFor(key).c_str(), "rb");
+    if (!f) return false;
+
+    FileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1
+        && std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0
+        && header.version == PROGRAM_CACHE_VERSION
+        && header.key == key
+        && header.length > 0;
+
+    std::vector<unsigned char> binary;
+    if (ok) {
+        binary.resize(header.length);
+        ok = fread(&binary[0], 1, binary.size(), f) == binary.size();
+    }
+    fclose(f);
+
+    if (!ok) return false;
+
+    glProgramBinary(program, header.format, &binary[0], binary.size());
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    return linked == GL_TRUE;
+}
+
+bool ProgramCache::Write(uint64_t key, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return false;
+
+    std::vector<unsigned char> binary(length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, &binary[0]);
+    if (written <= 0) return false;
+
+    if (!makeDirectory()) return false;
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+    header.format = format;
+    header.length = written;
+
+    // Same dance as MeshCache::Write, a crash can't leave a torn binary behind
+    std::string path = PathFor(key);
+    std::string temp = path + ".tmp";
+
+    FILE* f = fopen(temp.c_str(), "wb");
+    if (!f) return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    if (ok) ok = fwrite(&binary[0], 1, written, f) == (size_t)written;
+    ok = fclose(f) == 0 && ok;
+
+    if (!ok) {
+        remove(temp.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    remove(path.c_str());
+#endif
+    if (rename(temp.c_str(), path.c_str()) != 0) {
+        remove(temp.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Bump whenever the key or the file layout changes
+#define PROGRAM_CACHE_VERSION 1
+
+// Relative to the working directory, like shaders/ and res/
+#define PROGRAM_CACHE_DIR ".shadercache"
+
+// Linked programs as the driver hands them out with glGetProgramBinary,
+// stored as PROGRAM_CACHE_DIR/<key>.bin. The key covers the source text and
+// the driver's vendor, renderer and version strings, so editing a shader or
+// updating the driver just means a miss. Drivers are also free to reject a
+// binary they gave out earlier, which is treated the same way.
+class ProgramCache {
+public:
+    // False when the driver supports no binary formats, nothing gets cached then
+    static bool Supported();
+
+    static uint64_t Key(const std::vector<std::string>& sources);
+    static std::string PathFor(uint64_t key);
+
+    // Loads the cached binary into program, which has to be freshly created.
+    // False on a miss, after which program can still be compiled as usual.
+    static bool Read(uint64_t key, GLuint program);
+
+    // program has to be linked, ideally with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+    static bool Write(uint64_t key, GLuint program);
+};
+
+#endif
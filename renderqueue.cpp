@@ -0,0 +1,180 @@
+#include "renderqueue.h"
+
+#include <cstring>
+
+#define KEY_DEPTH_BITS    20
+#define KEY_MESH_BITS     14
+#define KEY_TEXTURES_BITS 14
+#define KEY_MODE_BITS     4
+#define KEY_POOL_BITS     2
+#define KEY_SHADER_BITS   8
+
+#define KEY_MESH_SHIFT     (KEY_DEPTH_BITS)
+#define KEY_TEXTURES_SHIFT (KEY_MESH_SHIFT + KEY_MESH_BITS)
+#define KEY_MODE_SHIFT     (KEY_TEXTURES_SHIFT + KEY_TEXTURES_BITS)
+#define KEY_POOL_SHIFT     (KEY_MODE_SHIFT + KEY_MODE_BITS)
+#define KEY_SHADER_SHIFT   (KEY_POOL_SHIFT + KEY_POOL_BITS)
+#define KEY_PASS_SHIFT     (KEY_SHADER_SHIFT + KEY_SHADER_BITS)
+
+// Everything above the depth bits, i.e. what it costs to switch between two items
+#define KEY_STATE_MASK (~((uint64_t(1) << KEY_DEPTH_BITS) - 1))
+
+static uint64_t field(unsigned int value, int bits, int shift) {
+    return (uint64_t(value) & ((uint64_t(1) << bits) - 1)) << shift;
+}
+
+uint64_t RenderQueue::MakeKey(Pass pass, unsigned int shader, unsigned int pool, GLenum mode, unsigned int textures, unsigned int mesh, float depth, float far_plane) {
+    // Opaque goes front-to-back to save on overdraw, transparent back-to-front to blend correctly
+    float d = glm::clamp(depth / far_plane, 0.0f, 1.0f);
+    if (pass == PASS_TRANSPARENT) d = 1.0f - d;
+
+    unsigned int depth_bits = (unsigned int)(d * ((1 << KEY_DEPTH_BITS) - 1));
+
+    return field(pass, 2, KEY_PASS_SHIFT)
+        | field(shader, KEY_SHADER_BITS, KEY_SHADER_SHIFT)
+        | field(pool, KEY_POOL_BITS, KEY_POOL_SHIFT)
+        | field(mode, KEY_MODE_BITS, KEY_MODE_SHIFT)
+        | field(textures, KEY_TEXTURES_BITS, KEY_TEXTURES_SHIFT)
+        | field(mesh, KEY_MESH_BITS, KEY_MESH_SHIFT)
+        | field(depth_bits, KEY_DEPTH_BITS, 0);
+}
+
+unsigned int RenderQueue::countStateChanges(const std::vector<DrawItem>& items) {
+    unsigned int changes = 0;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (i == 0 || (items[i].key & KEY_STATE_MASK) != (items[i - 1].key & KEY_STATE_MASK)) {
+            changes++;
+        }
+    }
+    return changes;
+}
+
+// LSD radix sort, one byte per pass. Passes where every key has the
+// same byte are skipped, which is most of them for a typical frame.
+void RenderQueue::sort() {
+    frame_stats.items = items.size();
+    frame_stats.state_changes_unsorted = countStateChanges(items);
+
+    scratch.resize(items.size());
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t counts[256];
+        std::memset(counts, 0, sizeof(counts));
+
+        for (size_t i = 0; i < items.size(); i++) {
+            counts[(items[i].key >> shift) & 0xFF]++;
+        }
+
+        bool trivial = false;
+        for (int b = 0; b < 256; b++) {
+            if (counts[b] == items.size()) trivial = true;
+        }
+        if (trivial) continue;
+
+        size_t offset = 0;
+        for (int b = 0; b < 256; b++) {
+            size_t c = counts[b];
+            counts[b] = offset;
+            offset += c;
+        }
+
+        for (size_t i = 0; i < items.size(); i++) {
+            scratch[counts[(items[i].key >> shift) & 0xFF]++] = items[i];
+        }
+
+        items.swap(scratch);
+    }
+
+    frame_stats.state_changes_sorted = countStateChanges(items);
+}
+
+// Writes data to buffer, reallocating when it no longer fits
+static void streamTo(GLenum target, GLuint* buffer, size_t* capacity, const void* data, size_t bytes) {
+    if (*buffer == 0) {
+        glGenBuffers(1, buffer);
+    }
+
+    glBindBuffer(target, *buffer);
+
+    if (*capacity < bytes) {
+        *capacity = bytes * 2;
+        glBufferData(target, *capacity, NULL, GL_STREAM_DRAW);
+    }
+
+    if (bytes > 0) {
+        glBufferSubData(target, 0, bytes, data);
+    }
+}
+
+void RenderQueue::submit(const Shader& shader) {
+    frame_stats.multi_draws = 0;
+    if (items.empty()) return;
+
+    commands.clear();
+    draw_data.clear();
+    stream.clear();
+
+    for (size_t i = 0; i < items.size(); i++) {
+        const DrawItem& item = items[i];
+        const MeshRange& range = item.mesh->range();
+
+        DrawData d;
+        d.diffuse = item.mesh->material.diffuse;
+        d.specular = item.mesh->material.specular;
+        d.position_offset = glm::vec4(range.dequantize.offset, 0.0f);
+        d.position_scale = glm::vec4(range.dequantize.scale, 0.0f);
+        d.shininess = item.mesh->material.shininess;
+        d.packed = range.format == VERTEX_PACKED;
+
+        DrawElementsIndirectCommand c;
+        c.count = range.index_count;
+        c.instance_count = item.batch->visible.size();
+        c.first_index = range.first_index;
+        c.base_vertex = range.base_vertex;
+        c.base_instance = stream.size();
+
+        for (unsigned int slot : item.batch->visible) {
+            stream.push_back(glm::uvec2(item.batch->bufferIndex(slot), draw_data.size()));
+        }
+
+        draw_data.push_back(d);
+        commands.push_back(c);
+    }
+
+    streamTo(GL_DRAW_INDIRECT_BUFFER, &command_buffer, &command_capacity, &commands[0], commands.size() * sizeof(DrawElementsIndirectCommand));
+    streamTo(GL_SHADER_STORAGE_BUFFER, &draw_data_buffer, &draw_data_capacity, &draw_data[0], draw_data.size() * sizeof(DrawData));
+    streamTo(GL_ARRAY_BUFFER, &stream_buffer, &stream_capacity, stream.empty() ? NULL : &stream[0], stream.size() * sizeof(glm::uvec2));
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, draw_data_buffer);
+    GeometryBuffer::bindInstanceStream(stream_buffer);
+
+    shader.use();
+    shader.set(shader.uInstanced, true);
+
+    // One call per run of items from the same pool, drawn with the same
+    // primitive, that bind the same textures
+    size_t run = 0;
+    for (size_t i = 1; i <= items.size(); i++) {
+        const Mesh& first = *items[run].mesh;
+
+        if (i < items.size()
+            && items[i].mesh->range().pool == first.range().pool
+            && items[i].mesh->drawMode() == first.drawMode()
+            && items[i].mesh->sameTextures(first)) continue;
+
+        GLState::bindVertexArray(GeometryBuffer::vertexArray(first.range().pool));
+        first.bindTextures(shader);
+        glMultiDrawElementsIndirect(
+            first.drawMode(),
+            first.range().index_type,
+            (void*)(run * sizeof(DrawElementsIndirectCommand)),
+            i - run,
+            0
+        );
+        frame_stats.multi_draws++;
+
+        run = i;
+    }
+
+    shader.set(shader.uInstanced, false);
+}
@@ -0,0 +1,99 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <vector>
+#include <stdint.h>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "models.h"
+#include "instancing.h"
+#include "geometrybuffer.h"
+
+// Must match the binding of DrawBuffer in shaders/shader.vert
+#define DRAW_DATA_BINDING 4
+
+// One mesh of one instance batch, everything needed to submit it later
+struct DrawItem {
+    uint64_t key;
+    const Mesh* mesh;
+    InstanceBatch* batch;
+};
+
+// Per-command data, found through the draw index in the instance stream.
+// Laid out for std430, mirrored by `struct DrawData` in shader.vert.
+struct DrawData {
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    glm::vec4 position_offset;
+    glm::vec4 position_scale;
+    float shininess;
+    int packed;
+    float padding[2];
+};
+
+// Collects a frame's draws, sorts them by a packed 64-bit key and submits
+// them in that order so that state changes cluster together. Each item
+// becomes one indirect command, consecutive items that share a geometry
+// pool and draw mode and bind the same textures go out in a single
+// glMultiDrawElementsIndirect.
+//
+// Key layout, most significant bits first:
+//   pass (2) | shader (8) | pool (2) | mode (4) | textures (14) | mesh (14) | depth (20)
+//
+// mode is the GL primitive, GL_POINTS to GL_PATCHES all fit in 4 bits.
+class RenderQueue {
+public:
+    enum Pass {
+        PASS_OPAQUE = 0,
+        PASS_TRANSPARENT = 1
+    };
+
+    struct Stats {
+        unsigned int items;
+        // Program, pool, draw mode, texture or mesh switches, as pushed and as submitted
+        unsigned int state_changes_unsorted;
+        unsigned int state_changes_sorted;
+        // glMultiDrawElementsIndirect calls it all went out in
+        unsigned int multi_draws;
+    };
+
+    static uint64_t MakeKey(Pass pass, unsigned int shader, unsigned int pool, GLenum mode, unsigned int textures, unsigned int mesh, float depth, float far_plane);
+
+    void clear() {
+        items.clear();
+    }
+
+    void push(const DrawItem& item) {
+        items.push_back(item);
+    }
+
+    void sort();
+
+    // Expects the instance buffer to be bound and up to date
+    void submit(const Shader& shader);
+
+    const Stats& stats() const {
+        return frame_stats;
+    }
+
+private:
+    std::vector<DrawItem> items;
+    std::vector<DrawItem> scratch;
+    Stats frame_stats;
+
+    // Rebuilt from the sorted items on every submit
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<DrawData> draw_data;
+    std::vector<glm::uvec2> stream; // (instance, draw) pairs, see INSTANCE_STREAM_LOCATION
+
+    // Made on first submit, grown as needed
+    GLuint command_buffer = 0, draw_data_buffer = 0, stream_buffer = 0;
+    size_t command_capacity = 0, draw_data_capacity = 0, stream_capacity = 0;
+
+    static unsigned int countStateChanges(const std::vector<DrawItem>& items);
+};
+
+#endif
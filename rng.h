@@ -0,0 +1,72 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// xoshiro256** by Blackman and Vigna. Small, fast and good enough for
+// anything that isn't cryptography, and unlike rand() the same seed gives
+// the same sequence everywhere.
+class Rng {
+public:
+    explicit Rng(uint64_t seed = 1) {
+        this->seed(seed);
+    }
+
+    // Expanded with splitmix64, so nearby seeds still give unrelated streams
+    void seed(uint64_t seed) {
+        for (int i = 0; i < 4; i++) {
+            seed += 0x9E3779B97F4A7C15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            s[i] = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+
+        return result;
+    }
+
+    // Uniform in [0, n), n > 0. Multiply and shift rather than modulo, the
+    // bias is below 2^-32 for anything we ask for.
+    uint32_t below(uint32_t n) {
+        return (uint32_t)(((next() >> 32) * n) >> 32);
+    }
+
+    // Uniform in [0, 1)
+    float unit() {
+        return (next() >> 40) * (1.0f / 16777216.0f);
+    }
+
+    // A generator for a numbered sub-task, so work split across threads
+    // doesn't depend on which thread ran what
+    static Rng Stream(uint64_t seed, uint64_t stream) {
+        return Rng(Mix(seed ^ Mix(stream + 0x632BE59BD9B4E019ull)));
+    }
+
+    // splitmix64's finalizer, also handy as a hash of coordinates
+    static uint64_t Mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+private:
+    uint64_t s[4];
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+#endif
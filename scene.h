@@ -1,59 +1,277 @@
 #include <vector>
+#include <unordered_map>
+#include <memory>
 
-#include "entity.h"
+#include "entitystore.h"
 #include "shader.h"
+#include "instancing.h"
+#include "ubo.h"
+#include "renderqueue.h"
+#include "camera.h"
+#include "bvh.h"
+#include "clusters.h"
+#include "threadpool.h"
 
 #ifndef SCENE_H
 #define SCENE_H
 
 class Scene {
-public:
-    ~Scene() { for (Entity* e : entities) { delete e; } }
+private:
+    // One batch per distinct model, rebuilt along with the BVH whenever entities come or go
+    std::unordered_map<Model*, InstanceBatch> batches;
+    unsigned int batched_layout = 0;
 
-    Entity* selected_entity;
+    // Instances of every batch back to back, batches know their own offset
+    GLuint instance_buffer = 0;
 
-    std::vector<Entity*>            entities;
-    std::vector<PointLight>         point_lights;
-    std::vector<DirectionalLight>   directional_lights;
+    UniformBuffer<LightsBlock> lights_buffer = UniformBuffer<LightsBlock>::AtBinding(LIGHTS_BINDING);
 
-    void update() {
+    // Lit point lights as the shader sees them, and as spheres for the
+    // clusters, rebuilt in update()
+    std::vector<GPUPointLight> gpu_point_lights;
+    std::vector<glm::vec4> light_spheres;
+
+    StorageBuffer<GPUPointLight> point_light_buffer = StorageBuffer<GPUPointLight>::AtBinding(POINT_LIGHTS_BINDING);
+    StorageBuffer<ClusterRange>  cluster_buffer = StorageBuffer<ClusterRange>::AtBinding(LIGHT_CLUSTERS_BINDING);
+    StorageBuffer<uint32_t>      light_index_buffer = StorageBuffer<uint32_t>::AtBinding(LIGHT_INDICES_BINDING);
+
+    // Which lights reach which part of the view, redone every draw since
+    // both the lights and the camera move
+    LightClusters clusters;
+    std::unique_ptr<ThreadPool> cluster_pool;
+
+    RenderQueue queue;
+
+    // Over the bounding spheres of pickable entities only. picked maps a
+    // BVH index to a dense entity index, bvh_index goes the other way and
+    // is -1 for entities that aren't in it.
+    BVH bvh;
+    std::vector<int> picked;
+    std::vector<int> bvh_index;
+
+    // Dense entity index by TransformId, -1 for transforms that aren't ours
+    std::vector<int> entity_by_transform;
+
+    void rebuild_batches() {
+        batches.clear();
+
+        // Everything gets re-attached below, so every entity needs its current matrix
+        Transforms::update();
+
+        entity_by_transform.clear();
+
+        std::vector<BVH::Bounds> pick_bounds;
+        picked.clear();
+        bvh_index.assign(entities.size(), -1);
+
+        for (size_t i = 0; i < entities.size(); i++) {
+            TransformId t = entities.transforms[i];
+            Renderable& r = entities.renderables[i];
+            const glm::mat4& model_matrix = Transforms::model(t);
+
+            entities.bounds[i] = WorldBounds(r.model, model_matrix);
+
+            auto it = batches.find(r.model);
+            if (it == batches.end()) {
+                it = batches.emplace(r.model, InstanceBatch::FromModel(r.model)).first;
+            }
+            r.batch = &it->second;
+            r.batch_slot = r.batch->add(model_matrix, entities.bounds[i], entities.selected[i]);
+
+            if (t >= entity_by_transform.size()) entity_by_transform.resize(t + 1, -1);
+            entity_by_transform[t] = i;
+
+            if (entities.pickable[i]) {
+                bvh_index[i] = picked.size();
+                picked.push_back(i);
+                pick_bounds.push_back(entities.bounds[i]);
+            }
+        }
+
+        size_t first = 0;
+        for (auto& kv : batches) {
+            kv.second.place(first);
+            first += kv.second.instances.size();
+        }
+
+        if (instance_buffer == 0) {
+            glGenBuffers(1, &instance_buffer);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, glm::max(first, (size_t)1) * sizeof(Instance), NULL, GL_DYNAMIC_DRAW);
+
+        bvh.build(pick_bounds);
+
+        batched_layout = entities.layout();
     }
 
-    void draw(Shader shader) {
-        for (int i = 0; i < directional_lights.size(); i++) {
-            shader.setDirectionalLight(i, directional_lights[i]);
+    // Hands what moved in the last Transforms::update() to the batches and the BVH
+    void sync_transforms() {
+        if (batched_layout != entities.layout()) {
+            rebuild_batches();
+            return;
         }
 
-        for (int i = 0; i < point_lights.size(); i++) {
-            shader.setPointLight(i, point_lights[i]);
+        for (TransformId t : Transforms::changed()) {
+            if (t >= entity_by_transform.size() || entity_by_transform[t] < 0) continue;
+
+            int i = entity_by_transform[t];
+            const Renderable& r = entities.renderables[i];
+            const glm::mat4& model_matrix = Transforms::model(t);
+
+            entities.bounds[i] = WorldBounds(r.model, model_matrix);
+
+            // Only this slot gets re-uploaded on the next draw
+            r.batch->setMatrix(r.batch_slot, model_matrix, entities.bounds[i]);
+            if (bvh_index[i] >= 0) bvh.update(bvh_index[i], entities.bounds[i]);
         }
+    }
+
+    void set_selected(EntityId id, bool selected) {
+        int i = entities.index(id);
+        if (i < 0) return;
+
+        entities.selected[i] = selected;
+        const Renderable& r = entities.renderables[i];
+        if (r.batch) r.batch->setSelected(r.batch_slot, selected);
+    }
+
+public:
+    EntityId selected_entity;
 
-        for (Entity* e : entities) {
-            e->draw(shader);
+    EntityStore                     entities;
+    std::vector<PointLight>         point_lights;
+    std::vector<DirectionalLight>   directional_lights;
+
+    // Once per frame, after the lights have been moved around
+    void update() {
+        gpu_point_lights.clear();
+        light_spheres.clear();
+
+        for (const PointLight& p : point_lights) {
+            if (!p.is_lit) continue;
+
+            GPUPointLight g;
+            g.position = p.position;
+            g.color = p.color;
+            g.radius = p.radius;
+            g.is_lit = 1;
+            gpu_point_lights.push_back(g);
+            light_spheres.push_back(glm::vec4(glm::vec3(p.position), p.radius));
         }
+
+        point_light_buffer.upload(gpu_point_lights);
     }
 
-    bool select_by_ray_cast(glm::vec3 p, glm::vec3 dir) {
-        float min_t = INFINITY;
+    // Sorts the lights into the camera's clusters and sends them up along
+    // with the Lights block. Part of draw(), for anything else that shades
+    // with the same lights.
+    void assign_lights(const Camera& camera) {
+        if (!cluster_pool) cluster_pool.reset(new ThreadPool());
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+
+        clusters.assign(
+            camera.getViewMatrix(), camera.getProjectionMatrix(),
+            Camera::NEAR_PLANE, Camera::FAR_PLANE,
+            light_spheres, cluster_pool.get()
+        );
+
+        cluster_buffer.upload(clusters.ranges);
+        light_index_buffer.upload(clusters.indices);
+
+        lights_buffer.upload(LightsBlock::FromLights(
+            gpu_point_lights.size(), directional_lights, clusters,
+            glm::vec2(glm::max(viewport[2], 1), glm::max(viewport[3], 1))
+        ));
+    }
+
+    void draw(const Shader& shader, const Camera& camera) {
+        sync_transforms();
+        assign_lights(camera);
+
+        queue.clear();
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BUFFER_BINDING, instance_buffer);
+
+        Frustum frustum = camera.getFrustum();
+
+        for (auto& kv : batches) {
+            InstanceBatch& batch = kv.second;
 
-        // Hurts my soul, looking forward to segfault
-        selected_entity = NULL;
+            // Dirty slots go up whether or not they are on screen
+            batch.upload();
 
-        for (int i = 0; i < entities.size(); i++) {
-            entities[i]->is_selected = false;
-            float t = entities[i]->bounding_sphere.ray_test(p, dir);
-            if (t < min_t) {
-                selected_entity = entities[i];
+            batch.cull(frustum, camera.position);
+            if (batch.visible.empty()) continue;
+
+            float depth = batch.nearestDistance(camera.position);
+
+            for (const Mesh& mesh : batch.model->meshes) {
+                DrawItem item;
+                item.key = RenderQueue::MakeKey(
+                    RenderQueue::PASS_OPAQUE,
+                    shader.getID(),
+                    mesh.range().pool,
+                    mesh.drawMode(),
+                    mesh.textureKey(),
+                    mesh.range().id,
+                    depth,
+                    Camera::FAR_PLANE
+                );
+                item.mesh = &mesh;
+                item.batch = &batch;
+                queue.push(item);
             }
         }
 
-        if (selected_entity) {
-            selected_entity->is_selected = true;
+        queue.sort();
+        queue.submit(shader);
+    }
+
+    const RenderQueue::Stats& queue_stats() const {
+        return queue.stats();
+    }
+
+    const LightClusters::Stats& light_stats() const {
+        return clusters.stats();
+    }
+
+    // dir points from p into the scene
+    bool select_by_ray_cast(glm::vec3 p, glm::vec3 dir) {
+        if (batched_layout != entities.layout()) {
+            rebuild_batches();
+        }
+
+        set_selected(selected_entity, false);
+
+        float t;
+        int hit = bvh.raycast(p, glm::normalize(dir), t);
+
+        selected_entity = hit >= 0 ? entities.ids[picked[hit]] : EntityId();
+
+        if (selected_entity.valid()) {
+            set_selected(selected_entity, true);
             return true;
         }
 
         return false;
     }
+
+    // Pickable entities whose bounding spheres touch the given volume
+    void query_sphere(glm::vec3 center, float radius, std::vector<EntityId>& out) {
+        std::vector<int> hits;
+        bvh.overlap_sphere(center, radius, hits);
+        for (int i : hits) out.push_back(entities.ids[picked[i]]);
+    }
+
+    void query_aabb(glm::vec3 min, glm::vec3 max, std::vector<EntityId>& out) {
+        std::vector<int> hits;
+        bvh.overlap_aabb(min, max, hits);
+        for (int i : hits) out.push_back(entities.ids[picked[i]]);
+    }
 };
 
 #endif
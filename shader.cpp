@@ -1,5 +1,7 @@
 #include "shader.h"
 #include "models.h"
+#include "ubo.h"
+#include "programcache.h"
 
 DirectionalLight DirectionalLight::Default() {
     DirectionalLight l;
@@ -41,123 +43,170 @@ Material Material::Hand() {
     return m;
 }
 
+namespace {
+
+bool parallel_compile_set = false;
+
+// Lets the driver pick how many threads it compiles on, once
+bool parallelCompile() {
+    if (!parallel_compile_set) {
+        parallel_compile_set = true;
+        if (GLEW_KHR_parallel_shader_compile) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        else if (GLEW_ARB_parallel_shader_compile) glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    }
+    return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+}
+
+// Reads a shader and pastes in every #include "file" line, relative to the
+// file it is in. GLSL has none of its own, this is how shaders/lighting.glsl
+// gets shared. Throws std::ifstream::failure like a plain read.
+std::string readSource(const std::string& path) {
+    std::ifstream file;
+    file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    file.open(path.c_str());
+
+    std::stringstream stream;
+    stream << file.rdbuf();
+    file.close();
+
+    std::string directory = path.substr(0, path.find_last_of('/') + 1);
+    std::istringstream lines(stream.str());
+    std::string code, line;
+
+    while (std::getline(lines, line)) {
+        size_t open = line.find('"');
+        size_t close = line.rfind('"');
+
+        if (line.compare(0, 9, "#include ") == 0 && open != close) {
+            code += readSource(directory + line.substr(open + 1, close - open - 1));
+        }
+        else {
+            code += line;
+            code += '\n';
+        }
+    }
+
+    return code;
+}
+
+}
+
 Shader Shader::FromPath(const char* vertexPath, const char* fragmentPath)
+{
+    Shader s = Compile(vertexPath, fragmentPath);
+    s.finish();
+    return s;
+}
+
+Shader Shader::Compile(const char* vertexPath, const char* fragmentPath)
 {
     Shader s;
 
-    s.setup(vertexPath, fragmentPath);
+    s.begin(vertexPath, fragmentPath);
 
     return s;
 }
 
-void Shader::use()
+bool Shader::poll()
 {
-    glUseProgram(ID);
-}
+    if (completed || ID == 0) return completed;
 
-void Shader::setCamera(const Camera& camera) const {
-    glUniformMatrix4fv(uProjectionMatrix, 1, GL_FALSE, &camera.getProjectionMatrix()[0][0]);
-    glUniformMatrix4fv(uViewMatrix, 1, GL_FALSE, &camera.getViewMatrix()[0][0]);
-    setVec4("uEyePosition", glm::vec4(camera.position, 1.0));
-}
+    // Without the extension asking would block anyway, so just finish
+    if (parallelCompile()) {
+        GLint done = GL_FALSE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done) return false;
+    }
 
-void Shader::setModelMatrix(const glm::mat4& model_matrix) const {
-    glUniformMatrix4fv(uModelMatrix, 1, GL_FALSE, &model_matrix[0][0]);
+    complete();
+    return completed;
 }
 
-void Shader::setDirectionalLight(int number, const DirectionalLight& light) const {
-    std::string s_light = "uDirectionalLights[" + std::to_string(number) + "]";
-    setBool(s_light + ".is_lit", light.is_lit);
-    setVec4(s_light + ".direction", light.direction);
-    setVec4(s_light + ".ambient", light.ambient);
-    setVec4(s_light + ".color", light.color);
+void Shader::finish()
+{
+    if (!completed && ID != 0) complete();
 }
 
-void Shader::setPointLight(int number, const PointLight& light) const {
-    std::string s_light = "uPointLights[" + std::to_string(number) + "]";
-    setBool(s_light + ".is_lit", light.is_lit);
-    setFloat(s_light + ".radius", light.radius);
-    setVec4(s_light + ".position", light.position);
-    setVec4(s_light + ".color", light.color);
+void Shader::use() const
+{
+    GLState::useProgram(ID);
 }
 
-void Shader::setMaterial(const std::string& name, const Material& material) const {
-    // Really ugly, but used to be name + ".<parameter>" which caused this function to be 34% of CPU time
-    // This uses 14% of CPU time as profiled by Visual Studio and is still mostly in concatenating strings.
-    // Testing attributes this overwhelmingly to += being faster than + for some weird reason
-    // Edit: The number of parameters has also dropped since, so optimization is not as critical.
-
-    std::string temp;
-
-    temp = name;
-    temp += ".diffuse";
-    setVec4(temp, material.diffuse);
+GLint Shader::location(const std::string& name) const {
+    std::unordered_map<std::string, GLint>::const_iterator it = uniform_locations.find(name);
+    return it == uniform_locations.end() ? -1 : it->second;
+}
 
-    temp = name;
-    temp += ".specular";
-    setVec4(temp, material.specular);
+void Shader::setModelMatrix(const glm::mat4& model_matrix) const {
+    set(uModelMatrix, model_matrix);
+}
 
-    temp = name;
-    temp += ".shininess";
-    setFloat(temp, material.shininess);
+void Shader::setMaterial(const Material& material) const {
+    // Used to build "uMaterial.<parameter>" strings on every call, which at
+    // its worst was 34% of CPU time. The handles are resolved at link time now.
+    set(uMaterial.diffuse, material.diffuse);
+    set(uMaterial.specular, material.specular);
+    set(uMaterial.shininess, material.shininess);
 }
 
+// The string setters are kept for one-off uniforms, they still hash the name
+// but no longer ask the driver for the location
 void Shader::setBool(const std::string& name, bool value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    set(getHandle<bool>(name), value);
 }
 void Shader::setInt(const std::string& name, int value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    set(getHandle<int>(name), value);
 }
 void Shader::setFloat(const std::string& name, float value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    set(getHandle<float>(name), value);
 }
 
 void Shader::setVec2(const std::string& name, const glm::vec2& value) const
 {
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    set(getHandle<glm::vec2>(name), value);
 }
 void Shader::setVec2(const std::string& name, float x, float y) const
 {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+    set(getHandle<glm::vec2>(name), glm::vec2(x, y));
 }
 
 void Shader::setVec3(const std::string& name, const glm::vec3& value) const
 {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    set(getHandle<glm::vec3>(name), value);
 }
 void Shader::setVec3(const std::string& name, float x, float y, float z) const
 {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+    set(getHandle<glm::vec3>(name), glm::vec3(x, y, z));
 }
 
 void Shader::setVec4(const std::string& name, const glm::vec4& value) const
 {
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    set(getHandle<glm::vec4>(name), value);
 }
-void Shader::setVec4(const std::string& name, float x, float y, float z, float w)
+void Shader::setVec4(const std::string& name, float x, float y, float z, float w) const
 {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+    set(getHandle<glm::vec4>(name), glm::vec4(x, y, z, w));
 }
 
 void Shader::setMat2(const std::string& name, const glm::mat2& mat) const
 {
-    glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    set(getHandle<glm::mat2>(name), mat);
 }
 void Shader::setMat3(const std::string& name, const glm::mat3& mat) const
 {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    set(getHandle<glm::mat3>(name), mat);
 }
 void Shader::setMat4(const std::string& name, const glm::mat4& mat) const
 {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    set(getHandle<glm::mat4>(name), mat);
 }
 
 
 // Been very useful to have
-void Shader::checkCompileErrors(GLuint shader, std::string type)
+bool Shader::checkCompileErrors(GLuint shader, std::string type)
 {
     GLint success;
     GLchar infoLog[1024];
@@ -179,65 +228,151 @@ void Shader::checkCompileErrors(GLuint shader, std::string type)
             std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
         }
     }
+    return success == GL_TRUE;
 }
 
-void Shader::setup_handles() {
-    uModelMatrix      = glGetUniformLocation(ID, "uModelMatrix");
-    uViewMatrix       = glGetUniformLocation(ID, "uViewMatrix");
-    uProjectionMatrix = glGetUniformLocation(ID, "uProjectionMatrix");
+void Shader::reflect_uniforms() {
+    uniform_locations.clear();
+
+    GLint count = 0;
+    glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+
+    GLint max_name_length = 0;
+    glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_MAX_NAME_LENGTH, &max_name_length);
+
+    std::vector<GLchar> name(max_name_length + 1);
+
+    const GLenum properties[] = { GL_BLOCK_INDEX, GL_LOCATION, GL_ARRAY_SIZE };
+
+    for (GLint i = 0; i < count; i++) {
+        GLint values[3];
+        glGetProgramResourceiv(ID, GL_UNIFORM, i, 3, properties, 3, NULL, values);
+
+        // Members of uniform blocks have no location of their own
+        if (values[0] != -1) continue;
+
+        GLint location = values[1];
+        GLint array_size = values[2];
+
+        GLsizei length = 0;
+        glGetProgramResourceName(ID, GL_UNIFORM, i, name.size(), &length, &name[0]);
+        std::string uniform_name(&name[0], length);
+
+        uniform_locations[uniform_name] = location;
+
+        // Arrays of basic types are reported once as "name[0]", but
+        // elements are contiguous so every "name[n]" can be derived
+        if (uniform_name.size() > 3 && uniform_name.compare(uniform_name.size() - 3, 3, "[0]") == 0) {
+            std::string base = uniform_name.substr(0, uniform_name.size() - 3);
+            uniform_locations[base] = location;
+            for (GLint j = 1; j < array_size; j++) {
+                uniform_locations[base + "[" + std::to_string(j) + "]"] = location + j;
+            }
+        }
+    }
 }
 
-void Shader::setup(const char* vertexPath, const char* fragmentPath) {
-    std::string vertexCode, fragmentCode, geometryCode;
-    std::ifstream vShaderFile, fShaderFile;
+void Shader::setup_handles() {
+    reflect_uniforms();
 
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    try
-    {
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
+    uModelMatrix = getHandle<glm::mat4>("uModelMatrix");
+
+    uSelected   = getHandle<bool>("uSelected");
+    uInstanced  = getHandle<bool>("uInstanced");
+    uTextured   = getHandle<bool>("uTextured");
+    uSpecmapped = getHandle<bool>("uSpecmapped");
+    uNormaled   = getHandle<bool>("uNormaled");
 
-        std::stringstream vShaderStream, fShaderStream;
+    uPackedVertices = getHandle<bool>("uPackedVertices");
+    uPositionOffset = getHandle<glm::vec3>("uPositionOffset");
+    uPositionScale  = getHandle<glm::vec3>("uPositionScale");
 
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
+    uTextureDiffuse  = getHandle<int>("uTextureDiffuse");
+    uTextureSpecular = getHandle<int>("uTextureSpecular");
+    uTextureNormal   = getHandle<int>("uTextureNormal");
 
-        vShaderFile.close();
-        fShaderFile.close();
+    uMaterial.diffuse   = getHandle<glm::vec4>("uMaterial.diffuse");
+    uMaterial.specular  = getHandle<glm::vec4>("uMaterial.specular");
+    uMaterial.shininess = getHandle<float>("uMaterial.shininess");
 
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+    // Per-frame data comes from the shared uniform buffers in ubo.h
+    GLuint frame_block = glGetUniformBlockIndex(ID, "FrameConstants");
+    if (frame_block != GL_INVALID_INDEX) {
+        glUniformBlockBinding(ID, frame_block, FRAME_CONSTANTS_BINDING);
     }
-    catch (std::ifstream::failure e)
+
+    GLuint lights_block = glGetUniformBlockIndex(ID, "Lights");
+    if (lights_block != GL_INVALID_INDEX) {
+        glUniformBlockBinding(ID, lights_block, LIGHTS_BINDING);
+    }
+}
+
+void Shader::begin(const char* vertexPath, const char* fragmentPath) {
+    std::string vertexCode, fragmentCode, geometryCode;
+
+    try
+    {
+        vertexCode = readSource(vertexPath);
+        fragmentCode = readSource(fragmentPath);
+    }
+    catch (const std::ifstream::failure& e)
     {
         fprintf(stderr, "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ");
     }
 
+    ID = glCreateProgram();
+
+    // A binary from an earlier run skips compiling and linking altogether
+    bool cacheable = ProgramCache::Supported();
+    if (cacheable) {
+        std::vector<std::string> sources;
+        sources.push_back(vertexCode);
+        sources.push_back(fragmentCode);
+        cache_key = ProgramCache::Key(sources);
+
+        if (ProgramCache::Read(cache_key, ID)) {
+            completed = true;
+            setup_handles();
+            return;
+        }
+    }
+
+    parallelCompile();
+
     const char* vShaderSource = vertexCode.c_str();
     const char* fShaderSource = fragmentCode.c_str();
 
-    unsigned int vertex, fragment;
+    // None of these wait for the compiler when it runs in parallel, the
+    // first status query does, which is what poll() avoids
+    pending_vertex = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(pending_vertex, 1, &vShaderSource, NULL);
+    glCompileShader(pending_vertex);
 
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderSource, NULL);
-    glCompileShader(vertex);
-    checkCompileErrors(vertex, "VERTEX");
+    pending_fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(pending_fragment, 1, &fShaderSource, NULL);
+    glCompileShader(pending_fragment);
 
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderSource, NULL);
-    glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
-
-    ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
+    glAttachShader(ID, pending_vertex);
+    glAttachShader(ID, pending_fragment);
 
+    if (cacheable) glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(ID);
-    checkCompileErrors(ID, "PROGRAM");
+}
+
+void Shader::complete() {
+    checkCompileErrors(pending_vertex, "VERTEX");
+    checkCompileErrors(pending_fragment, "FRAGMENT");
+    bool ok = checkCompileErrors(ID, "PROGRAM");
 
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+    glDetachShader(ID, pending_vertex);
+    glDetachShader(ID, pending_fragment);
+    glDeleteShader(pending_vertex);
+    glDeleteShader(pending_fragment);
+    pending_vertex = pending_fragment = 0;
+
+    // A failed link still counts as done, the errors above are all there is to it
+    completed = true;
+    if (ok && cache_key != 0) ProgramCache::Write(cache_key, ID);
 
     setup_handles();
-}
\ No newline at end of file
+}
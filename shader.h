@@ -8,11 +8,17 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
 
 #include "camera.h"
 #include "assman.h"
+#include "glstate.h"
 
-#define MAX_NR_OF_POINT_LIGHTS 5
+// Size of the array in the Lights uniform block, see ubo.h. Point lights
+// have no limit, they live in a storage buffer.
+#define MAX_NR_OF_DIRECTIONAL_LIGHTS 3
 
 // Heavily influenced by and in part lifted from learnopengl.com
 struct DirectionalLight {
@@ -46,31 +52,118 @@ struct Material {
     static Material Hand();
 };
 
+// A uniform location resolved once at link time. The type only exists so
+// that Shader::set picks the right glUniform* call without a lookup.
+template <class T>
+struct UniformHandle {
+    GLint location = -1;
+};
+
+struct MaterialHandles {
+    UniformHandle<glm::vec4> diffuse;
+    UniformHandle<glm::vec4> specular;
+    UniformHandle<float>     shininess;
+};
+
 class Shader
 {
 private:
-    unsigned int ID;
+    unsigned int ID = 0;
+
+    // While a compile is in flight, see compile() and poll()
+    GLuint pending_vertex = 0, pending_fragment = 0;
+    uint64_t cache_key = 0;
+    bool completed = false;
 
-    unsigned int uModelMatrix; // One of the worst offenders
-    unsigned int uViewMatrix;
-    unsigned int uProjectionMatrix;
+    // Every active uniform outside of a block, filled by reflect_uniforms()
+    std::unordered_map<std::string, GLint> uniform_locations;
 
+    void reflect_uniforms();
     void setup_handles();
-    void checkCompileErrors(GLuint shader, std::string type);
-    void setup(const char* vertexPath, const char* fragmentPath);
+    bool checkCompileErrors(GLuint shader, std::string type);
+    void begin(const char* vertexPath, const char* fragmentPath);
+    void complete();
 public:
-    static Shader FromPath(const char* vertexPath, const char* fragmentPath);
+    // Handles for everything touched per draw call, -1 when the program lacks them
+    UniformHandle<glm::mat4> uModelMatrix;
 
-    void use();
+    UniformHandle<bool> uSelected;
+    UniformHandle<bool> uInstanced;
+    UniformHandle<bool> uTextured;
+    UniformHandle<bool> uSpecmapped;
+    UniformHandle<bool> uNormaled;
 
-    void setCamera(const Camera& camera) const;
+    // Vertex decoding, see vertexformat.h
+    UniformHandle<bool>      uPackedVertices;
+    UniformHandle<glm::vec3> uPositionOffset;
+    UniformHandle<glm::vec3> uPositionScale;
 
-    void setModelMatrix(const glm::mat4 &model_matrix) const;
-    void setDirectionalLight(int number, const DirectionalLight& light) const;
+    UniformHandle<int> uTextureDiffuse;
+    UniformHandle<int> uTextureSpecular;
+    UniformHandle<int> uTextureNormal;
+
+    MaterialHandles uMaterial;
+
+    // Blocks until the program is linked
+    static Shader FromPath(const char* vertexPath, const char* fragmentPath);
+
+    // Starts the compile and returns right away. Comes straight out of the
+    // program cache when it can, otherwise the driver compiles in the
+    // background where it supports KHR_parallel_shader_compile. Call poll()
+    // until it says the program is ready, or finish() to wait on it.
+    static Shader Compile(const char* vertexPath, const char* fragmentPath);
+
+    bool poll();
+    void finish();
+    bool ready() const { return completed; }
+
+    void use() const;
+
+    unsigned int getID() const { return ID; }
+
+    GLint location(const std::string& name) const;
+
+    template <class T>
+    UniformHandle<T> getHandle(const std::string& name) const {
+        UniformHandle<T> h;
+        h.location = location(name);
+        return h;
+    }
+
+    // All of these skip the glUniform call when the program already holds the
+    // value. They write to this program whether or not it is the one in use.
+    void set(UniformHandle<bool> h, bool value) const {
+        int v = value;
+        if (GLState::uniformChanged(ID, h.location, &v, sizeof(v))) glProgramUniform1i(ID, h.location, v);
+    }
+    void set(UniformHandle<int> h, int value) const {
+        if (GLState::uniformChanged(ID, h.location, &value, sizeof(value))) glProgramUniform1i(ID, h.location, value);
+    }
+    void set(UniformHandle<float> h, float value) const {
+        if (GLState::uniformChanged(ID, h.location, &value, sizeof(value))) glProgramUniform1f(ID, h.location, value);
+    }
+    void set(UniformHandle<glm::vec2> h, const glm::vec2& value) const {
+        if (GLState::uniformChanged(ID, h.location, &value, sizeof(value))) glProgramUniform2fv(ID, h.location, 1, &value[0]);
+    }
+    void set(UniformHandle<glm::vec3> h, const glm::vec3& value) const {
+        if (GLState::uniformChanged(ID, h.location, &value, sizeof(value))) glProgramUniform3fv(ID, h.location, 1, &value[0]);
+    }
+    void set(UniformHandle<glm::vec4> h, const glm::vec4& value) const {
+        if (GLState::uniformChanged(ID, h.location, &value, sizeof(value))) glProgramUniform4fv(ID, h.location, 1, &value[0]);
+    }
+    void set(UniformHandle<glm::mat2> h, const glm::mat2& mat) const {
+        if (GLState::uniformChanged(ID, h.location, &mat, sizeof(mat))) glProgramUniformMatrix2fv(ID, h.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void set(UniformHandle<glm::mat3> h, const glm::mat3& mat) const {
+        if (GLState::uniformChanged(ID, h.location, &mat, sizeof(mat))) glProgramUniformMatrix3fv(ID, h.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void set(UniformHandle<glm::mat4> h, const glm::mat4& mat) const {
+        if (GLState::uniformChanged(ID, h.location, &mat, sizeof(mat))) glProgramUniformMatrix4fv(ID, h.location, 1, GL_FALSE, &mat[0][0]);
+    }
 
-    void setPointLight(int number, const PointLight& light) const;
+    void setModelMatrix(const glm::mat4 &model_matrix) const;
 
-    void setMaterial(const std::string& name, const Material& material) const;
+    void setMaterial(const Material& material) const;
 
     void setBool(const std::string& name, bool value) const;
     void setInt(const std::string& name, int value) const;
@@ -83,7 +176,7 @@ public:
     void setVec3(const std::string& name, float x, float y, float z) const;
 
     void setVec4(const std::string& name, const glm::vec4& value) const;
-    void setVec4(const std::string& name, float x, float y, float z, float w);
+    void setVec4(const std::string& name, float x, float y, float z, float w) const;
 
     void setMat2(const std::string& name, const glm::mat2& mat) const;
     void setMat3(const std::string& name, const glm::mat3& mat) const;
@@ -2,11 +2,20 @@
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 uModelMatrix;
-uniform mat4 uViewMatrix;
-uniform mat4 uProjectionMatrix;
+
+// Positions may be quantized, see vertexformat.h
+uniform vec3 uPositionOffset;
+uniform vec3 uPositionScale;
+
+// Filled once per frame, see FrameConstants in ubo.h
+layout (std140) uniform FrameConstants {
+    mat4 uViewMatrix;
+    mat4 uProjectionMatrix;
+    vec4 uEyePosition;
+};
 
 void main()
 {
-    vec4 position = vec4(aPos, 1.0);
+    vec4 position = vec4(aPos * uPositionScale + uPositionOffset, 1.0);
     gl_Position = uProjectionMatrix * uViewMatrix * uModelMatrix * position;
 }
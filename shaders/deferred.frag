@@ -0,0 +1,77 @@
+#version 450 core
+// Lighting pass of the deferred path, once per pixel over what gbuffer.frag
+// left behind. Finds lights through the same clusters as shader.frag, so it
+// is a tiled pass that happens to have depth slices too.
+out vec4 FragColor;
+
+// Units are GBUFFER_*_UNIT in gbuffer.h
+layout (binding = 0) uniform sampler2D uGAlbedo;
+layout (binding = 1) uniform sampler2D uGNormal;
+layout (binding = 2) uniform sampler2D uGSpecular;
+layout (binding = 3) uniform sampler2D uGDepth;
+
+layout (std140) uniform FrameConstants {
+    mat4 uViewMatrix;
+    mat4 uProjectionMatrix;
+    vec4 uEyePosition;
+};
+
+#include "lighting.glsl"
+
+// Undoes fOctahedralEncode in gbuffer.frag
+vec3 fOctahedralDecode(vec2 e) {
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(uGDepth, pixel, 0).r;
+
+    // Nothing was drawn here, the sky goes in afterwards
+    if (depth == 1.0) discard;
+
+    // Back to view space through the projection, which is symmetric, then
+    // to world space through the inverse of the view's rotation
+    vec2 ndc = gl_FragCoord.xy / vec2(textureSize(uGDepth, 0)) * 2.0 - 1.0;
+    float z = -uProjectionMatrix[3][2] / (depth * 2.0 - 1.0 + uProjectionMatrix[2][2]);
+    vec3 view_position = vec3(ndc * -z / vec2(uProjectionMatrix[0][0], uProjectionMatrix[1][1]), z);
+    vec4 position = vec4(transpose(mat3(uViewMatrix)) * (view_position - uViewMatrix[3].xyz), 1.0);
+
+    vec4 albedo = texelFetch(uGAlbedo, pixel, 0);
+    vec4 specular = texelFetch(uGSpecular, pixel, 0);
+
+    Material material;
+    material.diffuse = vec4(albedo.rgb, 1.0);
+    material.specular = vec4(specular.rgb, 1.0);
+    material.shininess = specular.a * 255.0;
+
+    vec4 normal  = vec4(fOctahedralDecode(texelFetch(uGNormal, pixel, 0).rg), 0.0);
+    vec4 viewDir = normalize(uEyePosition - position);
+
+    FragColor = vec4(0.0);
+
+    uvec2 cluster = uClusters[fCluster(-z)];
+    for (uint i = cluster.x; i < cluster.x + cluster.y; i++) {
+        PointLight light = uPointLights[uLightIndices[i]];
+        if (light.is_lit == 1) {
+            FragColor += fPointLightFactor(light, position, normal, viewDir, material);
+        }
+    }
+
+    for (int i = 0; i < uDirectionalLightCount; i++) {
+        if (uDirectionalLights[i].is_lit == 1) {
+            FragColor += fDirectionalLightFactor(uDirectionalLights[i], normal, viewDir, material);
+        }
+    }
+
+    if (albedo.a > 0.5) {
+        float R = 0.0 + 0.2 * pow(1.0 + dot(viewDir, normal), 4);
+        FragColor = mix(vec4(1.0, 1.0, 0.2, 1.0), FragColor, R);
+    }
+}
@@ -0,0 +1,81 @@
+#version 450 core
+// Geometry pass of the deferred path, goes with shader.vert. Works out the
+// same material as shader.frag and leaves it in the G-buffer for
+// deferred.frag to light, see GBuffer in gbuffer.h for the layout.
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec2 gNormal;
+layout (location = 2) out vec4 gSpecular;
+
+layout (location = 0) uniform sampler2D uTextureDiffuse;
+layout (location = 1) uniform sampler2D uTextureSpecular;
+layout (location = 2) uniform sampler2D uTextureNormal;
+
+uniform bool uSelected;
+
+uniform bool uTextured;
+uniform bool uNormaled;
+uniform bool uSpecmapped;
+
+in vec2 vTexCoords;
+in vec4 vFragPos;
+in vec4 vNormal;
+in mat3 vTangentMatrix;
+flat in int vInstanceSelected;
+
+flat in int vUseDrawMaterial;
+flat in vec4 vDrawDiffuse;
+flat in vec4 vDrawSpecular;
+flat in float vDrawShininess;
+
+in vec4 vTangent;
+in vec4 vBitangent;
+
+struct Material {
+    vec4 diffuse;
+    vec4 specular;
+
+    float shininess;
+};
+
+uniform Material uMaterial;
+
+// Unit vector to a point on the octahedron, folded flat into [0, 1]^2
+vec2 fOctahedralEncode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 p = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return p * 0.5 + 0.5;
+}
+
+void main()
+{
+    vec4 normal = normalize(vNormal);
+
+    Material material = uMaterial;
+
+    if (vUseDrawMaterial == 1) {
+        material.diffuse = vDrawDiffuse;
+        material.specular = vDrawSpecular;
+        material.shininess = vDrawShininess;
+    }
+
+    if (uTextured) {
+        material.diffuse = texture(uTextureDiffuse, vTexCoords);
+    }
+
+    if (uNormaled) {
+        // Only x and y are stored, cooked normal maps are BC5 with no blue at all
+        vec2 xy = texture(uTextureNormal, vTexCoords).rg * 2 - 1;
+        vec3 tangentNormal = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+        normal = vec4(normalize(vTangentMatrix * tangentNormal), 0.0);
+    }
+
+    if (uSpecmapped) {
+        material.specular = texture(uTextureSpecular, vTexCoords);
+    }
+
+    bool selected = uSelected || vInstanceSelected == 1;
+
+    gAlbedo = vec4(material.diffuse.rgb, selected ? 1.0 : 0.0);
+    gNormal = fOctahedralEncode(normal.xyz);
+    gSpecular = vec4(material.specular.rgb, clamp(material.shininess, 0.0, 255.0) / 255.0);
+}
@@ -0,0 +1,112 @@
+// Lights and how they shade a surface, shared by shader.frag and
+// deferred.frag through Shader's #include. Fragment shaders only.
+struct Material {
+    vec4 diffuse;
+    vec4 specular;
+
+    float shininess;
+};
+
+// Both light structs and the Lights block mirror the structs in ubo.h
+struct DirectionalLight {
+    vec4 direction;
+    vec4 ambient;
+    vec4 color;
+    int is_lit;
+};
+
+struct PointLight {
+    vec4 position;
+    vec4 color;
+    float radius;
+    int is_lit;
+};
+
+// Keep in sync with shader.h
+#define MAX_NR_OF_DIRECTIONAL_LIGHTS 3
+
+layout (std140) uniform Lights {
+    int uPointLightCount;
+    int uDirectionalLightCount;
+
+    uvec4 uClusterGrid;
+    vec4 uClusterDepth;
+    vec4 uClusterScreen;
+
+    DirectionalLight uDirectionalLights[MAX_NR_OF_DIRECTIONAL_LIGHTS];
+};
+
+// Bindings are POINT_LIGHTS_BINDING and on in ubo.h. Each cluster is an
+// offset and a count into uLightIndices, see LightClusters in clusters.h.
+layout (std430, binding = 5) readonly buffer PointLights {
+    PointLight uPointLights[];
+};
+
+layout (std430, binding = 6) readonly buffer LightClusters {
+    uvec2 uClusters[];
+};
+
+layout (std430, binding = 7) readonly buffer LightIndices {
+    uint uLightIndices[];
+};
+
+// Same numbering as LightClusters: slices are exponential in view depth,
+// tiles start at the bottom left like gl_FragCoord
+uint fCluster(float depth) {
+    int slice = int(floor(log(max(depth, uClusterDepth.x) / uClusterDepth.x) * uClusterDepth.y));
+
+    uvec3 cell = uvec3(
+        min(uvec2(gl_FragCoord.xy * uClusterScreen.xy), uClusterGrid.xy - 1u),
+        uint(clamp(slice, 0, int(uClusterGrid.z) - 1))
+    );
+    return (cell.z * uClusterGrid.y + cell.y) * uClusterGrid.x + cell.x;
+}
+
+// modified equation (9) from 'Real Shading in Unreal Engine 4' by Brian Karis
+float fLightFalloff(float distance, float lightRadius, float scale) {
+    //
+    //           saturate(1 - (distance/lightRadius)^4)^2
+    // falloff = ----------------------------------------       (9)
+    //                      distance^2 + 1
+    //
+    // Note(j):
+    // Apparently "saturate" is just clamp(x, 0.0, 1.0) and is a HLSL term
+    //
+    distance = distance / scale;
+    return pow(clamp(1 - pow(distance/lightRadius, 4), 0.0, 1.0),2) / (pow(distance, 2) + 1);
+}
+
+float fLambert(vec4 normal, vec4 lightDir) {
+    return max(dot(normal, lightDir), 0.0); // lambert
+}
+
+float fPhong(vec4 normal, vec4 lightDir, float shininess) {
+    vec4 reflectDir = reflect(-lightDir, normal);
+    return pow(max(dot(normal, reflectDir), 0.0), shininess); // phong
+}
+
+float fBlinnPhong(vec4 normal, vec4 lightDir, vec4 viewDir, float shininess) {
+    vec4 halfway = normalize(lightDir + viewDir);
+    return pow(max(dot(normal, halfway), 0.0), 3*shininess); // blinn-phong
+}
+
+vec4 fDirectionalLightFactor(DirectionalLight light, vec4 normal, vec4 viewDir, Material material) {
+    vec4 lightDir = normalize(light.direction);
+    vec4 diffuse  = material.diffuse  * fLambert(normal, lightDir);
+    vec4 specular = material.specular * fPhong(normal, lightDir, 64);
+    //vec4 specular = material.specular * fBlinnPhong(normal, light.direction, viewDir, material.shininess);
+    return light.ambient * material.diffuse + light.color * (diffuse + specular);
+}
+
+vec4 fPointLightFactor(PointLight light, vec4 position, vec4 normal, vec4 viewDir, Material material) {
+    vec4 toLight  = light.position - position;
+    vec4 lightDir = normalize(toLight);
+
+    float intensity = fLightFalloff(length(toLight), light.radius, 1.0);
+
+    vec4 diffuse  = material.diffuse  * fLambert(normal, lightDir);
+    vec4 specular = material.specular * fPhong(normal, lightDir, material.shininess);
+    //vec4 specular = material.specular * fBlinnPhong(normal, lightDir, viewDir, material.shininess);
+
+    return intensity * light.color * (diffuse + specular);
+}
@@ -1,39 +1,128 @@
 #version 450 core
+// Either full floats or the packed layout in vertexformat.h, which GL
+// hands us as: unorm16 position inside the mesh bounds, octahedral normal
+// in xy, tangent with the bitangent sign in w, and no bitangent.
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec3 aTangent;
+layout (location = 2) in vec4 aTangent;
 layout (location = 3) in vec3 aBitangent;
 layout (location = 4) in vec2 aTexCoords;
 
+// (instance, draw) pair, advanced once per instance starting at the
+// command's base instance. See INSTANCE_STREAM_LOCATION in geometrybuffer.h
+layout (location = 5) in uvec2 aInstance;
+
 uniform mat4 uModelMatrix;
-uniform mat4 uViewMatrix;
-uniform mat4 uProjectionMatrix;
+
+// Used instead of the draw data when not instanced
+uniform bool uPackedVertices;
+uniform vec3 uPositionOffset;
+uniform vec3 uPositionScale;
+
+// Filled once per frame, see FrameConstants in ubo.h
+layout (std140) uniform FrameConstants {
+    mat4 uViewMatrix;
+    mat4 uProjectionMatrix;
+    vec4 uEyePosition;
+};
+
+// Mirrors struct Instance in instancing.h
+struct Instance {
+    mat4 model_matrix;
+    vec4 flags;
+};
+
+layout (std430, binding = 3) readonly buffer InstanceBuffer {
+    Instance uInstances[];
+};
+
+// Mirrors struct DrawData in renderqueue.h
+struct DrawData {
+    vec4 diffuse;
+    vec4 specular;
+    vec4 position_offset;
+    vec4 position_scale;
+    float shininess;
+    int packed;
+};
+
+layout (std430, binding = 4) readonly buffer DrawBuffer {
+    DrawData uDraws[];
+};
+
+uniform bool uInstanced;
 
 out vec2 vTexCoords;
 out vec4 vFragPos;
 out vec4 vNormal;
 out mat3 vTangentMatrix;
+flat out int vInstanceSelected;
+
+// Material of this draw, only used when vUseDrawMaterial is set
+flat out int vUseDrawMaterial;
+flat out vec4 vDrawDiffuse;
+flat out vec4 vDrawSpecular;
+flat out float vDrawShininess;
+
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
 
 void main()
 {
     vTexCoords = aTexCoords;
 
-    vec4 position = vec4(aPos, 1.0);
-    vec3 T = normalize(vec3(uModelMatrix * vec4(aTangent,   0.0)));
-    vec3 N = normalize(vec3(uModelMatrix * vec4(aNormal,    0.0)));
+    mat4 modelMatrix = uModelMatrix;
+    vInstanceSelected = 0;
+    vUseDrawMaterial = 0;
+
+    bool packed = uPackedVertices;
+    vec3 positionOffset = uPositionOffset;
+    vec3 positionScale = uPositionScale;
+
+    if (uInstanced) {
+        uint instance = aInstance.x;
+        modelMatrix = uInstances[instance].model_matrix;
+        vInstanceSelected = int(uInstances[instance].flags.x);
+
+        DrawData draw = uDraws[aInstance.y];
+        vUseDrawMaterial = 1;
+        vDrawDiffuse = draw.diffuse;
+        vDrawSpecular = draw.specular;
+        vDrawShininess = draw.shininess;
+
+        packed = draw.packed == 1;
+        positionOffset = draw.position_offset.xyz;
+        positionScale = draw.position_scale.xyz;
+    }
+
+    vec3 normal = packed ? octahedralDecode(aNormal.xy) : aNormal;
+
+    vec4 position = vec4(aPos * positionScale + positionOffset, 1.0);
+    vec3 T = normalize(vec3(modelMatrix * vec4(aTangent.xyz, 0.0)));
+    vec3 N = normalize(vec3(modelMatrix * vec4(normal,       0.0)));
 	// Make sure tangent is orthogonal to the normal
     T = normalize(T - dot(T, N) * N);
-    vec3 B = normalize(vec3(uModelMatrix * vec4(aBitangent, 0.0)));
 
-	// Make sure that the bitangent points in the right direction
-    if(dot(cross(N.xyz, T.xyz), B.xyz) < 0.0) {
+	// Make sure that the bitangent points in the right direction.
+    // Packed vertices worked that out up front.
+    float handedness = aTangent.w;
+    if (!packed) {
+        vec3 B = normalize(vec3(modelMatrix * vec4(aBitangent, 0.0)));
+        handedness = dot(cross(N.xyz, T.xyz), B.xyz) < 0.0 ? -1.0 : 1.0;
+    }
+    if (handedness < 0.0) {
       T = T * -1;
     }
-    B = cross(T, N);
+    vec3 B = cross(T, N);
     vTangentMatrix = mat3(T,B,N);
 
-    vNormal = normalize(uModelMatrix * vec4(aNormal, 0.0));
-    vFragPos = uModelMatrix * position;
+    vNormal = normalize(modelMatrix * vec4(normal, 0.0));
+    vFragPos = modelMatrix * position;
 
-    gl_Position = uProjectionMatrix * uViewMatrix * uModelMatrix * position;
+    gl_Position = uProjectionMatrix * uViewMatrix * modelMatrix * position;
 }
@@ -2,17 +2,27 @@
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 uModelMatrix;
-uniform mat4 uViewMatrix;
-uniform mat4 uProjectionMatrix;
+
+// Positions may be quantized, see vertexformat.h
+uniform vec3 uPositionOffset;
+uniform vec3 uPositionScale;
+
+// Filled once per frame, see FrameConstants in ubo.h
+layout (std140) uniform FrameConstants {
+    mat4 uViewMatrix;
+    mat4 uProjectionMatrix;
+    vec4 uEyePosition;
+};
 
 out float height;
 
 void main(void) {
 
      mat4 view = mat4(mat3(uViewMatrix));
-     vec4 position = uProjectionMatrix * view * vec4(aPos, 1.0);
+     vec3 pos = aPos * uPositionScale + uPositionOffset;
+     vec4 position = uProjectionMatrix * view * vec4(pos, 1.0);
 
-     height = aPos.y;
+     height = pos.y;
 
      gl_Position = position.xyww;
 }
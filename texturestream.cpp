@@ -0,0 +1,323 @@
+#include "texturestream.h"
+#include "glstate.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+namespace {
+
+const size_t NO_SPACE = (size_t)-1;
+
+struct Job {
+    std::shared_ptr<const TextureData> data;
+    GLuint texture;
+    GLenum format;
+
+    // Level being uploaded, counting down to 0, and how far into it we are
+    // in rows, which are 4 pixel block rows for compressed data
+    uint32_t level;
+    int row;
+
+    size_t remaining;
+};
+
+// Ring space the GPU may still read from, everything from start up to the
+// next fence's start (or the current frame's) belongs to this one
+struct Fence {
+    GLsync sync;
+    size_t start;
+};
+
+struct State {
+    bool initialized;
+    bool persistent;
+
+    GLuint pbo;
+    unsigned char* mapped;
+
+    // Written this frame: [frame_start, head), wrapping around at most once
+    size_t frame_start;
+    size_t head;
+    std::deque<Fence> in_flight;
+
+    std::vector<Job> jobs;
+    size_t pending;
+};
+
+State state;
+
+void init() {
+    state.initialized = true;
+    state.persistent = GLEW_ARB_buffer_storage;
+    if (!state.persistent) return;
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &state.pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, state.pbo);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, TEXTURE_STREAM_RING_SIZE, NULL, flags);
+    state.mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, TEXTURE_STREAM_RING_SIZE, flags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (state.mapped == NULL) {
+        fprintf(stderr, "Warning: could not map the texture streaming buffer, uploading from client memory\n");
+        glDeleteBuffers(1, &state.pbo);
+        state.pbo = 0;
+        state.persistent = false;
+    }
+}
+
+// Drops fences the GPU is past, never waits
+void retire() {
+    while (!state.in_flight.empty()) {
+        GLenum status = glClientWaitSync(state.in_flight.front().sync, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+
+        glDeleteSync(state.in_flight.front().sync);
+        state.in_flight.pop_front();
+    }
+}
+
+size_t allocate(size_t bytes) {
+    if (bytes > TEXTURE_STREAM_RING_SIZE) return NO_SPACE;
+
+    size_t start = (state.head + 3) & ~(size_t)3;
+
+    if (state.in_flight.empty() && state.frame_start == state.head) {
+        if (start + bytes > TEXTURE_STREAM_RING_SIZE) start = 0;
+        state.frame_start = start;
+        state.head = start + bytes;
+        return start;
+    }
+
+    size_t tail = state.in_flight.empty() ? state.frame_start : state.in_flight.front().start;
+
+    if (state.head >= tail) {
+        // Used space is [tail, head), free is the end of the ring and then [0, tail)
+        if (start + bytes <= TEXTURE_STREAM_RING_SIZE) {
+            state.head = start + bytes;
+            return start;
+        }
+        if (bytes < tail) {
+            state.head = bytes;
+            return 0;
+        }
+        return NO_SPACE;
+    }
+
+    // Wrapped, free is [head, tail). Never let head catch up with tail, equal means empty.
+    if (start + bytes < tail) {
+        state.head = start + bytes;
+        return start;
+    }
+    return NO_SPACE;
+}
+
+void levelRows(const Job& job, int& rows, size_t& row_bytes) {
+    const TextureData& data = *job.data;
+    int w = data.levelWidth(job.level), h = data.levelHeight(job.level);
+
+    if (data.compressed_format) {
+        rows = (h + 3) / 4;
+        row_bytes = ((w + 3) / 4) * DDSBlockBytes(data.fourcc);
+    }
+    else {
+        rows = h;
+        row_bytes = (size_t)w * data.channels;
+    }
+}
+
+void uploadRows(const Job& job, int first, int count, const void* pixels) {
+    const TextureData& data = *job.data;
+    int w = data.levelWidth(job.level), h = data.levelHeight(job.level);
+
+    if (data.compressed_format) {
+        int y = first * 4;
+        int band = std::min(count * 4, h - y);
+        size_t row_bytes = ((w + 3) / 4) * DDSBlockBytes(data.fourcc);
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, job.level, 0, y, w, band, job.format, count * row_bytes, pixels);
+    }
+    else {
+        glTexSubImage2D(GL_TEXTURE_2D, job.level, 0, first, w, count, job.format, GL_UNSIGNED_BYTE, pixels);
+    }
+}
+
+// The job whose next level is the fewest bytes, so every texture in flight
+// gets its low resolution levels before any one of them gets its big ones.
+// Level indices alone don't say that across textures of different sizes
+// and formats. Ties go to the higher level, the smaller mip of its chain.
+size_t nextJob() {
+    size_t best = 0;
+    size_t best_bytes = state.jobs[0].data->levelBytes(state.jobs[0].level);
+
+    for (size_t i = 1; i < state.jobs.size(); i++) {
+        const Job& job = state.jobs[i];
+        size_t bytes = job.data->levelBytes(job.level);
+
+        if (bytes < best_bytes || (bytes == best_bytes && job.level > state.jobs[best].level)) {
+            best = i;
+            best_bytes = bytes;
+        }
+    }
+    return best;
+}
+
+}
+
+Texture TextureStreamer::begin(std::shared_ptr<const TextureData> data) {
+    Texture t;
+    if (!data->compressed_format && data->pixels == NULL) return t;
+
+    Job job;
+    job.data = data;
+    job.format = data->compressed_format ? data->compressed_format : Texture::pixelFormat(*data);
+
+    GLenum internal_format = job.format;
+    switch (job.format) {
+    case GL_RED:
+        internal_format = GL_R8;    break;
+    case GL_RGB:
+        internal_format = GL_RGB8;  break;
+    case GL_RGBA:
+        internal_format = GL_RGBA8; break;
+    }
+
+    uint32_t levels = data->levelCount();
+
+    // Immutable storage for the whole chain, only the base level moves after this
+    glGenTextures(1, &t.id);
+    GLState::bindTexture(0, GL_TEXTURE_2D, t.id);
+    glTexStorage2D(GL_TEXTURE_2D, levels, internal_format, data->width, data->height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    Texture::setSampling();
+
+    job.texture = t.id;
+    job.level = levels - 1;
+    job.row = 0;
+    job.remaining = 0;
+    for (uint32_t i = 0; i < levels; i++) job.remaining += data->levelBytes(i);
+
+    state.pending += job.remaining;
+    state.jobs.push_back(job);
+
+    return t;
+}
+
+void TextureStreamer::update(size_t budget) {
+    if (state.jobs.empty()) return;
+    if (!state.initialized) init();
+
+    retire();
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (state.persistent) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, state.pbo);
+
+    size_t spent = 0;
+
+    while (!state.jobs.empty() && spent < budget) {
+        size_t index = nextJob();
+        Job& job = state.jobs[index];
+
+        int rows;
+        size_t row_bytes;
+        levelRows(job, rows, row_bytes);
+
+        // At least one row, so a single huge row can't hold everything up forever
+        size_t fit = std::max((size_t)1, (budget - spent) / row_bytes);
+        int count = std::min((size_t)(rows - job.row), fit);
+        size_t bytes = count * row_bytes;
+
+        const unsigned char* src = job.data->levelData(job.level) + job.row * row_bytes;
+
+        GLState::bindTexture(0, GL_TEXTURE_2D, job.texture);
+
+        if (state.persistent && row_bytes <= TEXTURE_STREAM_RING_SIZE) {
+            size_t offset = allocate(bytes);
+            if (offset == NO_SPACE) {
+                count = 1;
+                bytes = row_bytes;
+                offset = allocate(bytes);
+            }
+
+            // The GPU hasn't caught up, what's left waits for a later frame
+            if (offset == NO_SPACE) break;
+
+            std::memcpy(state.mapped + offset, src, bytes);
+            uploadRows(job, job.row, count, (const void*)offset);
+        }
+        else {
+            if (state.persistent) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            uploadRows(job, job.row, count, src);
+            if (state.persistent) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, state.pbo);
+        }
+
+        spent += bytes;
+        job.row += count;
+        job.remaining -= bytes;
+        state.pending -= bytes;
+
+        if (job.row < rows) continue;
+
+        // A whole level is in, let sampling use it
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, job.level);
+
+        if (job.level == 0) {
+            state.jobs.erase(state.jobs.begin() + index);
+        }
+        else {
+            job.level--;
+            job.row = 0;
+        }
+    }
+
+    if (state.persistent) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (state.head != state.frame_start) {
+        Fence fence;
+        fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        fence.start = state.frame_start;
+        state.in_flight.push_back(fence);
+        state.frame_start = state.head;
+    }
+}
+
+void TextureStreamer::cancel(GLuint texture) {
+    for (size_t i = 0; i < state.jobs.size(); i++) {
+        if (state.jobs[i].texture != texture) continue;
+
+        state.pending -= state.jobs[i].remaining;
+        state.jobs.erase(state.jobs.begin() + i);
+        return;
+    }
+}
+
+size_t TextureStreamer::pending() {
+    return state.pending;
+}
+
+void TextureStreamer::shutdown() {
+    state.jobs.clear();
+    state.pending = 0;
+
+    for (const Fence& f : state.in_flight) {
+        glDeleteSync(f.sync);
+    }
+    state.in_flight.clear();
+
+    if (state.pbo) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, state.pbo);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &state.pbo);
+        state.pbo = 0;
+    }
+
+    state.mapped = NULL;
+    state.frame_start = state.head = 0;
+    state.initialized = false;
+}
@@ -0,0 +1,46 @@
+#ifndef TEXTURESTREAM_H
+#define TEXTURESTREAM_H
+
+#include <GL/glew.h>
+#include <memory>
+#include <cstddef>
+
+#include "assman.h"
+
+// Bytes of texel data handed to the driver per frame, at most. About a
+// 1024x1024 RGBA level, or a 2048x2048 BC1 one.
+#define TEXTURE_UPLOAD_BUDGET (4 << 20)
+
+// Size of the persistently mapped pixel unpack ring. Room for a few frames
+// worth of budget so the GPU can be that far behind before we have to skip.
+#define TEXTURE_STREAM_RING_SIZE (16 << 20)
+
+// Uploads textures a piece at a time instead of all at once. begin() makes
+// the texture with storage for every level right away, then update() copies
+// texels into a ring of pixel unpack buffer memory that stays mapped, and
+// points glTexSubImage at it. Levels go smallest first and the base level
+// follows along, so a blurry version shows up on the first frame and
+// sharpens as the budget allows. Ring space the GPU may still be reading
+// is fenced, when there is none free the rest waits for the next frame
+// rather than stalling this one.
+//
+// Falls back to plain client memory uploads, still within the budget, when
+// the context has no ARB_buffer_storage. Main thread only.
+class TextureStreamer {
+public:
+    // data has to have all its levels, see TextureData::buildMips
+    static Texture begin(std::shared_ptr<const TextureData> data);
+
+    // Once a frame
+    static void update(size_t budget = TEXTURE_UPLOAD_BUDGET);
+
+    // Stops streaming into texture, for deleting it
+    static void cancel(GLuint texture);
+
+    // Bytes still to go across everything begun
+    static size_t pending();
+
+    static void shutdown();
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(unsigned int threads) {
+    stopping = false;
+
+    if (threads == 0) {
+        unsigned int cores = std::thread::hardware_concurrency();
+        threads = cores > 1 ? cores - 1 : 1;
+    }
+
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.push_back(std::thread(&ThreadPool::work, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (std::thread& t : workers) {
+        t.join();
+    }
+}
+
+void ThreadPool::enqueue(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(task);
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::runOne() {
+    Task task;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tasks.empty()) return false;
+        task = tasks.front();
+        tasks.pop_front();
+    }
+
+    task();
+    return true;
+}
+
+void ThreadPool::work() {
+    for (;;) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+            // Drain what is left before leaving
+            if (tasks.empty()) return;
+
+            task = tasks.front();
+            tasks.pop_front();
+        }
+
+        task();
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <chrono>
+
+// Plain FIFO of tasks shared by a fixed set of workers. Nothing in here may
+// touch GL, see AssetLoader for how results get back to the main thread.
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    // 0 means one worker per core but one, the main thread keeps its own
+    explicit ThreadPool(unsigned int threads = 0);
+
+    // Lets queued tasks finish, then joins
+    ~ThreadPool();
+
+    template <typename F>
+    std::future<typename std::result_of<F()>::type> submit(F f) {
+        typedef typename std::result_of<F()>::type R;
+
+        // std::function wants something copyable
+        std::shared_ptr<std::packaged_task<R()>> task = std::make_shared<std::packaged_task<R()>>(f);
+        std::future<R> result = task->get_future();
+        enqueue([task]() { (*task)(); });
+        return result;
+    }
+
+    // Runs one queued task on the calling thread, false if there was none
+    bool runOne();
+
+    // For tasks that depend on other tasks: blocking a worker outright can
+    // deadlock once every worker is waiting, so help out in the meantime
+    template <typename T>
+    void waitFor(const std::shared_future<T>& f) {
+        while (f.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (!runOne()) f.wait_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    unsigned int size() const { return workers.size(); }
+
+    // Runs f(0) .. f(count - 1), on pool when there is one. The calling
+    // thread helps out while it waits.
+    template <typename F>
+    static void ForEach(ThreadPool* pool, size_t count, F f) {
+        if (!pool) {
+            for (size_t i = 0; i < count; i++) f(i);
+            return;
+        }
+
+        std::vector<std::shared_future<void>> done;
+        done.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            done.push_back(pool->submit([f, i]() { f(i); }).share());
+        }
+        for (const std::shared_future<void>& d : done) {
+            pool->waitFor(d);
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<Task> tasks;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void enqueue(Task task);
+    void work();
+};
+
+#endif
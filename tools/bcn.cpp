@@ -0,0 +1,236 @@
+#include "bcn.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+struct Color {
+    float r, g, b;
+};
+
+uint16_t pack565(Color c) {
+    int r = (int)std::floor(c.r * 31.0f / 255.0f + 0.5f);
+    int g = (int)std::floor(c.g * 63.0f / 255.0f + 0.5f);
+    int b = (int)std::floor(c.b * 31.0f / 255.0f + 0.5f);
+    r = r < 0 ? 0 : r > 31 ? 31 : r;
+    g = g < 0 ? 0 : g > 63 ? 63 : g;
+    b = b < 0 ? 0 : b > 31 ? 31 : b;
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+// What the hardware expands a 565 endpoint to
+Color unpack565(uint16_t c) {
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    Color out = { (float)((r << 3) | (r >> 2)), (float)((g << 2) | (g >> 4)), (float)((b << 3) | (b >> 2)) };
+    return out;
+}
+
+float distance2(Color a, Color b) {
+    float dr = a.r - b.r, dg = a.g - b.g, db = a.b - b.b;
+    return dr * dr + dg * dg + db * db;
+}
+
+Color lerp(Color a, Color b, float t) {
+    Color c = { a.r + (b.r - a.r) * t, a.g + (b.g - a.g) * t, a.b + (b.b - a.b) * t };
+    return c;
+}
+
+// Picks the nearest of the four palette entries for every pixel, returns the total error
+float assignIndices(const Color pixels[16], uint16_t c0, uint16_t c1, uint32_t& indices) {
+    Color e0 = unpack565(c0), e1 = unpack565(c1);
+    Color palette[4] = { e0, e1, lerp(e0, e1, 1.0f / 3.0f), lerp(e0, e1, 2.0f / 3.0f) };
+
+    // With equal endpoints the block is in three colour mode, but entry 0 is still e0
+    int entries = c0 == c1 ? 1 : 4;
+
+    float error = 0.0f;
+    indices = 0;
+
+    for (int i = 0; i < 16; i++) {
+        int best = 0;
+        float best_error = distance2(pixels[i], palette[0]);
+        for (int p = 1; p < entries; p++) {
+            float e = distance2(pixels[i], palette[p]);
+            if (e < best_error) {
+                best_error = e;
+                best = p;
+            }
+        }
+        indices |= (uint32_t)best << (2 * i);
+        error += best_error;
+    }
+
+    return error;
+}
+
+// Endpoints along the principal axis of the block's colours, pulled in a
+// little since the extremes are rarely worth spending precision on
+void principalEndpoints(const Color pixels[16], Color& a, Color& b) {
+    Color mean = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++) {
+        mean.r += pixels[i].r / 16.0f;
+        mean.g += pixels[i].g / 16.0f;
+        mean.b += pixels[i].b / 16.0f;
+    }
+
+    float cov[6] = { 0 }; // rr rg rb gg gb bb
+    for (int i = 0; i < 16; i++) {
+        float r = pixels[i].r - mean.r, g = pixels[i].g - mean.g, b = pixels[i].b - mean.b;
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    // Power iteration converges fast enough for 3x3
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int k = 0; k < 8; k++) {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float len = std::sqrt(x * x + y * y + z * z);
+        if (len < 1e-6f) break;
+        axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+    }
+
+    float min_t = INFINITY, max_t = -INFINITY;
+    for (int i = 0; i < 16; i++) {
+        float t = (pixels[i].r - mean.r) * axis[0] + (pixels[i].g - mean.g) * axis[1] + (pixels[i].b - mean.b) * axis[2];
+        min_t = t < min_t ? t : min_t;
+        max_t = t > max_t ? t : max_t;
+    }
+
+    float inset = (max_t - min_t) / 16.0f;
+    min_t += inset;
+    max_t -= inset;
+
+    Color lo = { mean.r + axis[0] * min_t, mean.g + axis[1] * min_t, mean.b + axis[2] * min_t };
+    Color hi = { mean.r + axis[0] * max_t, mean.g + axis[1] * max_t, mean.b + axis[2] * max_t };
+    a = hi;
+    b = lo;
+}
+
+// Least squares endpoints for a fixed set of indices
+bool refineEndpoints(const Color pixels[16], uint32_t indices, Color& a, Color& b) {
+    static const float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+    float aa = 0, bb = 0, ab = 0;
+    Color ax = { 0, 0, 0 }, bx = { 0, 0, 0 };
+
+    for (int i = 0; i < 16; i++) {
+        float w = weights[(indices >> (2 * i)) & 3];
+        float v = 1.0f - w;
+        aa += v * v; bb += w * w; ab += v * w;
+        ax.r += v * pixels[i].r; ax.g += v * pixels[i].g; ax.b += v * pixels[i].b;
+        bx.r += w * pixels[i].r; bx.g += w * pixels[i].g; bx.b += w * pixels[i].b;
+    }
+
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f) return false;
+
+    float inv = 1.0f / det;
+    a.r = (ax.r * bb - bx.r * ab) * inv; a.g = (ax.g * bb - bx.g * ab) * inv; a.b = (ax.b * bb - bx.b * ab) * inv;
+    b.r = (bx.r * aa - ax.r * ab) * inv; b.g = (bx.g * aa - ax.g * ab) * inv; b.b = (bx.b * aa - ax.b * ab) * inv;
+    return true;
+}
+
+void writeColorBlock(uint16_t c0, uint16_t c1, uint32_t indices, uint8_t out[8]) {
+    out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+    out[4] = indices & 0xFF; out[5] = (indices >> 8) & 0xFF;
+    out[6] = (indices >> 16) & 0xFF; out[7] = indices >> 24;
+}
+
+// Always four colour mode, which BC1 needs c0 > c1 for
+void encodeColor(const uint8_t rgba[16 * 4], uint8_t out[8]) {
+    Color pixels[16];
+    for (int i = 0; i < 16; i++) {
+        Color c = { (float)rgba[i * 4 + 0], (float)rgba[i * 4 + 1], (float)rgba[i * 4 + 2] };
+        pixels[i] = c;
+    }
+
+    Color a, b;
+    principalEndpoints(pixels, a, b);
+
+    uint16_t c0 = pack565(a), c1 = pack565(b);
+    uint32_t indices;
+    float error = assignIndices(pixels, c0, c1, indices);
+
+    for (int pass = 0; pass < 2 && c0 != c1; pass++) {
+        Color ra, rb;
+        if (!refineEndpoints(pixels, indices, ra, rb)) break;
+
+        uint16_t r0 = pack565(ra), r1 = pack565(rb);
+        uint32_t refined;
+        float refined_error = assignIndices(pixels, r0, r1, refined);
+        if (refined_error >= error) break;
+
+        c0 = r0; c1 = r1; indices = refined; error = refined_error;
+    }
+
+    if (c0 < c1) {
+        uint16_t t = c0; c0 = c1; c1 = t;
+        indices ^= 0x55555555; // 0 <-> 1, 2 <-> 3
+    }
+    else if (c0 == c1) {
+        indices = 0;
+    }
+
+    writeColorBlock(c0, c1, indices, out);
+}
+
+// Eight value mode, a0 > a1. Used for BC3 alpha and both BC5 channels.
+void encodeChannel(const uint8_t rgba[16 * 4], int channel, uint8_t out[8]) {
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; i++) {
+        int v = rgba[i * 4 + channel];
+        lo = v < lo ? v : lo;
+        hi = v > hi ? v : hi;
+    }
+
+    out[0] = hi;
+    out[1] = lo;
+    std::memset(out + 2, 0, 6);
+    if (hi == lo) return;
+
+    float palette[8];
+    palette[0] = hi;
+    palette[1] = lo;
+    for (int k = 1; k < 7; k++) {
+        palette[k + 1] = ((7 - k) * hi + k * lo) / 7.0f;
+    }
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; i++) {
+        float v = rgba[i * 4 + channel];
+        int best = 0;
+        float best_error = std::fabs(v - palette[0]);
+        for (int p = 1; p < 8; p++) {
+            float e = std::fabs(v - palette[p]);
+            if (e < best_error) {
+                best_error = e;
+                best = p;
+            }
+        }
+        bits |= (uint64_t)best << (3 * i);
+    }
+
+    for (int k = 0; k < 6; k++) {
+        out[2 + k] = (bits >> (8 * k)) & 0xFF;
+    }
+}
+
+}
+
+void EncodeBC1(const uint8_t rgba[16 * 4], uint8_t out[8]) {
+    encodeColor(rgba, out);
+}
+
+void EncodeBC3(const uint8_t rgba[16 * 4], uint8_t out[16]) {
+    encodeChannel(rgba, 3, out);
+    encodeColor(rgba, out + 8);
+}
+
+void EncodeBC5(const uint8_t rgba[16 * 4], uint8_t out[16]) {
+    encodeChannel(rgba, 0, out);
+    encodeChannel(rgba, 1, out + 8);
+}
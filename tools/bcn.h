@@ -0,0 +1,18 @@
+#ifndef BCN_H
+#define BCN_H
+
+#include <stdint.h>
+
+// Block compressors used by the texture cooker. Every function takes one
+// 4x4 block of RGBA8 pixels, row by row, and writes one compressed block.
+
+// 8 bytes, opaque colour. Alpha is ignored.
+void EncodeBC1(const uint8_t rgba[16 * 4], uint8_t out[8]);
+
+// 16 bytes, colour as BC1 plus interpolated alpha
+void EncodeBC3(const uint8_t rgba[16 * 4], uint8_t out[16]);
+
+// 16 bytes, red and green as two independent single channel blocks
+void EncodeBC5(const uint8_t rgba[16 * 4], uint8_t out[16]);
+
+#endif
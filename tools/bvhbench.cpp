@@ -0,0 +1,87 @@
+// Times BVH::raycast over a maze-sized grid of overlapping spheres, the
+// picking worst case, and checks every hit against testing each sphere.
+// Half the rays are axis aligned, which is where a slab test can go NaN.
+//
+//     make bvhbench
+//     ./bvhbench [grid side, default 61] [seed]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <chrono>
+
+#include "../bvh.h"
+#include "../rng.h"
+
+// Nearest sphere the ray enters, the ones it starts inside don't count
+static int brute(const std::vector<BVH::Bounds>& spheres, glm::vec3 origin, glm::vec3 dir, float& t) {
+    int hit = -1;
+    t = INFINITY;
+
+    for (size_t i = 0; i < spheres.size(); i++) {
+        glm::vec3 to_center = spheres[i].center - origin;
+        float c = glm::dot(to_center, to_center) - spheres[i].radius * spheres[i].radius;
+        float b = glm::dot(dir, to_center);
+        if (c < 0.0f || b < 0.0f || b * b < c) continue;
+
+        float ts = b - std::sqrt(b * b - c);
+        if (ts < t) {
+            t = ts;
+            hit = i;
+        }
+    }
+    return hit;
+}
+
+int main(int argc, char** argv) {
+    int side = argc > 1 ? atoi(argv[1]) : 61;
+    uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+
+    // One sphere per tile, each around a unit cube at floor or wall height
+    Rng rng(seed);
+    std::vector<BVH::Bounds> spheres;
+    for (int x = 0; x < side; x++) {
+        for (int z = 0; z < side; z++) {
+            BVH::Bounds b;
+            b.center = glm::vec3((float)x, rng.unit() < 0.5f ? -0.5f : 0.5f, (float)z);
+            b.radius = 0.866f;
+            spheres.push_back(b);
+        }
+    }
+
+    BVH bvh;
+    bvh.build(spheres);
+
+    // Clicks from head height, looking down into the maze
+    const int RAYS = 200000;
+    std::vector<glm::vec3> origins(RAYS), dirs(RAYS);
+    const glm::vec3 axes[4] = { glm::vec3(0, -1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+
+    for (int i = 0; i < RAYS; i++) {
+        origins[i] = glm::vec3(rng.unit() * side, 1.7f + rng.unit() * 2.0f, rng.unit() * side);
+        dirs[i] = i % 2 ? axes[i / 2 % 4] : glm::normalize(glm::vec3(rng.unit() - 0.5f, -0.3f - rng.unit(), rng.unit() - 0.5f));
+    }
+
+    int wrong = 0, hits = 0;
+    for (int i = 0; i < RAYS; i += 10) {
+        float t, bt;
+        int hit = bvh.raycast(origins[i], dirs[i], t);
+        int expected = brute(spheres, origins[i], dirs[i], bt);
+
+        // Either the same sphere, or another one entered at the same distance
+        if (hit != expected && !(hit >= 0 && expected >= 0 && std::fabs(t - bt) < 1e-4f)) wrong++;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < RAYS; i++) {
+        float t;
+        hits += bvh.raycast(origins[i], dirs[i], t) >= 0;
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%zu spheres, %d rays, %d hit: %.3f us per ray\n", spheres.size(), RAYS, hits, us / RAYS);
+    printf("brute force: %s\n", wrong ? "HITS DIFFER" : "same hits");
+
+    return wrong == 0 ? 0 : 1;
+}
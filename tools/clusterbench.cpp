@@ -0,0 +1,95 @@
+// Times light clustering with thousands of point lights and checks it
+// against brute force: for random points in the view, every light that
+// reaches the point has to be in the point's cluster. Also checks that
+// threaded runs come out the same as serial ones.
+//
+//     make clusterbench
+//     ./clusterbench [lights, default 4096] [seed]
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../clusters.h"
+#include "../threadpool.h"
+#include "../rng.h"
+
+static double milliseconds(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+static double timeAssign(LightClusters& clusters, const glm::mat4& view, const glm::mat4& projection,
+                         const std::vector<glm::vec4>& lights, ThreadPool* pool, int runs) {
+    std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; i++) {
+        clusters.assign(view, projection, 0.1f, 100.0f, lights, pool);
+    }
+    return milliseconds(t) / runs;
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 4096;
+    uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+
+    const float NEAR = 0.1f, FAR = 100.0f;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, NEAR, FAR);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 1.5f, 0.0f), glm::vec3(20.0f, 0.5f, 30.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    // Small lights scattered low over a maze sized area, like the game's
+    Rng rng(seed);
+    std::vector<glm::vec4> lights(count);
+    for (glm::vec4& l : lights) {
+        l = glm::vec4(rng.unit() * 80.0f - 20.0f, 0.4f + rng.unit(), rng.unit() * 80.0f - 20.0f, 1.5f + rng.unit() * 1.5f);
+    }
+
+    ThreadPool pool;
+    LightClusters serial, threaded;
+    serial.assign(view, projection, NEAR, FAR, lights);
+    threaded.assign(view, projection, NEAR, FAR, lights, &pool);
+
+    bool same = true;
+    for (size_t i = 0; i < serial.count(); i++) {
+        same = serial.ranges[i].offset == threaded.ranges[i].offset && serial.ranges[i].count == threaded.ranges[i].count && same;
+    }
+    same = serial.indices == threaded.indices && same;
+
+    // Points spread evenly over the screen and over log depth, like the slices
+    glm::mat4 to_world = glm::inverse(view);
+    long reached = 0, shaded = 0, missing = 0;
+    const int SAMPLES = 100000;
+    for (int s = 0; s < SAMPLES; s++) {
+        float nx = rng.unit() * 2.0f - 1.0f, ny = rng.unit() * 2.0f - 1.0f;
+        float depth = NEAR * glm::pow(FAR / NEAR, rng.unit());
+        glm::vec3 p = glm::vec3(to_world * glm::vec4(nx * depth / projection[0][0], ny * depth / projection[1][1], -depth, 1.0f));
+
+        int tx = std::min((int)((nx + 1.0f) * 0.5f * serial.width()), serial.width() - 1);
+        int ty = std::min((int)((ny + 1.0f) * 0.5f * serial.height()), serial.height() - 1);
+        const ClusterRange& r = serial.ranges[((size_t)serial.slice(depth) * serial.height() + ty) * serial.width() + tx];
+        const uint32_t* first = serial.indices.data() + r.offset;
+
+        shaded += r.count;
+        for (size_t i = 0; i < lights.size(); i++) {
+            if (glm::length(glm::vec3(lights[i]) - p) >= lights[i].w) continue;
+            reached++;
+            if (!std::binary_search(first, first + r.count, (uint32_t)i)) missing++;
+        }
+    }
+
+    const LightClusters::Stats& stats = serial.stats();
+    printf("%d lights, %u in view, %dx%dx%d clusters, %u indices, at most %u in a cluster\n",
+        count, stats.lights, serial.width(), serial.height(), serial.depth(), stats.references, stats.busiest);
+    printf("per fragment: %.2f lights reach it, %.2f in its cluster, %d looping over every light\n",
+        (double)reached / SAMPLES, (double)shaded / SAMPLES, count);
+    printf("assign: %.3f ms serial, %.3f ms on %u threads\n",
+        timeAssign(serial, view, projection, lights, NULL, 50),
+        timeAssign(threaded, view, projection, lights, &pool, 50), pool.size());
+    printf("brute force: %s, threaded: %s\n",
+        missing ? "LIGHTS MISSING" : "every light found",
+        same ? "same as serial" : "DIFFERS FROM SERIAL");
+
+    return missing == 0 && same ? 0 : 1;
+}
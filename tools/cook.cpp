@@ -0,0 +1,334 @@
+// Cooks every image under res/ into a block compressed DDS next to it, with
+// the whole mip chain built here instead of by glGenerateMipmap at load.
+// Texture::FromPath picks up <image>.dds as long as it is newer than <image>.
+//
+//     make cook
+//     ./cook [--force] [directory]
+//
+// What an image is gets guessed from its name:
+//   *normal*, *_norm*, *_ddn*   BC5, x and y only, z is rebuilt in the shader
+//   spec, rough, height, ...    BC1, or BC3 with alpha, filtered as plain data
+//   anything else               BC1, or BC3 with alpha, filtered as sRGB colour
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+#include "../dds.h"
+#include "bcn.h"
+
+enum Kind {
+    KIND_COLOR,
+    KIND_DATA,
+    KIND_NORMAL
+};
+
+static const char* KIND_NAMES[] = { "color", "data", "normal" };
+
+// Four floats a pixel, in whatever space the kind is filtered in
+struct Level {
+    int width, height;
+    std::vector<float> pixels;
+};
+
+struct Totals {
+    size_t files, cooked, failed;
+    size_t bytes_before, bytes_after;
+};
+
+static std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+static bool endsWith(const std::string& s, const char* suffix) {
+    size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static bool isImage(const std::string& name) {
+    std::string l = lower(name);
+    return endsWith(l, ".jpg") || endsWith(l, ".jpeg") || endsWith(l, ".png") || endsWith(l, ".tga");
+}
+
+static Kind classify(const std::string& name) {
+    std::string l = lower(name);
+
+    if (l.find("normal") != std::string::npos || l.find("_norm") != std::string::npos || l.find("_ddn") != std::string::npos) {
+        return KIND_NORMAL;
+    }
+
+    const char* data[] = { "spec", "rough", "height", "disp", "bump", "_occ", "occlusion", "metal" };
+    for (const char* d : data) {
+        if (l.find(d) != std::string::npos) return KIND_DATA;
+    }
+
+    return KIND_COLOR;
+}
+
+static float srgbToLinear(float c) {
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float c) {
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+static uint8_t toByte(float v) {
+    int i = (int)std::floor(v * 255.0f + 0.5f);
+    return i < 0 ? 0 : i > 255 ? 255 : i;
+}
+
+static void normalize3(float* v) {
+    float len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (len > 1e-6f) {
+        v[0] /= len; v[1] /= len; v[2] /= len;
+    }
+    else {
+        v[0] = 0.0f; v[1] = 0.0f; v[2] = 1.0f;
+    }
+}
+
+static Level decode(const unsigned char* rgba, int width, int height, Kind kind) {
+    Level level;
+    level.width = width;
+    level.height = height;
+    level.pixels.resize((size_t)width * height * 4);
+
+    for (size_t i = 0; i < (size_t)width * height; i++) {
+        float* p = &level.pixels[i * 4];
+        for (int c = 0; c < 4; c++) p[c] = rgba[i * 4 + c] / 255.0f;
+
+        if (kind == KIND_COLOR) {
+            for (int c = 0; c < 3; c++) p[c] = srgbToLinear(p[c]);
+        }
+        else if (kind == KIND_NORMAL) {
+            for (int c = 0; c < 3; c++) p[c] = p[c] * 2.0f - 1.0f;
+            // xy alone only means something for unit vectors, z gets rebuilt from it
+            normalize3(p);
+        }
+    }
+
+    return level;
+}
+
+// 2x2 box, odd edges repeat their last row or column
+static Level downsample(const Level& src, Kind kind) {
+    Level dst;
+    dst.width = std::max(1, src.width / 2);
+    dst.height = std::max(1, src.height / 2);
+    dst.pixels.resize((size_t)dst.width * dst.height * 4);
+
+    for (int y = 0; y < dst.height; y++) {
+        int y0 = std::min(y * 2, src.height - 1), y1 = std::min(y * 2 + 1, src.height - 1);
+
+        for (int x = 0; x < dst.width; x++) {
+            int x0 = std::min(x * 2, src.width - 1), x1 = std::min(x * 2 + 1, src.width - 1);
+
+            const float* a = &src.pixels[((size_t)y0 * src.width + x0) * 4];
+            const float* b = &src.pixels[((size_t)y0 * src.width + x1) * 4];
+            const float* c = &src.pixels[((size_t)y1 * src.width + x0) * 4];
+            const float* d = &src.pixels[((size_t)y1 * src.width + x1) * 4];
+            float* out = &dst.pixels[((size_t)y * dst.width + x) * 4];
+
+            for (int k = 0; k < 4; k++) out[k] = (a[k] + b[k] + c[k] + d[k]) * 0.25f;
+
+            if (kind == KIND_NORMAL) normalize3(out);
+        }
+    }
+
+    return dst;
+}
+
+static void encodePixel(const float* p, Kind kind, uint8_t* out) {
+    if (kind == KIND_COLOR) {
+        for (int c = 0; c < 3; c++) out[c] = toByte(linearToSrgb(p[c]));
+        out[3] = toByte(p[3]);
+    }
+    else if (kind == KIND_NORMAL) {
+        for (int c = 0; c < 3; c++) out[c] = toByte(p[c] * 0.5f + 0.5f);
+        out[3] = 255;
+    }
+    else {
+        for (int c = 0; c < 4; c++) out[c] = toByte(p[c]);
+    }
+}
+
+static void encodeLevel(const Level& level, Kind kind, uint32_t fourcc, std::vector<uint8_t>& out) {
+    int blocks_x = (level.width + 3) / 4, blocks_y = (level.height + 3) / 4;
+    uint32_t block_bytes = DDSBlockBytes(fourcc);
+
+    size_t start = out.size();
+    out.resize(start + (size_t)blocks_x * blocks_y * block_bytes);
+    uint8_t* dst = &out[start];
+
+    uint8_t block[16 * 4];
+
+    for (int by = 0; by < blocks_y; by++) {
+        for (int bx = 0; bx < blocks_x; bx++) {
+            // Blocks hanging over the edge repeat the edge, the padding is never sampled
+            for (int i = 0; i < 16; i++) {
+                int x = std::min(bx * 4 + i % 4, level.width - 1);
+                int y = std::min(by * 4 + i / 4, level.height - 1);
+                encodePixel(&level.pixels[((size_t)y * level.width + x) * 4], kind, &block[i * 4]);
+            }
+
+            if (fourcc == DDS_FOURCC_BC1) EncodeBC1(block, dst);
+            else if (fourcc == DDS_FOURCC_BC3) EncodeBC3(block, dst);
+            else EncodeBC5(block, dst);
+
+            dst += block_bytes;
+        }
+    }
+}
+
+static bool writeDDS(const std::string& path, uint32_t fourcc, int width, int height, uint32_t mip_count, const std::vector<uint8_t>& levels) {
+    DDSHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.size = sizeof(DDSHeader);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.height = height;
+    header.width = width;
+    header.linear_size = DDSLevelBytes(fourcc, width, height);
+    header.mip_count = mip_count;
+    header.format.size = sizeof(DDSPixelFormat);
+    header.format.flags = DDPF_FOURCC;
+    header.format.fourcc = fourcc;
+    header.caps = DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX;
+
+    // Same as the mesh cache, never leave a half written file where the loader looks
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+
+    uint32_t magic = DDS_MAGIC;
+    bool ok = fwrite(&magic, sizeof(magic), 1, f) == 1
+        && fwrite(&header, sizeof(header), 1, f) == 1
+        && fwrite(levels.data(), 1, levels.size(), f) == levels.size();
+
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool upToDate(const std::string& source, const std::string& cooked) {
+    struct stat s, c;
+    if (stat(source.c_str(), &s) != 0 || stat(cooked.c_str(), &c) != 0) return false;
+    return c.st_mtime >= s.st_mtime;
+}
+
+static void cook(const std::string& path, const std::string& name, bool force, Totals& totals) {
+    std::string cooked = path + ".dds";
+    totals.files++;
+
+    if (!force && upToDate(path, cooked)) return;
+
+    int width, height, channels;
+    unsigned char* rgba = stbi_load(path.c_str(), &width, &height, &channels, 4);
+    if (rgba == NULL) {
+        printf("%-64s %s\n", path.c_str(), stbi_failure_reason());
+        totals.failed++;
+        return;
+    }
+
+    Kind kind = classify(name);
+
+    bool alpha = false;
+    if (kind != KIND_NORMAL) {
+        for (size_t i = 0; i < (size_t)width * height && !alpha; i++) {
+            alpha = rgba[i * 4 + 3] != 255;
+        }
+    }
+
+    uint32_t fourcc = kind == KIND_NORMAL ? DDS_FOURCC_BC5 : alpha ? DDS_FOURCC_BC3 : DDS_FOURCC_BC1;
+
+    Level level = decode(rgba, width, height, kind);
+    stbi_image_free(rgba);
+
+    // Every level is filtered from the float one above it, so rounding never compounds
+    std::vector<uint8_t> levels;
+    uint32_t mip_count = 1;
+    encodeLevel(level, kind, fourcc, levels);
+
+    while (level.width > 1 || level.height > 1) {
+        level = downsample(level, kind);
+        encodeLevel(level, kind, fourcc, levels);
+        mip_count++;
+    }
+
+    if (!writeDDS(cooked, fourcc, width, height, mip_count, levels)) {
+        printf("%-64s could not write %s\n", path.c_str(), cooked.c_str());
+        totals.failed++;
+        return;
+    }
+
+    // What glTexImage2D plus glGenerateMipmap used to keep around, RGBA8 is what drivers store RGB8 as anyway
+    size_t before = (size_t)width * height * 4 * 4 / 3;
+
+    printf("%-64s %6s %5dx%-5d %4s %8.1f KiB -> %8.1f KiB\n",
+        path.c_str(), KIND_NAMES[kind], width, height,
+        fourcc == DDS_FOURCC_BC1 ? "BC1" : fourcc == DDS_FOURCC_BC3 ? "BC3" : "BC5",
+        before / 1024.0, levels.size() / 1024.0);
+
+    totals.cooked++;
+    totals.bytes_before += before;
+    totals.bytes_after += levels.size();
+}
+
+static void walk(const std::string& directory, bool force, Totals& totals) {
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return;
+
+    std::vector<std::string> names;
+    while (dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') names.push_back(entry->d_name);
+    }
+    closedir(dir);
+
+    // Stable output no matter what order the filesystem hands them out in
+    std::sort(names.begin(), names.end());
+
+    for (const std::string& name : names) {
+        std::string path = directory + '/' + name;
+
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) continue;
+
+        if (S_ISDIR(st.st_mode)) walk(path, force, totals);
+        else if (isImage(name)) cook(path, name, force, totals);
+    }
+}
+
+int main(int argc, char** argv) {
+    bool force = false;
+    std::string root = "res";
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--force") == 0) force = true;
+        else root = argv[i];
+    }
+
+    Totals totals = {};
+    walk(root, force, totals);
+
+    printf("%zu images, %zu cooked, %zu up to date, %zu failed",
+        totals.files, totals.cooked, totals.files - totals.cooked - totals.failed, totals.failed);
+    if (totals.cooked > 0) {
+        printf(", %.1f MiB -> %.1f MiB", totals.bytes_before / 1048576.0, totals.bytes_after / 1048576.0);
+    }
+    printf("\n");
+
+    return totals.failed ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+// Times every maze generator, checks that what comes out is a perfect maze
+// and that the threaded runs match the serial ones node for node. Also
+// reports what the mesher makes of the game's maze.
+//
+//     make mazebench
+//     ./mazebench [nodes per side, default 10000] [seed]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <sys/resource.h>
+
+#include "../maze.h"
+#include "../mazemesh.h"
+#include "../threadpool.h"
+
+typedef Maze (*Threaded)(int, int, uint64_t, ThreadPool*);
+
+static double seconds(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+static long peakMiB() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024; // KiB on Linux
+}
+
+static bool report(const char* name, const char* threads, const Maze& m, double elapsed) {
+    bool perfect = m.isPerfect();
+    printf("%-18s %-10s %8.2f s  %6.1f Mnodes/s  grid %5zu MiB  peak RSS %5ld MiB  %s\n",
+        name, threads, elapsed,
+        (double)m.width() * m.height() / elapsed / 1e6,
+        m.passages.cells.size() >> 20, peakMiB(),
+        perfect ? "perfect" : "NOT PERFECT");
+    return perfect;
+}
+
+int main(int argc, char** argv) {
+    int size = argc > 1 ? atoi(argv[1]) : 10000;
+    uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+
+    ThreadPool pool;
+    char pooled[32];
+    snprintf(pooled, sizeof(pooled), "%u+1 thr", pool.size());
+
+    printf("%d x %d nodes, seed %llu\n", size, size, (unsigned long long)seed);
+
+    bool ok = true;
+
+    {
+        std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+        Maze m = Maze::Backtracker(size, size, seed);
+        ok = report("backtracker", "serial", m, seconds(t)) && ok;
+    }
+
+    const char* names[] = { "recursive division", "wilson (blocked)" };
+    Threaded generators[] = { Maze::RecursiveDivision, Maze::Wilson };
+
+    for (int g = 0; g < 2; g++) {
+        std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+        Maze serial = generators[g](size, size, seed, NULL);
+        ok = report(names[g], "serial", serial, seconds(t)) && ok;
+
+        t = std::chrono::steady_clock::now();
+        Maze threaded = generators[g](size, size, seed, &pool);
+        ok = report(names[g], pooled, threaded, seconds(t)) && ok;
+
+        bool same = serial.passages.cells == threaded.passages.cells;
+        if (!same) printf("%-18s threaded result differs from serial\n", names[g]);
+        ok = same && ok;
+    }
+
+    // Eller's only ever holds a row, however many it makes
+    {
+        std::vector<uint8_t> row(size);
+        EllerRows rows(size, 64, seed);
+
+        std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+        for (int y = 0; y < size; y++) rows.next(row.data());
+        double elapsed = seconds(t);
+
+        printf("%-18s %-10s %8.2f s  %6.1f Mnodes/s  row  %5zu KiB  peak RSS %5ld MiB\n",
+            "eller (streamed)", "serial", elapsed,
+            (double)size * size / elapsed / 1e6, row.size() >> 10, peakMiB());
+    }
+
+    // A window of bands, with a corridor along the top standing in for
+    // everything above it, has to be a perfect maze. Each band made on its
+    // own has to match the same rows made one after the other.
+    {
+        const int W = 257, BAND = 16, FIRST = -3, BANDS = 8;
+
+        Maze window;
+        window.seed = seed;
+        window.passages = Grid<uint8_t>(W, BANDS * BAND + 1, 0);
+
+        std::vector<uint8_t> doors(W);
+        EllerRows::Doors(W, seed, FIRST, doors.data());
+        for (int x = 0; x < W; x++) {
+            window.passages(x, 0) = (x < W - 1 ? Maze::EAST : 0) | (doors[x] ? Maze::SOUTH : 0);
+        }
+
+        EllerRows rows(W, BAND, seed, FIRST);
+        for (int y = 1; y <= BANDS * BAND; y++) rows.next(&window.passages(0, y));
+
+        bool bands_match = true;
+        for (int b = 0; b < BANDS; b++) {
+            Grid<uint8_t> band = EllerRows::Band(W, BAND, seed, FIRST + b);
+            bands_match = std::equal(band.cells.begin(), band.cells.end(), &window.passages(0, 1 + b * BAND)) && bands_match;
+        }
+
+        for (int x = 0; x < W; x++) window.passages(x, BANDS * BAND) &= ~Maze::SOUTH;
+
+        bool perfect = window.isPerfect();
+        printf("eller bands: %s, %s\n",
+            perfect ? "perfect" : "NOT PERFECT",
+            bands_match ? "independent" : "DEPEND ON ORDER");
+        ok = perfect && bands_match && ok;
+    }
+
+    // Same seed, same maze
+    Maze a = Maze::Wilson(257, 129, seed), b = Maze::Wilson(257, 129, seed), c = Maze::Wilson(257, 129, seed + 1);
+    bool reproducible = a.passages.cells == b.passages.cells && a.passages.cells != c.passages.cells;
+    printf("reproducible from seed: %s\n", reproducible ? "yes" : "NO");
+
+    // What greedy meshing makes of the game's maze
+    Grid<Maze::TileType> tiles = Maze::Default(30, 30, seed).tiles();
+    MazeGeometry geometry = MeshMaze(tiles);
+    printf("meshed %d x %d tiles: %zu triangles, %zu as one cube per tile\n",
+        tiles.width, tiles.height, geometry.triangles(), MazeCubeTriangles(tiles));
+
+    return ok && reproducible ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+// Prints vertex and index memory per model, as parsed and as uploaded after
+// OptimizeMesh and packing, along with the worst error the packing introduces
+// and the vertex cache misses per triangle (ACMR) before and after.
+//
+//     make vertexreport
+//     ./vertexreport res/nanosuit/nanosuit.obj ...
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "../vertexformat.h"
+#include "../meshopt.h"
+
+struct Totals {
+    size_t vertices, indices;
+    size_t bytes_before, bytes_after;
+    float position_error;
+    float normal_error; // degrees
+
+    // ACMR summed over triangles, divided out per model
+    size_t triangles_before, triangles_after;
+    double misses_before, misses_after;
+};
+
+static glm::vec3 octahedralDecode(int16_t x, int16_t y) {
+    glm::vec2 e = glm::max(glm::vec2(x / 32767.0f, y / 32767.0f), glm::vec2(-1.0f));
+    glm::vec3 n = glm::vec3(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+    float t = glm::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+static void measure(const aiMesh* mesh, Totals& totals) {
+    std::vector<Vertex> vertices(mesh->mNumVertices);
+
+    for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+        Vertex& v = vertices[i];
+        v.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+        v.Normal = mesh->mNormals ? glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z) : glm::vec3(0.0f);
+        v.Tangent = mesh->mTangents ? glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z) : glm::vec3(0.0f);
+        v.Bitangent = mesh->mBitangents ? glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z) : glm::vec3(0.0f);
+        v.TexCoords = mesh->mTextureCoords[0] ? glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y) : glm::vec2(0.0f);
+    }
+
+    std::vector<unsigned int> indices;
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+        for (unsigned int j = 0; j < mesh->mFaces[i].mNumIndices; j++) {
+            indices.push_back(mesh->mFaces[i].mIndices[j]);
+        }
+    }
+
+    totals.vertices += vertices.size();
+    totals.indices += indices.size();
+    totals.bytes_before += vertices.size() * sizeof(Vertex) + indices.size() * 4;
+
+    // Same steps as the Mesh constructor and GeometryBuffer::allocate
+    MeshOptimizationReport r = OptimizeMesh(vertices, indices);
+    totals.triangles_before += r.triangles_before;
+    totals.triangles_after += r.triangles_after;
+    totals.misses_before += r.before.acmr * r.triangles_before;
+    totals.misses_after += r.after.acmr * r.triangles_after;
+
+    PreparedMesh prepared;
+    PrepareMesh(vertices, indices, ChooseVertexFormat(vertices), prepared);
+
+    totals.bytes_after += prepared.vertex_data.size() + prepared.index_data.size();
+
+    if (prepared.format != VERTEX_PACKED) return;
+
+    const PositionDequantize& d = prepared.dequantize;
+    const PackedVertex* packed = (const PackedVertex*)prepared.vertex_data.data();
+
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const PackedVertex& p = packed[i];
+
+        glm::vec3 q = glm::vec3(p.position[0], p.position[1], p.position[2]) / 65535.0f;
+        glm::vec3 position = q * d.scale + d.offset;
+        totals.position_error = glm::max(totals.position_error, glm::length(position - vertices[i].Position));
+
+        if (glm::dot(vertices[i].Normal, vertices[i].Normal) > 0.0f) {
+            glm::vec3 n = octahedralDecode(p.normal[0], p.normal[1]);
+            float c = glm::clamp(glm::dot(n, glm::normalize(vertices[i].Normal)), -1.0f, 1.0f);
+            totals.normal_error = glm::max(totals.normal_error, (float)(std::acos(c) * 180.0 / M_PI));
+        }
+    }
+}
+
+static void walk(const aiNode* node, const aiScene* scene, Totals& totals) {
+    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+        measure(scene->mMeshes[node->mMeshes[i]], totals);
+    }
+    for (unsigned int i = 0; i < node->mNumChildren; i++) {
+        walk(node->mChildren[i], scene, totals);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <model>...\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-48s %9s %9s %8s %8s %10s %10s %9s %8s %6s %6s\n",
+        "model", "vertices", "indices", "B/vert", "B/vert'", "KiB", "KiB'", "pos err", "nrm err", "ACMR", "ACMR'");
+
+    for (int i = 1; i < argc; i++) {
+        // Same flags as Model::loadModel
+        Assimp::Importer import;
+        const aiScene* scene = import.ReadFile(argv[i], aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+            printf("%-48s %s\n", argv[i], import.GetErrorString());
+            continue;
+        }
+
+        Totals t = {};
+        walk(scene->mRootNode, scene, t);
+
+        // Index bytes are spread over the parsed vertices, so both columns are per the same vertex
+        double before = t.vertices ? (double)t.bytes_before / t.vertices : 0.0;
+        double after = t.vertices ? (double)t.bytes_after / t.vertices : 0.0;
+
+        double acmr_before = t.triangles_before ? t.misses_before / t.triangles_before : 0.0;
+        double acmr_after = t.triangles_after ? t.misses_after / t.triangles_after : 0.0;
+
+        printf("%-48s %9zu %9zu %8.1f %8.1f %10.1f %10.1f %9.2e %7.3f %6.3f %6.3f\n",
+            argv[i], t.vertices, t.indices, before, after,
+            t.bytes_before / 1024.0, t.bytes_after / 1024.0,
+            t.position_error, t.normal_error, acmr_before, acmr_after);
+    }
+
+    return 0;
+}
@@ -0,0 +1,375 @@
+#include "transform.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define TRANSFORM_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace {
+
+struct State {
+    std::vector<float> px, py, pz;
+    std::vector<float> qx, qy, qz, qw;
+    std::vector<float> sx, sy, sz;
+
+    // Children are a singly linked list hanging off the parent
+    std::vector<TransformId> parent, first_child, next_sibling;
+
+    std::vector<glm::mat4> offset, local, world, model;
+
+    std::vector<unsigned char> live, dirty;
+
+    std::vector<TransformId> free;
+    std::vector<TransformId> dirty_list;
+    std::vector<TransformId> changed;
+
+    // Kept around so walking the hierarchy doesn't allocate every frame
+    std::vector<TransformId> stack;
+
+    unsigned int composed, worlds;
+};
+
+State state;
+
+void markDirty(TransformId id) {
+    if (state.dirty[id]) return;
+    state.dirty[id] = 1;
+    state.dirty_list.push_back(id);
+}
+
+void unlink(TransformId id) {
+    TransformId p = state.parent[id];
+    if (p == NO_TRANSFORM) return;
+
+    TransformId* link = &state.first_child[p];
+    while (*link != id) link = &state.next_sibling[*link];
+    *link = state.next_sibling[id];
+
+    state.parent[id] = NO_TRANSFORM;
+    state.next_sibling[id] = NO_TRANSFORM;
+}
+
+// out = a * b, out may be b
+void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+#ifdef TRANSFORM_SSE
+    __m128 a0 = _mm_loadu_ps(&a[0][0]);
+    __m128 a1 = _mm_loadu_ps(&a[1][0]);
+    __m128 a2 = _mm_loadu_ps(&a[2][0]);
+    __m128 a3 = _mm_loadu_ps(&a[3][0]);
+
+    for (int j = 0; j < 4; j++) {
+        __m128 column = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(b[j][0])), _mm_mul_ps(a1, _mm_set1_ps(b[j][1]))),
+            _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(b[j][2])), _mm_mul_ps(a3, _mm_set1_ps(b[j][3])))
+        );
+        _mm_storeu_ps(&out[j][0], column);
+    }
+#else
+    out = a * b;
+#endif
+}
+
+// translate * rotate * scale written out, the rotation being the usual
+// unit quaternion to matrix expansion with each column scaled
+void composeOne(TransformId id) {
+    float x = state.qx[id], y = state.qy[id], z = state.qz[id], w = state.qw[id];
+    float sx = state.sx[id], sy = state.sy[id], sz = state.sz[id];
+
+    glm::mat4& m = state.local[id];
+
+    m[0][0] = (1.0f - 2.0f * (y * y + z * z)) * sx;
+    m[0][1] = 2.0f * (x * y + w * z) * sx;
+    m[0][2] = 2.0f * (x * z - w * y) * sx;
+    m[0][3] = 0.0f;
+
+    m[1][0] = 2.0f * (x * y - w * z) * sy;
+    m[1][1] = (1.0f - 2.0f * (x * x + z * z)) * sy;
+    m[1][2] = 2.0f * (y * z + w * x) * sy;
+    m[1][3] = 0.0f;
+
+    m[2][0] = 2.0f * (x * z + w * y) * sz;
+    m[2][1] = 2.0f * (y * z - w * x) * sz;
+    m[2][2] = (1.0f - 2.0f * (x * x + y * y)) * sz;
+    m[2][3] = 0.0f;
+
+    m[3] = glm::vec4(state.px[id], state.py[id], state.pz[id], 1.0f);
+}
+
+// Same as composeOne over every id at once, four lanes at a time
+void composeLocals(const TransformId* ids, size_t count) {
+    size_t i = 0;
+
+#ifdef TRANSFORM_SSE
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+
+    for (; i + 4 <= count; i += 4) {
+        TransformId a = ids[i], b = ids[i + 1], c = ids[i + 2], d = ids[i + 3];
+
+#define GATHER(v) _mm_setr_ps(state.v[a], state.v[b], state.v[c], state.v[d])
+        __m128 x = GATHER(qx), y = GATHER(qy), z = GATHER(qz), w = GATHER(qw);
+        __m128 sx = GATHER(sx), sy = GATHER(sy), sz = GATHER(sz);
+        __m128 tx = GATHER(px), ty = GATHER(py), tz = GATHER(pz);
+#undef GATHER
+
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        // One register per matrix element, one lane per transform
+        __m128 m00 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+        __m128 m01 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+        __m128 m02 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+
+        __m128 m10 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+        __m128 m11 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+        __m128 m12 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+
+        __m128 m20 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+        __m128 m21 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+        __m128 m22 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+
+        __m128 m03 = _mm_setzero_ps(), m13 = _mm_setzero_ps(), m23 = _mm_setzero_ps();
+        __m128 m33 = one;
+
+        // Turns element-per-register into column-per-register, one transform each
+        _MM_TRANSPOSE4_PS(m00, m01, m02, m03);
+        _MM_TRANSPOSE4_PS(m10, m11, m12, m13);
+        _MM_TRANSPOSE4_PS(m20, m21, m22, m23);
+        _MM_TRANSPOSE4_PS(tx, ty, tz, m33);
+
+        _mm_storeu_ps(&state.local[a][0][0], m00);
+        _mm_storeu_ps(&state.local[b][0][0], m01);
+        _mm_storeu_ps(&state.local[c][0][0], m02);
+        _mm_storeu_ps(&state.local[d][0][0], m03);
+
+        _mm_storeu_ps(&state.local[a][1][0], m10);
+        _mm_storeu_ps(&state.local[b][1][0], m11);
+        _mm_storeu_ps(&state.local[c][1][0], m12);
+        _mm_storeu_ps(&state.local[d][1][0], m13);
+
+        _mm_storeu_ps(&state.local[a][2][0], m20);
+        _mm_storeu_ps(&state.local[b][2][0], m21);
+        _mm_storeu_ps(&state.local[c][2][0], m22);
+        _mm_storeu_ps(&state.local[d][2][0], m23);
+
+        _mm_storeu_ps(&state.local[a][3][0], tx);
+        _mm_storeu_ps(&state.local[b][3][0], ty);
+        _mm_storeu_ps(&state.local[c][3][0], tz);
+        _mm_storeu_ps(&state.local[d][3][0], m33);
+    }
+#endif
+
+    for (; i < count; i++) {
+        composeOne(ids[i]);
+    }
+}
+
+// Parents come off the stack before their children go on, so every world
+// matrix is built from an up to date parent
+void updateSubtree(TransformId root) {
+    state.stack.push_back(root);
+
+    while (!state.stack.empty()) {
+        TransformId id = state.stack.back();
+        state.stack.pop_back();
+
+        TransformId p = state.parent[id];
+        if (p == NO_TRANSFORM) state.world[id] = state.local[id];
+        else multiply(state.world[p], state.local[id], state.world[id]);
+
+        multiply(state.world[id], state.offset[id], state.model[id]);
+
+        state.changed.push_back(id);
+        state.worlds++;
+
+        for (TransformId c = state.first_child[id]; c != NO_TRANSFORM; c = state.next_sibling[c]) {
+            state.stack.push_back(c);
+        }
+    }
+}
+
+}
+
+TransformId Transforms::create() {
+    TransformId id;
+
+    if (!state.free.empty()) {
+        id = state.free.back();
+        state.free.pop_back();
+    }
+    else {
+        id = state.live.size();
+
+        state.px.push_back(0.0f); state.py.push_back(0.0f); state.pz.push_back(0.0f);
+        state.qx.push_back(0.0f); state.qy.push_back(0.0f); state.qz.push_back(0.0f); state.qw.push_back(1.0f);
+        state.sx.push_back(1.0f); state.sy.push_back(1.0f); state.sz.push_back(1.0f);
+
+        state.parent.push_back(NO_TRANSFORM);
+        state.first_child.push_back(NO_TRANSFORM);
+        state.next_sibling.push_back(NO_TRANSFORM);
+
+        state.offset.push_back(glm::mat4(1.0f));
+        state.local.push_back(glm::mat4(1.0f));
+        state.world.push_back(glm::mat4(1.0f));
+        state.model.push_back(glm::mat4(1.0f));
+
+        state.live.push_back(0);
+        state.dirty.push_back(0);
+    }
+
+    state.px[id] = state.py[id] = state.pz[id] = 0.0f;
+    state.qx[id] = state.qy[id] = state.qz[id] = 0.0f;
+    state.qw[id] = 1.0f;
+    state.sx[id] = state.sy[id] = state.sz[id] = 1.0f;
+
+    state.offset[id] = state.local[id] = state.world[id] = state.model[id] = glm::mat4(1.0f);
+
+    state.live[id] = 1;
+    markDirty(id);
+
+    return id;
+}
+
+void Transforms::destroy(TransformId id) {
+    if (id >= state.live.size() || !state.live[id]) return;
+
+    unlink(id);
+
+    // Orphans become roots where they are
+    TransformId c = state.first_child[id];
+    while (c != NO_TRANSFORM) {
+        TransformId next = state.next_sibling[c];
+        state.parent[c] = NO_TRANSFORM;
+        state.next_sibling[c] = NO_TRANSFORM;
+        markDirty(c);
+        c = next;
+    }
+    state.first_child[id] = NO_TRANSFORM;
+
+    // Might still be on the dirty list, update() skips it
+    state.live[id] = 0;
+    state.free.push_back(id);
+}
+
+void Transforms::setPosition(TransformId id, const glm::vec3& position) {
+    state.px[id] = position.x;
+    state.py[id] = position.y;
+    state.pz[id] = position.z;
+    markDirty(id);
+}
+
+void Transforms::setRotation(TransformId id, const glm::quat& rotation) {
+    glm::quat q = glm::normalize(rotation);
+    state.qx[id] = q.x;
+    state.qy[id] = q.y;
+    state.qz[id] = q.z;
+    state.qw[id] = q.w;
+    markDirty(id);
+}
+
+void Transforms::setScale(TransformId id, const glm::vec3& scale) {
+    state.sx[id] = scale.x;
+    state.sy[id] = scale.y;
+    state.sz[id] = scale.z;
+    markDirty(id);
+}
+
+void Transforms::setOffset(TransformId id, const glm::mat4& offset) {
+    state.offset[id] = offset;
+    markDirty(id);
+}
+
+bool Transforms::setParent(TransformId id, TransformId parent) {
+    for (TransformId p = parent; p != NO_TRANSFORM; p = state.parent[p]) {
+        if (p == id) return false;
+    }
+
+    unlink(id);
+
+    if (parent != NO_TRANSFORM) {
+        state.parent[id] = parent;
+        state.next_sibling[id] = state.first_child[parent];
+        state.first_child[parent] = id;
+    }
+
+    markDirty(id);
+    return true;
+}
+
+glm::vec3 Transforms::position(TransformId id) {
+    return glm::vec3(state.px[id], state.py[id], state.pz[id]);
+}
+
+glm::quat Transforms::rotation(TransformId id) {
+    return glm::quat(state.qw[id], state.qx[id], state.qy[id], state.qz[id]);
+}
+
+glm::vec3 Transforms::scale(TransformId id) {
+    return glm::vec3(state.sx[id], state.sy[id], state.sz[id]);
+}
+
+TransformId Transforms::parent(TransformId id) {
+    return state.parent[id];
+}
+
+const glm::mat4& Transforms::local(TransformId id) {
+    return state.local[id];
+}
+
+const glm::mat4& Transforms::world(TransformId id) {
+    return state.world[id];
+}
+
+const glm::mat4& Transforms::model(TransformId id) {
+    return state.model[id];
+}
+
+void Transforms::update() {
+    state.changed.clear();
+    state.composed = 0;
+    state.worlds = 0;
+
+    if (state.dirty_list.empty()) return;
+
+    // Destroyed since being marked
+    size_t n = 0;
+    for (TransformId id : state.dirty_list) {
+        if (state.live[id]) state.dirty_list[n++] = id;
+        else state.dirty[id] = 0;
+    }
+    state.dirty_list.resize(n);
+
+    composeLocals(state.dirty_list.data(), n);
+    state.composed = n;
+
+    for (TransformId id : state.dirty_list) {
+        // A dirty ancestor's walk gets to this one anyway
+        bool covered = false;
+        for (TransformId p = state.parent[id]; p != NO_TRANSFORM; p = state.parent[p]) {
+            if (state.dirty[p]) {
+                covered = true;
+                break;
+            }
+        }
+
+        if (!covered) updateSubtree(id);
+    }
+
+    for (TransformId id : state.dirty_list) {
+        state.dirty[id] = 0;
+    }
+    state.dirty_list.clear();
+}
+
+const std::vector<TransformId>& Transforms::changed() {
+    return state.changed;
+}
+
+Transforms::Stats Transforms::stats() {
+    Stats s;
+    s.live = state.live.size() - state.free.size();
+    s.composed = state.composed;
+    s.worlds = state.worlds;
+    return s;
+}
@@ -0,0 +1,71 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <vector>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+typedef uint32_t TransformId;
+
+// For a root's parent, and anything that never got a transform
+#define NO_TRANSFORM 0xFFFFFFFF
+
+// Every entity's position, rotation and scale, kept apart per component so
+// recomposition can stream through them four at a time like the culling
+// does. Setters only store the value and mark it dirty, the matrices are
+// rebuilt once a frame in update(), and only for what changed. A change
+// dirties everything below it in the hierarchy as well.
+//
+// world = parent's world * translate * rotate * scale, and what gets drawn
+// is model = world * offset, where the offset is the model's own import
+// transform and so isn't passed on to children. Ids are reused after
+// destroy(). Main thread only.
+class Transforms {
+public:
+    struct Stats {
+        unsigned int live;
+        unsigned int composed; // Local matrices rebuilt by the last update()
+        unsigned int worlds;   // World matrices rebuilt, including children
+    };
+
+    static TransformId create();
+    static void destroy(TransformId id);
+
+    static void setPosition(TransformId id, const glm::vec3& position);
+    static void setRotation(TransformId id, const glm::quat& rotation);
+    static void setScale(TransformId id, const glm::vec3& scale);
+    static void setOffset(TransformId id, const glm::mat4& offset);
+
+    // NO_TRANSFORM makes it a root again. Refused, returning false, when it
+    // would make a cycle.
+    static bool setParent(TransformId id, TransformId parent);
+
+    static glm::vec3 position(TransformId id);
+    static glm::quat rotation(TransformId id);
+    static glm::vec3 scale(TransformId id);
+    static TransformId parent(TransformId id);
+
+    // As of the last update()
+    static const glm::mat4& local(TransformId id);
+    static const glm::mat4& world(TransformId id);
+    static const glm::mat4& model(TransformId id);
+
+    // Once a frame, before anything reads world matrices
+    static void update();
+
+    // Whose matrices moved in the last update(), parents before children
+    static const std::vector<TransformId>& changed();
+
+    static Stats stats();
+};
+
+// Same order the Euler angles were always applied in, z then y then x
+inline glm::quat EulerRotation(const glm::vec3& angles) {
+    return glm::angleAxis(angles.z, glm::vec3(0, 0, 1))
+         * glm::angleAxis(angles.y, glm::vec3(0, 1, 0))
+         * glm::angleAxis(angles.x, glm::vec3(1, 0, 0));
+}
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef UBO_H
+#define UBO_H
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "shader.h"
+#include "clusters.h"
+
+// Fixed binding points, wired up to the named blocks in Shader::setup_handles
+#define FRAME_CONSTANTS_BINDING 0
+#define LIGHTS_BINDING          1
+
+// Storage buffers, these have their binding written out in shaders/lighting.glsl
+#define POINT_LIGHTS_BINDING    5
+#define LIGHT_CLUSTERS_BINDING  6
+#define LIGHT_INDICES_BINDING   7
+
+// Everything below is laid out by hand to match std140, the GLSL side
+// lives in shaders/*.vert and shaders/lighting.glsl. GPUPointLight comes out
+// the same under std430, where the point lights live.
+
+struct FrameConstants {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 eye_position;
+
+    static FrameConstants FromCamera(const Camera& camera) {
+        FrameConstants f;
+        f.view = camera.getViewMatrix();
+        f.projection = camera.getProjectionMatrix();
+        f.eye_position = glm::vec4(camera.position, 1.0f);
+        return f;
+    }
+};
+
+struct GPUPointLight {
+    glm::vec4 position;
+    glm::vec4 color;
+    float radius;
+    int is_lit;
+    int padding[2];
+};
+
+struct GPUDirectionalLight {
+    glm::vec4 direction;
+    glm::vec4 ambient;
+    glm::vec4 color;
+    int is_lit;
+    int padding[3];
+};
+
+struct LightsBlock {
+    int point_light_count;
+    int directional_light_count;
+    int padding[2];
+
+    // What a fragment needs to find its cluster, see LightClusters
+    glm::uvec4 cluster_grid;   // xyz: clusters across, down and deep
+    glm::vec4  cluster_depth;  // x: near plane, y: slice scale
+    glm::vec4  cluster_screen; // xy: clusters per pixel
+
+    GPUDirectionalLight directional_lights[MAX_NR_OF_DIRECTIONAL_LIGHTS];
+
+    // Point lights themselves go in a storage buffer, this only says how many
+    static LightsBlock FromLights(
+        int point_light_count,
+        const std::vector<DirectionalLight>& directionals,
+        const LightClusters& clusters,
+        const glm::vec2& viewport
+    ) {
+        LightsBlock b;
+        b.point_light_count = point_light_count;
+        b.directional_light_count = glm::min((int)directionals.size(), MAX_NR_OF_DIRECTIONAL_LIGHTS);
+
+        b.cluster_grid = glm::uvec4(clusters.width(), clusters.height(), clusters.depth(), 0);
+        b.cluster_depth = glm::vec4(Camera::NEAR_PLANE, clusters.sliceScale(), 0.0f, 0.0f);
+        b.cluster_screen = glm::vec4(clusters.width() / viewport.x, clusters.height() / viewport.y, 0.0f, 0.0f);
+
+        for (int i = 0; i < b.directional_light_count; i++) {
+            b.directional_lights[i].direction = directionals[i].direction;
+            b.directional_lights[i].ambient = directionals[i].ambient;
+            b.directional_lights[i].color = directionals[i].color;
+            b.directional_lights[i].is_lit = directionals[i].is_lit;
+        }
+
+        return b;
+    }
+};
+
+// One buffer per block, shared by every program that declares it.
+// The GL object is made on first upload so these can live in globals
+// that are constructed before there is a context.
+template <class T>
+class UniformBuffer {
+private:
+    GLuint ubo;
+    GLuint binding;
+
+public:
+    static UniformBuffer AtBinding(GLuint binding) {
+        UniformBuffer u;
+        u.ubo = 0;
+        u.binding = binding;
+        return u;
+    }
+
+    void upload(const T& data) {
+        if (ubo == 0) {
+            glGenBuffers(1, &ubo);
+            glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_DYNAMIC_DRAW);
+            glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+        }
+
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+    }
+};
+
+// Same idea for arrays that change length, read through std430 buffer
+// blocks. Grows when it has to and never shrinks.
+template <class T>
+class StorageBuffer {
+private:
+    GLuint ssbo;
+    GLuint binding;
+    size_t capacity;
+
+public:
+    static StorageBuffer AtBinding(GLuint binding) {
+        StorageBuffer s;
+        s.ssbo = 0;
+        s.binding = binding;
+        s.capacity = 0;
+        return s;
+    }
+
+    void upload(const T* data, size_t count) {
+        if (ssbo == 0) {
+            glGenBuffers(1, &ssbo);
+        }
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+
+        // An empty buffer can't be bound, so there is always room for one
+        if (count > capacity || capacity == 0) {
+            capacity = glm::max(count + count / 2, (size_t)1);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(T), NULL, GL_DYNAMIC_DRAW);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, ssbo);
+        }
+
+        if (count > 0) {
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(T), data);
+        }
+    }
+
+    void upload(const std::vector<T>& data) {
+        upload(data.empty() ? NULL : &data[0], data.size());
+    }
+};
+
+#endif
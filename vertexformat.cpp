@@ -0,0 +1,195 @@
+#include "vertexformat.h"
+
+#include <cmath>
+#include <cstring>
+
+PositionDequantize PositionDequantize::Identity() {
+    PositionDequantize d;
+    d.offset = glm::vec3(0.0f);
+    d.scale = glm::vec3(1.0f);
+    return d;
+}
+
+PositionDequantize PositionDequantize::FromVertices(const std::vector<Vertex>& vertices) {
+    glm::vec3 min = glm::vec3(INFINITY);
+    glm::vec3 max = glm::vec3(-INFINITY);
+
+    for (const Vertex& v : vertices) {
+        min = glm::min(min, v.Position);
+        max = glm::max(max, v.Position);
+    }
+
+    if (vertices.empty()) {
+        min = glm::vec3(0.0f);
+        max = glm::vec3(0.0f);
+    }
+
+    PositionDequantize d;
+    d.offset = min;
+    d.scale = max - min;
+    return d;
+}
+
+size_t VertexFormatStride(VertexFormat format) {
+    return format == VERTEX_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+VertexFormat ChooseVertexFormat(const std::vector<Vertex>& vertices) {
+    PositionDequantize d = PositionDequantize::FromVertices(vertices);
+    float extent = glm::max(d.scale.x, glm::max(d.scale.y, d.scale.z));
+
+    // Rounding is off by at most half a step
+    float error = 0.5f * extent / 65535.0f;
+    return error <= MAX_POSITION_ERROR ? VERTEX_PACKED : VERTEX_FULL;
+}
+
+static float signNotZero(float v) {
+    return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+// "A Survey of Efficient Representations for Independent Unit Vectors", Cigolle et al. 2014
+glm::vec2 OctahedralEncode(glm::vec3 n) {
+    float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (l1 == 0.0f) return glm::vec2(0.0f);
+
+    glm::vec2 p = glm::vec2(n.x, n.y) / l1;
+    if (n.z < 0.0f) {
+        p = glm::vec2(
+            (1.0f - std::fabs(p.y)) * signNotZero(p.x),
+            (1.0f - std::fabs(p.x)) * signNotZero(p.y)
+        );
+    }
+    return p;
+}
+
+// Round to nearest, ties away from zero. Denormals are kept, NaN stays NaN.
+uint16_t FloatToHalf(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+
+    uint16_t sign = (x >> 16) & 0x8000;
+    int exponent = (int)((x >> 23) & 0xFF);
+    uint32_t mantissa = x & 0x7FFFFF;
+
+    if (exponent == 0xFF) {
+        return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+    }
+
+    exponent = exponent - 127 + 15;
+
+    if (exponent >= 31) {
+        return sign | 0x7C00;
+    }
+
+    if (exponent <= 0) {
+        if (exponent < -10) return sign;
+
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint16_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) half++;
+        return sign | half;
+    }
+
+    // A carry out of the mantissa correctly bumps the exponent
+    uint16_t half = sign | (exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) half++;
+    return half;
+}
+
+static int16_t snorm16(float v) {
+    return (int16_t)std::floor(glm::clamp(v, -1.0f, 1.0f) * 32767.0f + 0.5f);
+}
+
+static uint16_t unorm16(float v) {
+    return (uint16_t)std::floor(glm::clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+static uint32_t snorm10(float v) {
+    int i = (int)std::floor(glm::clamp(v, -1.0f, 1.0f) * 511.0f + 0.5f);
+    return (uint32_t)i & 0x3FF;
+}
+
+// Meshes without tangents (the procedural ones) still need something
+// perpendicular to the normal for the shader to build a frame from
+static glm::vec3 anyTangent(glm::vec3 n) {
+    glm::vec3 axis = std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    return glm::normalize(glm::cross(axis, n));
+}
+
+void PackVertices(const std::vector<Vertex>& vertices, const PositionDequantize& dequantize, std::vector<PackedVertex>& out) {
+    out.resize(vertices.size());
+
+    // Flat axes quantize to 0 and decode to offset
+    glm::vec3 inverse_scale = glm::vec3(
+        dequantize.scale.x > 0.0f ? 1.0f / dequantize.scale.x : 0.0f,
+        dequantize.scale.y > 0.0f ? 1.0f / dequantize.scale.y : 0.0f,
+        dequantize.scale.z > 0.0f ? 1.0f / dequantize.scale.z : 0.0f
+    );
+
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const Vertex& v = vertices[i];
+        PackedVertex& p = out[i];
+
+        glm::vec3 q = (v.Position - dequantize.offset) * inverse_scale;
+        p.position[0] = unorm16(q.x);
+        p.position[1] = unorm16(q.y);
+        p.position[2] = unorm16(q.z);
+        p.position[3] = 0;
+
+        glm::vec3 n = v.Normal;
+        bool has_normal = glm::dot(n, n) > 0.0f;
+        n = has_normal ? glm::normalize(n) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+        glm::vec2 oct = OctahedralEncode(n);
+        p.normal[0] = snorm16(oct.x);
+        p.normal[1] = snorm16(oct.y);
+
+        // Same orthogonalization shader.vert does, done once here instead
+        glm::vec3 t = v.Tangent - glm::dot(v.Tangent, n) * n;
+        t = glm::dot(t, t) > 1e-12f ? glm::normalize(t) : anyTangent(n);
+
+        // Matches the handedness test shader.vert used to do with the full bitangent
+        float sign = glm::dot(glm::cross(n, t), v.Bitangent) < 0.0f ? -1.0f : 1.0f;
+
+        p.tangent = snorm10(t.x) | (snorm10(t.y) << 10) | (snorm10(t.z) << 20) | ((sign < 0.0f ? 3u : 1u) << 30);
+
+        p.uv[0] = FloatToHalf(v.TexCoords.x);
+        p.uv[1] = FloatToHalf(v.TexCoords.y);
+    }
+}
+
+void PrepareMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, VertexFormat format, PreparedMesh& out) {
+    out.format = format;
+    out.vertex_count = vertices.size();
+    out.index_count = indices.empty() ? vertices.size() : indices.size();
+
+    // Indices are relative to base_vertex, so what matters is this mesh's size alone
+    out.index_size = vertices.size() <= 65536 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    if (format == VERTEX_PACKED) {
+        out.dequantize = PositionDequantize::FromVertices(vertices);
+
+        std::vector<PackedVertex> packed;
+        PackVertices(vertices, out.dequantize, packed);
+        out.vertex_data.assign((const unsigned char*)packed.data(), (const unsigned char*)(packed.data() + packed.size()));
+    }
+    else {
+        out.dequantize = PositionDequantize::Identity();
+        out.vertex_data.assign((const unsigned char*)vertices.data(), (const unsigned char*)(vertices.data() + vertices.size()));
+    }
+
+    out.index_data.resize(out.index_count * out.index_size);
+
+    for (size_t i = 0; i < out.index_count; i++) {
+        uint32_t index = indices.empty() ? i : indices[i];
+
+        if (out.index_size == sizeof(uint16_t)) {
+            uint16_t narrow = index;
+            std::memcpy(&out.index_data[i * sizeof(uint16_t)], &narrow, sizeof(narrow));
+        }
+        else {
+            std::memcpy(&out.index_data[i * sizeof(uint32_t)], &index, sizeof(index));
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <vector>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+// Nothing in here touches GL so that offline tools can pack meshes too
+
+// Zeroed by default, welding compares vertices bytewise and not every
+// mesh fills in every attribute
+struct Vertex {
+    glm::vec3 Position  = glm::vec3(0.0f);
+    glm::vec3 Normal    = glm::vec3(0.0f);
+    glm::vec3 Tangent   = glm::vec3(0.0f);
+    glm::vec3 Bitangent = glm::vec3(0.0f);
+    glm::vec2 TexCoords = glm::vec2(0.0f);
+};
+
+// 20 bytes instead of 56. Decoded in shaders/shader.vert.
+struct PackedVertex {
+    uint16_t position[4]; // unorm16 inside the mesh bounds, w unused
+    int16_t  normal[2];   // octahedral, snorm16
+    uint32_t tangent;     // snorm 2_10_10_10_REV, w is the bitangent sign
+    uint16_t uv[2];       // half floats
+};
+
+enum VertexFormat {
+    VERTEX_FULL = 0,
+    VERTEX_PACKED = 1,
+    VERTEX_FORMAT_COUNT = 2
+};
+
+// Largest position error, in model units, we accept before falling back to full floats
+#define MAX_POSITION_ERROR 0.001f
+
+// Maps unorm16 positions back into the mesh, position = q * scale + offset.
+// The identity for full float vertices.
+struct PositionDequantize {
+    glm::vec3 offset;
+    glm::vec3 scale;
+
+    static PositionDequantize Identity();
+    static PositionDequantize FromVertices(const std::vector<Vertex>& vertices);
+};
+
+size_t VertexFormatStride(VertexFormat format);
+
+// Packed unless the mesh is too large to quantize within MAX_POSITION_ERROR
+VertexFormat ChooseVertexFormat(const std::vector<Vertex>& vertices);
+
+void PackVertices(const std::vector<Vertex>& vertices, const PositionDequantize& dequantize, std::vector<PackedVertex>& out);
+
+// Vertex and index bytes exactly as they go into the GPU buffers
+struct PreparedMesh {
+    VertexFormat format;
+    PositionDequantize dequantize;
+
+    size_t vertex_count;
+    size_t index_count;
+    size_t index_size; // 2 when the mesh has few enough vertices, else 4
+
+    std::vector<unsigned char> vertex_data;
+    std::vector<unsigned char> index_data;
+};
+
+// Packs into `format` and narrows the indices. Meshes without indices
+// get 0..n-1 so that everything can be drawn as elements.
+void PrepareMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, VertexFormat format, PreparedMesh& out);
+
+glm::vec2 OctahedralEncode(glm::vec3 n);
+uint16_t FloatToHalf(float f);
+
+#endif